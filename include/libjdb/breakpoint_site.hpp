@@ -0,0 +1,58 @@
+#ifndef JDB_BREAKPOINT_SITE_HPP
+#define JDB_BREAKPOINT_SITE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <libjdb/types.hpp>
+
+namespace jdb {
+class process;
+
+/*
+ * A location in the inferior's code where execution should stop. Software sites place an int3
+ * instruction there: process patches the code when they are enabled and restores the original
+ * byte when they are disabled. Hardware sites use one of the debug registers instead and leave
+ * the code untouched.
+ */
+class breakpoint_site {
+  public:
+    breakpoint_site() = delete;
+    breakpoint_site(const breakpoint_site &) = delete;
+    breakpoint_site &operator=(const breakpoint_site &) = delete;
+
+    using id_type = std::int32_t;
+    id_type id() const { return id_; }
+
+    void enable();
+    void disable();
+
+    bool is_enabled() const { return is_enabled_; }
+    bool is_hardware() const { return is_hardware_; }
+    // Internal sites are the ones jdb sets for itself, like the return address of a step over a
+    // call. Their ids are negative, so they don't take up the user's numbers.
+    bool is_internal() const { return is_internal_; }
+    virt_addr address() const { return address_; }
+
+    bool at_address(virt_addr addr) const { return address_ == addr; }
+    bool in_range(virt_addr low, virt_addr high) const {
+        return low <= address_ && high > address_;
+    }
+
+  private:
+    friend process;
+    breakpoint_site(process &proc, virt_addr address, bool is_hardware, bool is_internal);
+
+    id_type id_;
+    process *process_;
+    virt_addr address_;
+    bool is_enabled_;
+    bool is_hardware_;
+    bool is_internal_;
+    // The byte int3 replaced, written back when the site is disabled
+    std::byte saved_data_;
+    // Index of the debug register used by hardware sites while enabled, or -1
+    int hardware_register_index_ = -1;
+};
+} // namespace jdb
+
+#endif // !JDB_BREAKPOINT_SITE_HPP
@@ -0,0 +1,99 @@
+#ifndef JDB_DETAIL_DWARF_CURSOR_HPP
+#define JDB_DETAIL_DWARF_CURSOR_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <libjdb/error.hpp>
+#include <libjdb/types.hpp>
+#include <string_view>
+
+namespace jdb::detail {
+// Reads DWARF encoded values, refusing to go past the end of its data
+class cursor {
+  public:
+    cursor(const std::byte *pos, const std::byte *end) : pos_(pos), end_(end) {}
+    explicit cursor(span<const std::byte> data) : cursor(data.begin(), data.end()) {}
+
+    bool finished() const { return pos_ >= end_; }
+    const std::byte *position() const { return pos_; }
+    const std::byte *end() const { return end_; }
+    void skip(std::uint64_t n) {
+        need(n);
+        pos_ += n;
+    }
+
+    template <class T> T fixed() {
+        need(sizeof(T));
+        T ret;
+        std::memcpy(&ret, pos_, sizeof(T));
+        pos_ += sizeof(T);
+        return ret;
+    }
+    std::uint8_t u8() { return fixed<std::uint8_t>(); }
+    std::uint16_t u16() { return fixed<std::uint16_t>(); }
+    std::uint32_t u24() {
+        auto low = u16();
+        return low | std::uint32_t(u8()) << 16;
+    }
+    std::uint32_t u32() { return fixed<std::uint32_t>(); }
+    std::uint64_t u64() { return fixed<std::uint64_t>(); }
+    std::int8_t s8() { return fixed<std::int8_t>(); }
+
+    std::uint64_t uleb() {
+        std::uint64_t ret = 0;
+        unsigned shift = 0;
+        std::uint8_t byte;
+        do {
+            byte = u8();
+            if (shift < 64)
+                ret |= std::uint64_t(byte & 0x7f) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+        return ret;
+    }
+    std::int64_t sleb() {
+        std::uint64_t ret = 0;
+        unsigned shift = 0;
+        std::uint8_t byte;
+        do {
+            byte = u8();
+            if (shift < 64)
+                ret |= std::uint64_t(byte & 0x7f) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+        if (shift < 64 && (byte & 0x40))
+            ret |= ~std::uint64_t(0) << shift;
+        return static_cast<std::int64_t>(ret);
+    }
+    std::string_view string() {
+        auto start = pos_;
+        while (pos_ < end_ && *pos_ != std::byte{0}) {
+            ++pos_;
+        }
+        need(1);
+        ++pos_;
+        return {reinterpret_cast<const char *>(start), std::size_t(pos_ - start - 1)};
+    }
+
+    // Reads the initial length of a unit, which also tells whether it uses 64 bit offsets
+    std::uint64_t initial_length(bool &is_64) {
+        auto length = u32();
+        is_64 = length == 0xffffffff;
+        return is_64 ? u64() : length;
+    }
+    std::uint64_t offset(bool is_64) { return is_64 ? u64() : u32(); }
+    std::uint64_t address(std::uint8_t size) { return size == 8 ? u64() : u32(); }
+
+  private:
+    void need(std::uint64_t n) const {
+        if (std::uint64_t(end_ - pos_) < n) {
+            error::send("Malformed DWARF: read past the end of a section");
+        }
+    }
+
+    const std::byte *pos_;
+    const std::byte *end_;
+};
+} // namespace jdb::detail
+
+#endif // !JDB_DETAIL_DWARF_CURSOR_HPP
@@ -0,0 +1,77 @@
+#ifndef JDB_DWARF_HPP
+#define JDB_DWARF_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <libjdb/elf.hpp>
+#include <libjdb/types.hpp>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace jdb {
+// A row of a line table
+struct line_entry {
+    // Where the row's instructions start, load bias included
+    virt_addr address;
+    // Owned by the dwarf object the entry came from
+    std::string_view file;
+    std::uint64_t line;
+    // Whether the row is a recommended place for a breakpoint (or a step) to stop at
+    bool is_stmt;
+};
+
+/*
+ * The line tables (.debug_line, DWARF 2 to 5) of an ELF file. The address ranges of the compile
+ * units are indexed up front, from .debug_aranges when the file has it, and from the ranges of
+ * each unit (low_pc/high_pc, .debug_rnglists or .debug_ranges) otherwise. That index is saved in
+ * the file's symbol index cache, and mapped from there by later loads. The line program of a unit
+ * is only decoded the first time an address in it is looked up, into an array of rows sorted by
+ * address. Rows aren't cached, as saving them would mean decoding every unit up front, where a
+ * session only stops in a few.
+ */
+class dwarf {
+  public:
+    explicit dwarf(const elf &file);
+
+    const elf &get_elf() const { return *elf_; }
+    // The row covering the address, which is the last one at or before it in its sequence
+    std::optional<line_entry> line_entry_at_address(virt_addr address) const;
+
+    std::size_t compile_unit_count() const { return units_.size(); }
+    // Units whose line program was decoded so far
+    std::size_t decoded_unit_count() const;
+    // The unit index, in the form the index cache saves it
+    std::vector<std::uint64_t> unit_offsets() const;
+    span<const detail::indexed_unit_range> unit_ranges() const { return ranges_; }
+
+  private:
+    struct line_row {
+        std::uint64_t address;
+        std::uint32_t line;
+        std::uint16_t file;
+        std::uint8_t is_stmt;
+        std::uint8_t end_sequence;
+    };
+    struct compile_unit {
+        // Of the unit's header in .debug_info
+        std::uint64_t offset;
+        bool decoded = false;
+        std::vector<line_row> rows;
+        // Indexed by the file numbers of the rows
+        std::vector<std::string> files;
+    };
+    void index_aranges();
+    void index_unit_ranges();
+    void decode_line_program(compile_unit &unit) const;
+
+    const elf *elf_;
+    mutable std::vector<compile_unit> units_;
+    // Sorted by start. Points into the storage below, or into the index cache.
+    span<const detail::indexed_unit_range> ranges_;
+    std::vector<detail::indexed_unit_range> range_storage_;
+};
+} // namespace jdb
+
+#endif // !JDB_DWARF_HPP
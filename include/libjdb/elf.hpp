@@ -0,0 +1,167 @@
+#ifndef JDB_ELF_HPP
+#define JDB_ELF_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <elf.h>
+#include <filesystem>
+#include <libjdb/types.hpp>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace jdb {
+class call_frame_information;
+class dwarf;
+
+struct elf_symbol {
+    std::string_view name;
+    // Where the symbol is once loaded, load bias included
+    virt_addr address;
+    std::uint64_t size;
+    // STT_FUNC, STT_OBJECT...
+    unsigned char type;
+};
+
+namespace detail {
+/*
+ * Layout of a symbol index cache file: this header, then symbol_count indexed_symbols sorted by
+ * address, then the compile unit index of the line tables (unit_count offsets of units in
+ * .debug_info, and unit_range_count indexed_unit_ranges sorted by start), then name_slot_count
+ * name slots, then the names the symbols point into. The name slots are an open addressing hash
+ * table of symbol indices plus one, zero standing for a free slot. Everything is used in place
+ * from the mapping, so a cached index costs a single mmap. Line rows aren't saved: a unit's are
+ * only decoded once an address in it is looked up (see dwarf).
+ */
+struct index_file_header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t build_id_size;
+    std::uint8_t build_id[64];
+    std::uint64_t symbol_count;
+    std::uint64_t name_slot_count;
+    std::uint64_t names_size;
+    // The symbol table the index was built from: its type (SHT_SYMTAB or SHT_DYNSYM) and size
+    std::uint32_t symbol_table_type;
+    std::uint64_t symbol_table_size;
+    // Of .debug_info, which a stripped file lacks while sharing the original's build-id
+    std::uint64_t debug_info_size;
+    std::uint64_t unit_count;
+    std::uint64_t unit_range_count;
+};
+
+struct indexed_symbol {
+    // Link time address
+    std::uint64_t address;
+    std::uint64_t size;
+    // Offset of the name in the names
+    std::uint32_t name;
+    std::uint8_t type;
+};
+
+struct indexed_unit_range {
+    // Link time addresses
+    std::uint64_t start;
+    std::uint64_t end;
+    // Index of the unit among the unit offsets
+    std::uint32_t unit;
+};
+
+inline constexpr char index_magic[8] = {'J', 'D', 'B', 'I', 'N', 'D', 'E', 'X'};
+inline constexpr std::uint32_t index_version = 3;
+} // namespace detail
+
+/*
+ * An ELF file mapped read-only into jdb's memory. Nothing is copied out of it: opening one only
+ * checks the headers, and every name and section handed out points into the mapping.
+ * The symbol table (.symtab, or .dynsym for stripped files) is indexed on the first lookup: by
+ * address into a sorted array searched in O(log n), and by name into a hash table. Files with a
+ * build-id have that index saved to the cache directory (index_cache_directory), where later
+ * loads of the same build map it instead of indexing again.
+ */
+class elf {
+  public:
+    explicit elf(const std::filesystem::path &path);
+    ~elf();
+    elf(const elf &) = delete;
+    elf &operator=(const elf &) = delete;
+
+    const std::filesystem::path &path() const { return path_; }
+    const Elf64_Ehdr &header() const { return *header_; }
+
+    std::string_view get_section_name(std::size_t index) const;
+    // nullptr if there is no such section
+    const Elf64_Shdr *get_section(std::string_view name) const;
+    // Empty for missing sections, and for the ones taking no room in the file, like .bss
+    span<const std::byte> get_section_contents(std::string_view name) const;
+    // The dynamic linker the file asks for (PT_INTERP), empty for libraries and static executables
+    std::string_view interpreter() const;
+    // The GNU build-id note, empty if the file has none
+    span<const std::byte> build_id() const;
+
+    // Where the file is loaded, relative to the addresses in it. Zero for non-PIE executables.
+    std::int64_t load_bias() const { return load_bias_; }
+    void set_load_bias(std::int64_t bias) { load_bias_ = bias; }
+    // Translates between the addresses in the file and where they are loaded
+    virt_addr to_virt_addr(std::uint64_t file_address) const {
+        return virt_addr{file_address + load_bias_};
+    }
+    std::uint64_t to_file_addr(virt_addr address) const { return address.addr() - load_bias_; }
+    // Whether one of the file's loadable segments covers the address, once loaded
+    bool contains_address(virt_addr address) const;
+
+    std::optional<elf_symbol> symbol_containing_address(virt_addr address) const;
+    std::vector<elf_symbol> symbols_by_name(std::string_view name) const;
+    std::size_t symbol_count() const;
+    // Whether the symbol index was mapped from the cache rather than built from the file. Indexes
+    // the symbols if they weren't yet.
+    bool symbols_from_cache() const;
+
+    // The file's line tables, read on first use
+    const dwarf &get_dwarf() const;
+    // The compile unit index saved with the symbol index: unit offsets in .debug_info, and their
+    // ranges sorted by start. Returns false, leaving both alone, if the symbol index wasn't mapped
+    // from the cache.
+    bool cached_compile_units(span<const std::uint64_t> &offsets,
+                              span<const detail::indexed_unit_range> &ranges) const;
+    // The file's unwind tables, read on first use
+    const call_frame_information &get_call_frame_info() const;
+
+    // $XDG_CACHE_HOME/jdb, or ~/.cache/jdb. Empty if neither variable is set.
+    static std::filesystem::path index_cache_directory();
+
+  private:
+    void index_symbols() const;
+    // Maps the cached index of this build, if there's a valid one built from the same table
+    bool load_index_cache(const std::filesystem::path &path, const Elf64_Shdr &table) const;
+    // Failures are ignored: the cache only saves time
+    void write_index_cache(const std::filesystem::path &path, const Elf64_Shdr &table,
+                           std::size_t names_size) const;
+    elf_symbol make_symbol(const detail::indexed_symbol &symbol) const;
+
+    std::filesystem::path path_;
+    const std::byte *data_ = nullptr;
+    std::size_t size_ = 0;
+    const Elf64_Ehdr *header_ = nullptr;
+    span<const Elf64_Shdr> sections_;
+    span<const Elf64_Phdr> segments_;
+    std::int64_t load_bias_ = 0;
+
+    // The symbol index, pointing either into the storage below or into the cache mapping
+    mutable bool symbols_indexed_ = false;
+    mutable span<const detail::indexed_symbol> symbols_;
+    mutable span<const std::uint32_t> name_slots_;
+    mutable const char *names_ = nullptr;
+    mutable std::vector<detail::indexed_symbol> symbol_storage_;
+    mutable std::vector<std::uint32_t> name_slot_storage_;
+    mutable span<const std::uint64_t> cached_unit_offsets_;
+    mutable span<const detail::indexed_unit_range> cached_unit_ranges_;
+    mutable const std::byte *cache_map_ = nullptr;
+    mutable std::size_t cache_size_ = 0;
+    mutable std::unique_ptr<dwarf> dwarf_;
+    mutable std::unique_ptr<call_frame_information> call_frame_info_;
+};
+} // namespace jdb
+
+#endif // !JDB_ELF_HPP
@@ -0,0 +1,64 @@
+#ifndef JDB_EVENT_LOOP_HPP
+#define JDB_EVENT_LOOP_HPP
+
+#include <chrono>
+#include <csignal>
+#include <cstddef>
+#include <functional>
+#include <libjdb/process.hpp>
+#include <optional>
+#include <vector>
+
+namespace jdb {
+/*
+ * Waits for state changes of any number of processes from a single thread, without blocking in
+ * waitpid. Every registered process gets a pidfd, which becomes readable when it exits, and the
+ * loop listens to SIGCHLD through a signalfd, since that is the only notification the kernel sends
+ * for ptrace stops. Both are multiplexed with epoll, and whenever either fires the running
+ * processes are reaped with WNOHANG and their stop reasons dispatched to their callbacks.
+ *
+ * SIGCHLD is blocked in the calling thread for the lifetime of the loop. In a multithreaded
+ * debugger, it should be blocked in every other thread too, or they may swallow the signal (exits
+ * are still caught through the pidfds).
+ */
+class event_loop {
+  public:
+    using callback = std::function<void(process &, stop_reason)>;
+
+    event_loop();
+    ~event_loop();
+    event_loop(const event_loop &) = delete;
+    event_loop &operator=(const event_loop &) = delete;
+
+    void add(process &proc, callback on_stop);
+    void remove(process &proc);
+    bool empty() const { return watched_.empty(); }
+
+    // Waits until at least one running process changes state, or until the timeout expires
+    // (forever if there is none), and dispatches every pending stop. Returns the number of stops
+    // dispatched. Returns 0 right away if none of the processes is running.
+    std::size_t run_once(std::optional<std::chrono::milliseconds> timeout = std::nullopt);
+    // Dispatches stops until every registered process has either ended, been removed or been left
+    // stopped by its callback
+    void run();
+
+  private:
+    struct watched_process {
+        process *proc;
+        int pidfd;
+        callback on_stop;
+    };
+
+    // Closes every descriptor and restores the signal mask
+    void release();
+    std::size_t dispatch_pending();
+    bool any_running() const;
+
+    int epoll_fd_ = -1;
+    int signal_fd_ = -1;
+    sigset_t previous_mask_;
+    std::vector<watched_process> watched_;
+};
+} // namespace jdb
+
+#endif // !JDB_EVENT_LOOP_HPP
@@ -0,0 +1,42 @@
+#ifndef JDB_MEMORY_DUMP_HPP
+#define JDB_MEMORY_DUMP_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <libjdb/types.hpp>
+
+namespace jdb {
+class process;
+
+enum class dump_format {
+    // The bytes as they are
+    raw,
+    // Lines of "<address>: <hex digits>" for every 32 bytes, e.g. for grep. Dropping the address
+    // column and passing the rest to "xxd -r -p" gives back the raw bytes.
+    hex,
+};
+
+// Writes the two lowercase hex digits of every byte in data to out, which needs room for twice
+// data.size() characters. Runs 16 bytes at a time with SSE2.
+void encode_hex(span<const std::byte> data, char *out);
+
+struct dump_stats {
+    std::uint64_t bytes_read = 0;
+    // Written as zeros, so that the rest of the dump stays at its offset
+    std::uint64_t bytes_unreadable = 0;
+};
+
+/*
+ * Copies [start, start + size) of a stopped process to a file, which it creates (or truncates).
+ * Memory is streamed through two buffers of chunk_size bytes: a thread reads the next chunk with
+ * process_vm_readv while the calling thread formats and writes the previous one, so dumps of any
+ * size use the same memory. Bytes where enabled breakpoint sites placed an int3 are shown as they
+ * were before.
+ */
+dump_stats dump_memory(const process &proc, virt_addr start, std::uint64_t size,
+                       const std::filesystem::path &path, dump_format format,
+                       std::size_t chunk_size = 1 << 20);
+} // namespace jdb
+
+#endif // !JDB_MEMORY_DUMP_HPP
@@ -0,0 +1,68 @@
+#ifndef JDB_MEMORY_MAP_HPP
+#define JDB_MEMORY_MAP_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <libjdb/types.hpp>
+#include <string_view>
+#include <sys/types.h>
+#include <vector>
+
+namespace jdb {
+// One line of /proc/<pid>/maps
+struct memory_region {
+    virt_addr start;
+    virt_addr end;
+    bool readable;
+    bool writable;
+    bool executable;
+    // MAP_SHARED rather than private copy-on-write
+    bool shared;
+    // Of the mapping in its file
+    std::uint64_t offset;
+    std::uint64_t inode;
+    // The mapped file or [heap], [stack]... Empty for anonymous mappings. Points into the text of
+    // the memory_map it came from, so it is only valid until that map is loaded again.
+    std::string_view name;
+
+    bool contains(virt_addr address) const { return address >= start && address < end; }
+    std::size_t size() const { return end.addr() - start.addr(); }
+};
+
+/*
+ * The mappings of a process, as a flat array sorted by address. The kernel lists mappings in
+ * address order and they never overlap, so lookups are binary searches and the regions in a range
+ * are a contiguous slice. Loading reads the whole file into a buffer that is kept from one load to
+ * the next, and parses it in place: names are views into it, so a load allocates nothing once the
+ * buffers have grown to size.
+ */
+class memory_map {
+  public:
+    memory_map() = default;
+    // Names point into text_, so a copy would point into the original
+    memory_map(const memory_map &) = delete;
+    memory_map &operator=(const memory_map &) = delete;
+    memory_map(memory_map &&) = default;
+    memory_map &operator=(memory_map &&) = default;
+
+    // Rereads /proc/<pid>/maps
+    void load(pid_t pid);
+
+    span<const memory_region> regions() const { return {regions_.data(), regions_.size()}; }
+    // The region holding the address, or nullptr if it isn't mapped
+    const memory_region *find(virt_addr address) const;
+    // The regions overlapping [start, end), in address order
+    span<const memory_region> regions_in(virt_addr start, virt_addr end) const;
+    // Number of times the map was loaded, which tells how often it had to be refreshed
+    std::size_t loads() const { return loads_; }
+
+  private:
+    void parse();
+
+    std::vector<char> text_;
+    std::vector<memory_region> regions_;
+    std::size_t loads_ = 0;
+};
+} // namespace jdb
+
+#endif // !JDB_MEMORY_MAP_HPP
@@ -0,0 +1,71 @@
+#ifndef JDB_MEMORY_SEARCH_HPP
+#define JDB_MEMORY_SEARCH_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <libjdb/types.hpp>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+namespace jdb {
+class process;
+
+// Appends to offsets where needle starts in haystack, in increasing order. Candidates are found
+// 32 (AVX2) or 16 (SSE2) positions at a time by comparing the first and the last byte of the
+// needle, and only those are compared in full.
+void find_in_buffer(span<const std::byte> haystack, span<const std::byte> needle,
+                    std::vector<std::size_t> &offsets);
+
+/*
+ * Searches the readable mappings of a stopped process for a byte pattern. Mappings are cut into
+ * chunks that worker threads take in turn. Each chunk is read with a single process_vm_readv into
+ * a buffer the worker keeps for the whole search, and is scanned with find_in_buffer. Chunks
+ * overlap by the length of the pattern, less one, so matches across them are found. Matches that
+ * run from one mapping into the next are not.
+ */
+class memory_searcher {
+  public:
+    // A workers count of 0 uses one per CPU, up to 8
+    explicit memory_searcher(process &proc, std::size_t workers = 0);
+
+    // Addresses where the pattern starts within [start, end), in increasing order. Only addresses
+    // that are multiples of alignment count. The search stops once max_matches are found, and
+    // those are then the first ones some worker came across, not necessarily the lowest ones.
+    std::vector<virt_addr> find(span<const std::byte> pattern, virt_addr start = virt_addr{0},
+                                virt_addr end = virt_addr{std::numeric_limits<std::uint64_t>::max()},
+                                std::size_t alignment = 1,
+                                std::size_t max_matches = std::numeric_limits<std::size_t>::max());
+
+    // Bytes read by the last search
+    std::uint64_t bytes_scanned() const { return bytes_scanned_; }
+
+  private:
+    struct chunk {
+        std::uint64_t address;
+        // Including the overlap with the next chunk
+        std::size_t size;
+        // Matches starting here or after belong to the next chunk, or are out of range
+        std::uint64_t starts_end;
+    };
+    // Takes chunks until there are none left or enough matches were found. Every worker runs this.
+    void run_jobs(std::size_t worker, const std::vector<chunk> &chunks,
+                  std::atomic<std::size_t> &next);
+
+    process *process_;
+    std::size_t workers_;
+    // Reused from one chunk, and one search, to the next
+    std::vector<std::vector<std::byte>> buffers_;
+    // The parameters and results of the search being run
+    span<const std::byte> pattern_;
+    std::size_t alignment_ = 1;
+    std::size_t max_matches_ = 0;
+    std::atomic<std::size_t> match_count_ = 0;
+    std::atomic<std::uint64_t> bytes_scanned_ = 0;
+    std::mutex matches_mutex_;
+    std::vector<virt_addr> matches_;
+};
+} // namespace jdb
+
+#endif // !JDB_MEMORY_SEARCH_HPP
@@ -0,0 +1,58 @@
+#ifndef JDB_PAGE_CACHE_HPP
+#define JDB_PAGE_CACHE_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+
+namespace jdb {
+/*
+ * Small cache of whole inferior pages, keyed by page number (address / page_size). It is owned by
+ * process and only lives for a single stop: resuming the inferior or writing to its memory
+ * invalidates it. Slots are reused in FIFO order once the cache is full.
+ */
+class page_cache {
+  public:
+    static constexpr std::size_t page_size = 0x1000;
+    static constexpr std::size_t capacity = 64;
+    // Reads larger than this bypass the cache, so a big dump doesn't evict every useful page
+    static constexpr std::size_t max_cached_read = capacity / 2 * page_size;
+
+    struct stats {
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+    };
+
+    page_cache() = default;
+    page_cache(const page_cache &) = delete;
+    page_cache &operator=(const page_cache &) = delete;
+
+    // Returns the cached copy of the page, or nullptr if it isn't cached. Counts a hit or a miss.
+    const std::byte *lookup(std::uint64_t page_number);
+    // Claims a slot for the page, evicting the oldest one if needed. The caller fills it in, or
+    // calls discard if the page turns out to be unreadable.
+    std::byte *allocate(std::uint64_t page_number);
+    void discard(std::uint64_t page_number);
+
+    void invalidate();
+    // Drops the cached pages in [first_page, last_page]
+    void invalidate(std::uint64_t first_page, std::uint64_t last_page);
+
+    stats get_stats() const { return stats_; }
+    void reset_stats() { stats_ = {}; }
+
+  private:
+    static constexpr std::uint64_t no_page = ~std::uint64_t{0};
+
+    // Allocated on first use, so processes that never read memory don't pay for it
+    std::unique_ptr<std::byte[]> storage_;
+    std::array<std::uint64_t, capacity> slot_pages_;
+    std::unordered_map<std::uint64_t, std::size_t> slots_by_page_;
+    std::size_t next_slot_ = 0;
+    stats stats_;
+};
+} // namespace jdb
+
+#endif // !JDB_PAGE_CACHE_HPP
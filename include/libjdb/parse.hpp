@@ -8,6 +8,7 @@
 #include <cstdint>
 #include <optional>
 #include <string_view>
+#include <vector>
 
 namespace jdb {
 template <class I> std::optional<I> to_integral(std::string_view sv, int base = 10) {
@@ -68,5 +69,36 @@ template <std::size_t N> auto parse_vector(std::string_view text) {
 
     return bytes;
 }
+
+// Same format as above, but for any number of bytes: [0xff,0x01,...]
+inline std::vector<std::byte> parse_vector(std::string_view text) {
+    auto invalid = [] { jdb::error::send("Invalid format"); };
+
+    std::vector<std::byte> bytes;
+    const char *c = text.data();
+
+    if (text.empty() || *c++ != '[')
+        invalid();
+
+    while (c < text.end() && *c != ']') {
+        if (text.end() - c < 4)
+            invalid();
+        auto byte = to_integral<std::byte>({c, 4}, 16);
+        if (!byte)
+            invalid();
+        bytes.push_back(*byte);
+        c += 4;
+
+        if (c < text.end() && *c == ',')
+            ++c;
+        else if (c == text.end() || *c != ']')
+            invalid();
+    }
+
+    if (c == text.end() || ++c != text.end())
+        invalid();
+
+    return bytes;
+}
 } // namespace jdb
 #endif // !JDB_PARSE_HPP
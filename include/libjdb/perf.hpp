@@ -0,0 +1,69 @@
+#ifndef JDB_PERF_HPP
+#define JDB_PERF_HPP
+
+#include <cstdint>
+#include <linux/perf_event.h>
+#include <optional>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <vector>
+
+namespace jdb {
+// glibc doesn't wrap perf_event_open. Opens an event following a single thread on any CPU, and
+// returns its fd, or -1 with errno set.
+inline int perf_event_open(perf_event_attr &attr, pid_t tid, int group_fd = -1) {
+    return static_cast<int>(
+        syscall(SYS_perf_event_open, &attr, tid, -1, group_fd, PERF_FLAG_FD_CLOEXEC));
+}
+
+// What the inferior spent between a resume and the stop that ended it. Counters the CPU (or the
+// VM) doesn't provide are nullopt.
+struct perf_counts {
+    std::optional<std::uint64_t> instructions;
+    std::optional<std::uint64_t> cycles;
+    std::optional<std::uint64_t> cache_misses;
+    std::optional<std::uint64_t> branch_misses;
+};
+
+/*
+ * Hardware counting events on the threads of a process, counting user space only. Each event is
+ * inherited by the threads its thread creates afterwards, and reading it sums theirs in, so only
+ * the threads that exist when the process is attached to need adding.
+ */
+class perf_counters {
+  public:
+    perf_counters() = default;
+    ~perf_counters();
+    perf_counters(const perf_counters &) = delete;
+    perf_counters &operator=(const perf_counters &) = delete;
+
+    // Opens every available event on tid, disabled. Never throws: a debugger that can't count
+    // still debugs.
+    void add_thread(pid_t tid);
+    bool empty() const { return counters_.empty(); }
+    // Closes every event, for when the process is replaced by another
+    void clear();
+
+    // Zeroes and enables every event
+    void start();
+    // Disables every event, and returns what they counted since start(). Returns nullopt if
+    // nothing is counted or the events weren't started.
+    std::optional<perf_counts> stop();
+    // Whether start() was called since the last stop()
+    bool running() const { return started_; }
+
+  private:
+    static constexpr std::size_t n_kinds = 4;
+    struct counter {
+        int fd;
+        std::size_t kind;
+    };
+    std::vector<counter> counters_;
+    // Kinds the kernel refused once, which aren't tried again on other threads
+    bool unavailable_[n_kinds] = {};
+    bool started_ = false;
+};
+} // namespace jdb
+
+#endif // !JDB_PERF_HPP
@@ -2,30 +2,118 @@
 #define JDB_PROCESS_HPP
 
 #include "libjdb/types.hpp"
+#include <array>
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
+#include <deque>
 #include <filesystem>
+#include <libjdb/bit.hpp>
+#include <libjdb/breakpoint_site.hpp>
+#include <libjdb/dwarf.hpp>
+#include <libjdb/elf.hpp>
+#include <libjdb/error.hpp>
+#include <libjdb/memory_map.hpp>
+#include <libjdb/page_cache.hpp>
+#include <libjdb/perf.hpp>
 #include <libjdb/registers.hpp>
+#include <libjdb/stoppoint_collection.hpp>
+#include <libjdb/unwinder.hpp>
+#include <libjdb/watchpoint.hpp>
 #include <memory>
 #include <optional>
 #include <sys/types.h>
 #include <sys/user.h>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
 
 namespace jdb {
 
 enum class process_state { stopped, running, exited, terminated };
 
+// Why a SIGTRAP was raised, as told by the si_code of its siginfo. interrupt is the stop
+// PTRACE_INTERRUPT causes in a seized process, and syscall the stops of traced syscalls.
+enum class trap_type { single_step, software_break, hardware_break, interrupt, syscall, unknown };
+
+// A traced syscall is reported twice: on entry, with its arguments, and on exit, with its result
+struct syscall_information {
+    std::uint16_t id;
+    bool entry;
+    union {
+        std::array<std::uint64_t, 6> args;
+        std::int64_t ret;
+    };
+};
+
 struct stop_reason {
     stop_reason(int wait_status);
 
     process_state reason;
     std::uint8_t info;
+    // Only set for stops caused by SIGTRAP
+    std::optional<trap_type> trap_reason;
+    // The thread whose state change this is
+    pid_t tid = 0;
+    // What the inferior spent since it was last resumed, when the hardware counters are available
+    std::optional<perf_counts> counters;
+    // Only set for trap_type::syscall stops
+    std::optional<syscall_information> syscall_info;
+};
+
+// Everything jdb tracks about a single thread of the inferior
+struct thread_state {
+    pid_t tid = 0;
+    process_state state = process_state::running;
+    // Why the thread last stopped. Only one stop is reported per all-stop; the others wait here
+    // for the next one.
+    std::optional<stop_reason> reason;
+    // Each thread has its own register file, whose groups are loaded on first access after a stop
+    std::unique_ptr<registers> regs;
+    // Set while a SIGSTOP jdb sent to stop the thread hasn't been reported yet. It is swallowed
+    // when it shows up instead of being reported as a stop.
+    bool pending_sigstop = false;
+    // Set between the entry and the exit of a traced syscall. The thread is resumed with
+    // PTRACE_SYSCALL then, so that it stops again when the syscall returns.
+    bool in_syscall = false;
+    // Signal the thread stopped with, passed on to it when it resumes. 0 if there is none.
+    int pending_signal = 0;
+    // Set when the thread stopped on its own while another thread's stop was being handled. That
+    // stop is reported by the next wait, before anything runs again.
+    bool report_pending = false;
+};
+
+// A frozen copy-on-write fork of the inferior, which process::restart can go back to
+struct checkpoint {
+    pid_t pid;
+    virt_addr pc;
+    // Software sites that were enabled when the fork was made, with the bytes their int3 replaced.
+    // The fork's memory has those int3s in it.
+    std::vector<std::pair<virt_addr, std::byte>> site_bytes;
+};
+
+// A shared object the dynamic linker mapped into the process
+struct shared_library {
+    std::filesystem::path path;
+    // Of the library's entry in the dynamic linker's list. Together with the path and the load
+    // bias, it tells libraries apart.
+    virt_addr link_map;
+    // Loaded with the library's load bias. nullptr when the file can't be read, like the vDSO's.
+    std::unique_ptr<elf> file;
 };
 
 class process {
   public:
+    // The syscalls in traced_syscalls stop the process on entry and on exit. They are selected by
+    // a seccomp filter installed before exec, so every other syscall runs at full speed.
     static std::unique_ptr<process> launch(std::filesystem::path path, bool debug = true,
-                                           std::optional<int> stdout_replacement = std::nullopt);
+                                           std::optional<int> stdout_replacement = std::nullopt,
+                                           const std::vector<int> &traced_syscalls = {});
     static std::unique_ptr<process> attach(pid_t pid);
+    // Attaches with PTRACE_SEIZE, which leaves the process running. No signal is sent, neither on
+    // attach nor on detach. Call interrupt() to stop it.
+    static std::unique_ptr<process> seize(pid_t pid);
 
     void resume();
     // /*?*/ wait_on_signal();
@@ -41,18 +129,135 @@ class process {
     ~process();
 
     process_state state() const { return state_; }
+    bool is_seized() const { return is_seized_; }
+    // Asks the running process to stop. The stop is reported by the next wait_on_signal or
+    // poll_stop: as an interrupt trap for seized processes, as SIGSTOP for the others.
+    void interrupt();
+    // Blocks until the process changes state
     stop_reason wait_on_signal();
+    // Waits at most timeout for the process to change state, and returns nullopt if it didn't. A
+    // timeout of nullopt blocks, like wait_on_signal. Use event_loop to wait on many processes.
+    std::optional<stop_reason> poll_stop(std::optional<std::chrono::milliseconds> timeout);
+    // Executes a single instruction in the given (by default, the current) thread, stepping over
+    // the breakpoint site at the PC if there is one. Every other thread stays stopped.
+    stop_reason step_instruction(std::optional<pid_t> tid = std::nullopt);
+
+    // Every known thread of the inferior, keyed by tid. New threads are picked up through
+    // PTRACE_O_TRACECLONE, so this is up to date whenever the process is stopped.
+    const std::unordered_map<pid_t, thread_state> &thread_states() const { return threads_; }
+    // The thread register and step operations act on by default. A stop makes the thread that
+    // caused it current.
+    pid_t current_thread() const { return current_thread_; }
+    void set_current_thread(pid_t tid);
 
-    registers &get_registers() { return *registers_; }
-    const registers &get_registers() const { return *registers_; }
+    // Registers of the given thread, or of the current thread when tid is nullopt
+    registers &get_registers(std::optional<pid_t> tid = std::nullopt);
+    const registers &get_registers(std::optional<pid_t> tid = std::nullopt) const;
 
-    void write_fprs(const user_fpregs_struct &fprs);
-    void write_gprs(const user_regs_struct &gprs);
+    void read_fprs(user_fpregs_struct &fprs, std::optional<pid_t> tid = std::nullopt) const;
+    void read_gprs(user_regs_struct &gprs, std::optional<pid_t> tid = std::nullopt) const;
+    std::uint64_t read_user_area(std::size_t offset, std::optional<pid_t> tid = std::nullopt) const;
 
-    void write_user_area(std::size_t offset, std::uint64_t data);
+    void write_fprs(const user_fpregs_struct &fprs, std::optional<pid_t> tid = std::nullopt);
+    void write_gprs(const user_regs_struct &gprs, std::optional<pid_t> tid = std::nullopt);
 
-    virt_addr get_pc() const {
-        return virt_addr{get_registers().read_by_id_as<std::uint64_t>(register_id::rip)};
+    void write_user_area(std::size_t offset, std::uint64_t data,
+                         std::optional<pid_t> tid = std::nullopt);
+
+    virt_addr get_pc(std::optional<pid_t> tid = std::nullopt) const {
+        return virt_addr{get_registers(tid).read_by_id_as<std::uint64_t>(register_id::rip)};
+    }
+    void set_pc(virt_addr address, std::optional<pid_t> tid = std::nullopt) {
+        get_registers(tid).write_by_id(register_id::rip, address.addr());
+    }
+
+    breakpoint_site &create_breakpoint_site(virt_addr address, bool hardware = false,
+                                            bool internal = false);
+    stoppoint_collection<breakpoint_site> &breakpoint_sites() { return breakpoint_sites_; }
+    const stoppoint_collection<breakpoint_site> &breakpoint_sites() const {
+        return breakpoint_sites_;
+    }
+    // Enables or disables every given site. Sites are grouped by page, and each page is patched
+    // with a single memory read and a single memory write, whatever the number of sites in it.
+    void set_breakpoint_sites_enabled(span<breakpoint_site *const> sites, bool enable);
+
+    watchpoint &create_watchpoint(virt_addr address, stoppoint_mode mode, std::size_t size);
+    stoppoint_collection<watchpoint> &watchpoints() { return watchpoints_; }
+    const stoppoint_collection<watchpoint> &watchpoints() const { return watchpoints_; }
+
+    // Claim one of the four debug address registers and return its index. Throws when all of them
+    // are in use.
+    int set_hardware_breakpoint(virt_addr address);
+    int set_watchpoint(virt_addr address, stoppoint_mode mode, std::size_t size);
+    void clear_hardware_stoppoint(int index);
+    // After a hardware_break stop, tells which breakpoint site (index 0) or watchpoint (index 1)
+    // was hit, from the status bits of dr6 of the given (by default, the current) thread
+    std::variant<breakpoint_site::id_type, watchpoint::id_type>
+    get_current_hardware_stoppoint(std::optional<pid_t> tid = std::nullopt) const;
+
+    // Reads stop at the first page that can't be read, so the result may be shorter than amount.
+    // While the process is stopped, small reads are served from a per-stop page cache.
+    std::vector<std::byte> read_memory(virt_addr address, std::size_t amount) const;
+    // Same as read_memory, but fills a caller provided buffer. Returns the number of bytes read.
+    std::size_t read_memory_into(virt_addr address, span<std::byte> buffer) const;
+    void write_memory(virt_addr address, span<const std::byte> data);
+    // Same as read_memory, but shows the original bytes wherever an enabled site placed an int3
+    std::vector<std::byte> read_memory_without_traps(virt_addr address, std::size_t amount) const;
+    // Puts the original bytes back in memory read from address, for reads that bypass the above
+    void remove_traps(virt_addr address, span<std::byte> memory) const;
+
+    // Makes the current thread of the stopped process run a fork syscall, and keeps the child
+    // stopped as a checkpoint. Memory is shared copy-on-write, so this costs about as much as the
+    // fork. Only the current thread is copied into the child. Returns the checkpoint's number.
+    std::size_t create_checkpoint();
+    const std::vector<checkpoint> &checkpoints() const { return checkpoints_; }
+    // Kills the process and carries on with a fresh fork of the given checkpoint instead. The
+    // checkpoint itself is left untouched, so it can be restarted again. Breakpoint sites and
+    // watchpoints are set up in the new process as they are now, and shared libraries as they were
+    // at the checkpoint.
+    void restart(std::size_t index);
+
+    // The executable, loaded on first use from /proc/<pid>/exe. Its load bias is the distance
+    // between the entry point the kernel reports in the auxiliary vector and the one in the file.
+    const elf &get_elf() const;
+    // Follows the shared objects the dynamic linker loads and unloads, through an internal
+    // breakpoint on the hook it calls around every change (r_brk in its r_debug). Each change only
+    // loads the objects new to the list, whose symbols are indexed on their first lookup. Does
+    // nothing for static executables. The process must be stopped.
+    void track_shared_libraries();
+    // In the dynamic linker's order, so the executable's dependencies come first
+    const std::vector<shared_library> &shared_libraries() const { return libraries_; }
+    // The executable, or the shared library, one of whose segments holds the address. nullptr if
+    // there's none.
+    const elf *elf_containing_address(virt_addr address) const;
+    // Looked up in the symbol and line tables of the file holding the address
+    std::optional<elf_symbol> symbol_containing_address(virt_addr address) const;
+    std::optional<line_entry> line_entry_at_address(virt_addr address) const;
+    // The PC of the given (by default, the current) thread, then the return address of each of its
+    // callers. Unwind rules are cached by PC until the shared library list changes.
+    std::vector<virt_addr> backtrace(std::optional<pid_t> tid = std::nullopt);
+    unwinder &get_unwinder() { return unwinder_; }
+    // The auxiliary vector the kernel passed to the program, keyed by AT_* type
+    std::unordered_map<std::uint64_t, std::uint64_t> get_auxv() const;
+
+    // The mappings of the process, parsed from /proc/<pid>/maps on first use. The parsed table is
+    // kept while the process stays stopped. When it was launched with every syscall that maps
+    // memory traced (mmap, munmap, mprotect, mremap, brk, shmat and shmdt), the table is also kept
+    // across resumes, until one of them returns, the shared library list changes or the process
+    // restarts.
+    const memory_map &get_memory_map() const;
+    void invalidate_memory_map() { memory_map_stale_ = true; }
+
+    page_cache::stats memory_cache_stats() const { return memory_cache_.get_stats(); }
+    void reset_memory_cache_stats() { memory_cache_.reset_stats(); }
+    void invalidate_memory_cache() { memory_cache_.invalidate(); }
+
+    template <class T> T read_memory_as(virt_addr address) const {
+        T ret;
+        if (read_memory_into(address, {as_bytes(ret), sizeof(T)}) != sizeof(T)) {
+            error::send("Could not read memory");
+        }
+        return ret;
     }
 
   private:
@@ -60,15 +265,100 @@ class process {
     // launch and attach public functions
     process(pid_t pid, bool terminate_on_end, bool is_attached)
         : pid_(pid), terminate_on_end_(terminate_on_end), is_attached_(is_attached),
-          registers_(new registers(*this)) {}
+          current_thread_(pid), reporting_thread_(pid) {
+        add_thread(pid);
+    }
+
+    // Lazily opened /proc/<pid>/mem, used for pages process_vm_readv/writev can't access
+    int mem_fd() const;
+    std::size_t read_memory_uncached_into(virt_addr address, span<std::byte> buffer) const;
+    friend class event_loop;
+    // Reaps a pending state change without blocking, if there is one
+    std::optional<stop_reason> try_wait();
+    // Returns the next (tid, wait status) pair of the given thread, or of any thread of this
+    // process when tid is -1. Statuses of other processes reaped along the way are handed over to
+    // them, and the ends of children nobody traces are dropped. Returns nullopt when block is false
+    // and nothing is pending.
+    std::optional<std::pair<pid_t, int>> reap(pid_t tid, bool block);
+    // Handles a status of a thread while the process runs. Returns a reason only for the stops that
+    // stop the whole process; clone events and swallowed SIGSTOPs resume the thread instead.
+    std::optional<stop_reason> handle_thread_status(pid_t tid, int wait_status);
+    // Marks the thread stopped, and builds its stop reason. single_stepped is set when the thread
+    // was resumed with PTRACE_SINGLESTEP.
+    stop_reason record_stop(thread_state &thread, int wait_status, bool single_stepped = false);
+    // Interrupts (or sends SIGSTOP to) every running thread at once, then waits for each of them
+    // in turn
+    void stop_running_threads();
+    // Tells whether the stop is one jdb asked for, and clears the pending SIGSTOP it answers
+    bool consume_stop_request(thread_state &thread, int wait_status);
+    // Records the stop of a thread other than the reporting one, and queues it to be reported
+    // unless jdb asked for it or it is a software breakpoint that is hit again on resume
+    void record_other_stop(thread_state &thread, int wait_status);
+    bool has_pending_report() const;
+    // Reports the stop of a thread queued by record_other_stop, if there is one
+    std::optional<stop_reason> take_pending_report();
+    // Fills in the trap type of SIGTRAP stops
+    void augment_stop_reason(stop_reason &reason, bool single_stepped);
+    // Reads the number and arguments (on entry) or result (on exit) of the syscall the thread is
+    // stopped at
+    syscall_information read_syscall_information(thread_state &thread, bool entry);
+    int set_hardware_stoppoint(virt_addr address, stoppoint_mode mode, std::size_t size);
 
-    void read_all_registers();
+    thread_state &add_thread(pid_t tid);
+    void remove_thread(pid_t tid);
+    // Registers the thread created by the clone event parent_tid is stopped at, and waits for its
+    // initial stop. Returns nullptr if it died before getting there.
+    thread_state *add_cloned_thread(pid_t parent_tid);
+    // Attaches to (or seizes) every thread of the process but the main one, which is already
+    // traced
+    void attach_remaining_threads();
+    // Flushes the registers of the thread, then restarts it with request (PTRACE_CONT or
+    // PTRACE_SINGLESTEP) and the signal it stopped with
+    void resume_thread(thread_state &thread, int request);
+    // Debug registers are per thread, so new threads get a copy of the ones in use
+    void copy_debug_registers(thread_state &thread);
+    // Brings libraries_ in line with the dynamic linker's list
+    void update_shared_libraries();
+    // Makes the stopped thread tid (of this process or a checkpoint) fork, by running a syscall
+    // instruction patched in at its PC. Both sides are put back as they were, and the child is left
+    // stopped. Returns the child's pid.
+    pid_t inject_fork(pid_t tid);
 
     pid_t pid_ = 0;
+    mutable int mem_fd_ = -1;
     bool terminate_on_end_ = true;
     process_state state_ = process_state::stopped;
     bool is_attached_;
-    std::unique_ptr<registers> registers_;
+    bool is_seized_ = false;
+    // Set between interrupt() and the stop it causes
+    bool interrupt_requested_ = false;
+    std::unordered_map<pid_t, thread_state> threads_;
+    pid_t current_thread_;
+    // The thread whose stop was last reported, which is the one resume steps over its site
+    pid_t reporting_thread_;
+    // Statuses of our threads reaped by another process object's waitpid(-1)
+    std::deque<std::pair<pid_t, int>> queued_statuses_;
+    mutable page_cache memory_cache_;
+    mutable memory_map memory_map_;
+    mutable bool memory_map_stale_ = true;
+    // Every syscall that changes the mappings is traced, so only their exits make the map stale
+    bool mappings_traced_ = false;
+    // Enabled by resume() and read when the process stops
+    perf_counters counters_;
+    stoppoint_collection<breakpoint_site> breakpoint_sites_;
+    stoppoint_collection<watchpoint> watchpoints_;
+    // One bit per debug address register (dr0-dr3) currently in use
+    std::uint8_t hardware_slots_in_use_ = 0;
+    // What every thread has in dr0-dr3 and dr7. Kept here since a running thread can't be asked.
+    std::uint64_t debug_addresses_[4] = {};
+    std::uint64_t debug_control_ = 0;
+    std::vector<checkpoint> checkpoints_;
+    mutable std::unique_ptr<elf> elf_;
+    std::vector<shared_library> libraries_;
+    // The dynamic linker's r_debug, and the hook it calls on changes, once tracking is on
+    std::optional<virt_addr> rendezvous_address_;
+    std::optional<virt_addr> rendezvous_hook_;
+    unwinder unwinder_{*this};
 };
 
 } // namespace jdb
@@ -0,0 +1,108 @@
+#ifndef JDB_PROFILER_HPP
+#define JDB_PROFILER_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <libjdb/stack_table.hpp>
+#include <sys/types.h>
+#include <vector>
+
+namespace jdb {
+class process;
+
+/*
+ * Statistical profiler built on ptrace. Each sample interrupts the process, unwinds the stack of
+ * every thread and resumes it straight away. The stop is kept short: only the GPRs are fetched,
+ * each thread's stack is read with a single vectored read that the unwinder then runs over
+ * locally, and the process' unwinder caches the rules of every PC it has seen.
+ * Works best on seized processes, since interrupt() then sends no signal.
+ */
+class sampling_profiler {
+  public:
+    // Frames past max_depth are dropped. Frames further than stack_bytes above the stack pointer
+    // are read from the process one word at a time.
+    explicit sampling_profiler(process &proc, std::size_t max_depth = 128,
+                               std::size_t stack_bytes = 32 * 1024);
+
+    // Takes one sample of every thread. The process has to be running, and is left running.
+    // Stops of the process' own, like signals it gets meanwhile, aren't samples and are passed
+    // on. Returns false if it ended instead of stopping.
+    bool sample();
+    // Samples hz times per second until duration has elapsed or the process ends. Returns the
+    // number of samples taken.
+    std::size_t run(double hz, std::chrono::nanoseconds duration);
+
+    const stack_table &stacks() const { return stacks_; }
+
+  private:
+    void sample_thread(pid_t tid);
+
+    process *process_;
+    std::size_t max_depth_;
+    stack_table stacks_;
+    // Reused from sample to sample, so steady state sampling doesn't allocate
+    std::vector<std::byte> stack_buffer_;
+    std::vector<std::uint64_t> frames_;
+};
+
+/*
+ * Statistical profiler built on perf_event_open, which never stops the inferior and doesn't even
+ * trace it. Every thread gets its own sampling event and its own mmap'd ring buffer. The kernel
+ * writes an IP and a frame pointer callchain there for each sample, and drain() reads them out
+ * into the same stack_table sampling_profiler fills. The kernel refuses to mmap inherited per
+ * thread events, so run() picks up new threads by rescanning /proc/<pid>/task instead.
+ * The event is CPU cycles when a hardware PMU is available. Otherwise, as in most VMs and
+ * containers, it falls back to the cpu-clock software event.
+ */
+class perf_profiler {
+  public:
+    enum class event { cycles, cpu_clock };
+
+    // Samples every thread of pid hz times per second of CPU time it uses. ring_pages is the size
+    // of each thread's ring buffer in pages, and must be a power of two.
+    perf_profiler(pid_t pid, double hz, std::size_t ring_pages = 16);
+    ~perf_profiler();
+    perf_profiler(const perf_profiler &) = delete;
+    perf_profiler &operator=(const perf_profiler &) = delete;
+
+    event sampled_event() const { return event_; }
+
+    // Reads every sample written so far, without blocking. Returns the number read.
+    std::size_t drain();
+    // Drains the ring buffers as they fill up until duration has elapsed or the process ends.
+    // Returns the number of samples read.
+    std::size_t run(std::chrono::nanoseconds duration);
+
+    const stack_table &stacks() const { return stacks_; }
+    // Samples the kernel dropped because a ring buffer was full
+    std::uint64_t lost() const { return lost_; }
+
+  private:
+    struct ring {
+        pid_t tid;
+        int fd;
+        void *base;
+    };
+
+    // Opens an event on every thread in /proc/<pid>/task that doesn't have one yet, and closes
+    // the events of threads that are no longer there. Returns the samples drained from those.
+    std::size_t open_threads();
+    bool open_thread(pid_t tid);
+    void close_ring(ring &buffer);
+    std::size_t drain(ring &buffer);
+
+    pid_t pid_;
+    double hz_;
+    event event_ = event::cycles;
+    std::size_t ring_pages_;
+    std::vector<ring> rings_;
+    stack_table stacks_;
+    std::uint64_t lost_ = 0;
+    // Records that wrap around the end of a ring buffer are put back together here
+    std::vector<std::byte> record_;
+    std::vector<std::uint64_t> frames_;
+};
+} // namespace jdb
+
+#endif // !JDB_PROFILER_HPP
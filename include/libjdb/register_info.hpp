@@ -2,8 +2,10 @@
 #define JDB_REGISTER_INFO_HPP
 
 #include <algorithm>
+#include <array>
 #include <cstddef>
 #include <cstdint>
+#include <iterator>
 #include <libjdb/error.hpp>
 #include <string_view>
 #include <sys/user.h>
@@ -53,16 +55,169 @@ template <class F> const register_info &register_info_by(F f) {
     return *it;
 }
 
-inline const register_info &register_info_by_id(register_id id) {
-    return register_info_by([id](auto &i) { return i.id == id; });
+namespace detail {
+inline constexpr std::size_t register_count = std::size(g_register_infos);
+
+// register_info_by_id indexes g_register_infos directly, which relies on the array being laid out
+// in the same order as register_id. Both are generated from registers.inc, so this always holds.
+constexpr bool register_ids_match_indices() {
+    for (std::size_t i = 0; i < register_count; ++i) {
+        if (static_cast<std::size_t>(g_register_infos[i].id) != i)
+            return false;
+    }
+    return true;
+}
+static_assert(register_ids_match_indices(), "g_register_infos must be ordered by register_id");
+
+constexpr std::int32_t max_dwarf_id() {
+    std::int32_t max = -1;
+    for (auto &info : g_register_infos) {
+        if (info.dwarf_id > max)
+            max = info.dwarf_id;
+    }
+    return max;
+}
+
+inline constexpr std::int16_t no_register = -1;
+
+/*
+ * Dense table from DWARF register number to index in g_register_infos. DWARF numbers for x64 are
+ * small (< 70), so a plain array is both the smallest and the fastest option.
+ */
+constexpr auto make_dwarf_table() {
+    std::array<std::int16_t, max_dwarf_id() + 1> table{};
+    for (auto &entry : table) {
+        entry = no_register;
+    }
+    for (std::size_t i = 0; i < register_count; ++i) {
+        auto dwarf_id = g_register_infos[i].dwarf_id;
+        // Keep the first match, like a linear search would
+        if (dwarf_id >= 0 && table[dwarf_id] == no_register) {
+            table[dwarf_id] = static_cast<std::int16_t>(i);
+        }
+    }
+    return table;
+}
+
+inline constexpr auto g_register_dwarf_table = make_dwarf_table();
+
+/*
+ * Perfect hash over the register names, built at compile time with the "hash and displace"
+ * scheme: every name is first assigned to a bucket with seed 0, then each bucket gets its own seed
+ * (displacement) chosen so that all of its names land on free slots. A lookup is then two hashes,
+ * one table read and one string comparison.
+ */
+constexpr std::uint32_t hash_register_name(std::string_view name, std::uint32_t seed) {
+    // FNV-1a, followed by murmur3's finalizer so that the low bits used for indexing mix well
+    std::uint32_t hash = 2166136261u ^ (seed * 0x9e3779b9u);
+    for (char c : name) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 16777619u;
+    }
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+inline constexpr std::size_t name_bucket_count = 64;
+inline constexpr std::size_t name_slot_count = 256;
+static_assert(register_count < name_slot_count, "Register name table is too small");
+
+struct register_name_table {
+    std::array<std::uint16_t, name_bucket_count> displacements{};
+    std::array<std::int16_t, name_slot_count> slots{};
+};
+
+constexpr std::size_t name_bucket(std::string_view name) {
+    return hash_register_name(name, 0) & (name_bucket_count - 1);
 }
 
-inline const register_info &register_info_by_name(std::string_view name) {
-    return register_info_by([name](auto &i) { return i.name == name; });
+constexpr std::size_t name_slot(std::string_view name, std::uint16_t displacement) {
+    return hash_register_name(name, displacement) & (name_slot_count - 1);
 }
 
-inline const register_info &register_info_by_dwarf(std::int32_t dwarf_id) {
-    return register_info_by([dwarf_id](auto &i) { return i.dwarf_id == dwarf_id; });
+constexpr register_name_table make_register_name_table() {
+    register_name_table table{};
+    for (auto &slot : table.slots) {
+        slot = no_register;
+    }
+
+    std::array<std::size_t, name_bucket_count> bucket_sizes{};
+    for (auto &info : g_register_infos) {
+        ++bucket_sizes[name_bucket(info.name)];
+    }
+
+    // Placing the largest buckets first, while the table is still mostly empty, keeps the search
+    // for displacements short
+    for (std::size_t size = register_count; size > 0; --size) {
+        for (std::size_t bucket = 0; bucket < name_bucket_count; ++bucket) {
+            if (bucket_sizes[bucket] != size)
+                continue;
+
+            for (std::uint16_t displacement = 1;; ++displacement) {
+                bool placed = true;
+                std::size_t placed_count = 0;
+                for (std::size_t i = 0; i < register_count; ++i) {
+                    auto name = g_register_infos[i].name;
+                    if (name_bucket(name) != bucket)
+                        continue;
+                    auto slot = name_slot(name, displacement);
+                    if (table.slots[slot] != no_register) {
+                        placed = false;
+                        break;
+                    }
+                    table.slots[slot] = static_cast<std::int16_t>(i);
+                    ++placed_count;
+                }
+                if (placed) {
+                    table.displacements[bucket] = displacement;
+                    break;
+                }
+                // Undo the partial placement before trying the next displacement
+                for (std::size_t i = 0; i < register_count && placed_count > 0; ++i) {
+                    auto name = g_register_infos[i].name;
+                    if (name_bucket(name) != bucket)
+                        continue;
+                    table.slots[name_slot(name, displacement)] = no_register;
+                    --placed_count;
+                }
+            }
+        }
+    }
+    return table;
+}
+
+inline constexpr auto g_register_name_table = make_register_name_table();
+} // namespace detail
+
+constexpr const register_info &register_info_by_id(register_id id) {
+    auto index = static_cast<std::size_t>(id);
+    if (index >= detail::register_count) {
+        error::send("Can't find register info");
+    }
+    return g_register_infos[index];
+}
+
+constexpr const register_info &register_info_by_name(std::string_view name) {
+    auto &table = detail::g_register_name_table;
+    auto displacement = table.displacements[detail::name_bucket(name)];
+    auto index = table.slots[detail::name_slot(name, displacement)];
+    if (index == detail::no_register || g_register_infos[index].name != name) {
+        error::send("Can't find register info");
+    }
+    return g_register_infos[index];
+}
+
+constexpr const register_info &register_info_by_dwarf(std::int32_t dwarf_id) {
+    auto &table = detail::g_register_dwarf_table;
+    if (dwarf_id < 0 || static_cast<std::size_t>(dwarf_id) >= table.size() ||
+        table[dwarf_id] == detail::no_register) {
+        error::send("Can't find register info");
+    }
+    return g_register_infos[table[dwarf_id]];
 }
 } // namespace jdb
 #endif // !JDB_REGISTER_INFO_HPP
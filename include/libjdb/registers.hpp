@@ -3,13 +3,24 @@
 
 #include <cmath>
 #include <cstdint>
+#include <libjdb/bit.hpp>
 #include <libjdb/register_info.hpp>
 #include <libjdb/types.hpp>
+#include <sys/types.h>
 #include <sys/user.h>
+#include <type_traits>
 #include <variant>
 
 namespace jdb {
 class process;
+
+/*
+ * write_through: every write is sent to the inferior immediately;
+ * write_back: writes only touch the cached copy and mark their group dirty. Dirty groups are sent
+ * with a single PTRACE_SETREGS/PTRACE_SETFPREGS when the process resumes or on flush().
+ */
+enum class register_write_mode { write_through, write_back };
+
 class registers {
   public:
     // Instance should be unique, so we remove the constructors and copying
@@ -23,21 +34,79 @@ class registers {
     value read(const register_info &info) const;
     void write(const register_info &info, value val);
 
+    // Inline, so that for a constant id the lookup and the type check fold away and the value is
+    // read straight from its offset. Asking for another type than read gives throws, like
+    // std::get does.
     template <class T> T read_by_id_as(register_id id) const {
-        return std::get<T>(read(register_info_by_id(id)));
+        auto &info = register_info_by_id(id);
+        if (!holds<T>(info)) {
+            return std::get<T>(read(info));
+        }
+        ensure_loaded(info.type);
+        return from_bytes<T>(as_bytes(data_) + info.offset);
     }
 
     void write_by_id(register_id id, value val) { write(register_info_by_id(id), val); }
 
+    // Reads rip alone. Unless the GPRs were already fetched since the stop, this is a single
+    // PTRACE_PEEKUSER, which leaves the rest of them unread and is kept until the next stop. Meant
+    // for loops that only follow the PC, like instruction tracing.
+    std::uint64_t read_pc() const;
+
+    register_write_mode write_mode() const { return write_mode_; }
+    // Switching back to write_through flushes any pending writes
+    void set_write_mode(register_write_mode mode);
+    // Sends every dirty register group to the inferior
+    void flush();
+
   private:
+    // Whether T is the alternative of value that read gives for the register
+    template <class T> static constexpr bool holds(const register_info &info) {
+        switch (info.format) {
+        case register_format::uint:
+            return (info.size == 1 && std::is_same_v<T, std::uint8_t>) ||
+                   (info.size == 2 && std::is_same_v<T, std::uint16_t>) ||
+                   (info.size == 4 && std::is_same_v<T, std::uint32_t>) ||
+                   (info.size == 8 && std::is_same_v<T, std::uint64_t>);
+        case register_format::double_float:
+            return std::is_same_v<T, double>;
+        case register_format::long_double:
+            return std::is_same_v<T, long double>;
+        case register_format::vector:
+            return info.size == 8 ? std::is_same_v<T, byte64> : std::is_same_v<T, byte128>;
+        }
+        return false;
+    }
+
     // Making process a friend allows us to access it's private members
     friend process;
-    registers(process &proc) : proc_(&proc) {}
+    registers(process &proc, pid_t tid) : proc_(&proc), tid_(tid) {}
+
+    // Marks every register group as stale. Called by process whenever the inferior stops, so the
+    // next access to a group fetches it again.
+    void invalidate();
+    // Fetches the group (GPR, FPR or DR) that holds registers of the given type, unless it has
+    // already been read since the last stop.
+    void ensure_loaded(register_type type) const;
+
+    // uses the user struct from <sys/user.h>, which has access to the registers.
+    // Groups are read lazily, so data_ is filled in from const member functions.
+    mutable user data_;
+    mutable bool gprs_loaded_ = false;
+    mutable bool fprs_loaded_ = false;
+    mutable bool drs_loaded_ = false;
+    // rip alone, as read by read_pc
+    mutable bool pc_loaded_ = false;
 
-    // uses the user struct from <sys/user.h>, which has access to the registers
-    user data_;
+    register_write_mode write_mode_ = register_write_mode::write_through;
+    bool gprs_dirty_ = false;
+    bool fprs_dirty_ = false;
+    // One bit per debug register, since those can only be written one at a time
+    std::uint8_t drs_dirty_ = 0;
     // Pointer to the parent process allows us to ask it for memory reads.
     process *proc_;
+    // The thread these registers belong to
+    pid_t tid_;
 };
 } // namespace jdb
 #endif // !JDB_REGISTERS_HPP
@@ -0,0 +1,129 @@
+#ifndef JDB_SNAPSHOT_HPP
+#define JDB_SNAPSHOT_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <libjdb/types.hpp>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace jdb {
+class process;
+
+/*
+ * Content addressed store of 4 KiB pages. Every distinct page is kept once, however many snapshots
+ * (or addresses) it appears in, so unchanged pages and the many zero pages of a heap cost nothing
+ * after their first copy. Pages are stored in 1 MiB chunks that never move, so the pointers
+ * page() returns stay valid. Interning is thread safe: pages go to one of several shards by hash,
+ * each with its own lock, so workers interning different pages rarely wait for each other.
+ */
+class page_store {
+  public:
+    using id_type = std::uint32_t;
+    // Stands for a page that couldn't be read
+    static constexpr id_type no_page = ~id_type(0);
+    static constexpr std::size_t page_size = 0x1000;
+
+    static std::uint64_t hash(const std::byte *page);
+    // Returns the id of the page with the given content, storing it if it's new
+    id_type intern(const std::byte *page, std::uint64_t hash);
+    const std::byte *page(id_type id) const;
+
+    // Distinct pages stored
+    std::size_t size() const { return count_; }
+
+  private:
+    static constexpr std::size_t pages_per_chunk = 256;
+    static constexpr std::size_t shard_bits = 4;
+    static constexpr std::size_t shard_count = 1 << shard_bits;
+    struct shard {
+        std::vector<std::unique_ptr<std::byte[]>> chunks;
+        std::unordered_multimap<std::uint64_t, id_type> by_hash;
+        std::size_t count = 0;
+        std::mutex mutex;
+    };
+    // Ids hold the shard in their low bits, and the index within it in the others
+    std::array<shard, shard_count> shards_;
+    std::atomic<std::size_t> count_ = 0;
+};
+
+struct snapshot_region {
+    virt_addr start;
+    virt_addr end;
+    // The mapped file or [heap], [stack]... Empty for anonymous mappings.
+    std::string name;
+    // One id per page of the region
+    std::vector<page_store::id_type> pages;
+};
+
+struct snapshot {
+    std::vector<snapshot_region> regions;
+    // Pages read from the process for this snapshot. The others were unchanged since the previous
+    // one, and are shared with it.
+    std::size_t pages_copied = 0;
+};
+
+// A range of pages that differs between two snapshots
+struct snapshot_change {
+    enum class kind { added, removed, modified };
+    kind type;
+    virt_addr start;
+    std::size_t size;
+};
+
+/*
+ * Snapshots of the writable memory of a stopped process. The first one copies every page. After
+ * it, the kernel's soft-dirty bits tell which pages the process wrote since the previous snapshot:
+ * they are cleared by writing 4 to /proc/<pid>/clear_refs, and set again in /proc/<pid>/pagemap
+ * (bit 55) on the next write. Only those pages are copied again. Kernels built without soft-dirty
+ * support get every page copied each time, and the page store still keeps unchanged ones once.
+ * Copies are split among worker threads, each reading runs of pages with process_vm_readv.
+ */
+class snapshot_store {
+  public:
+    // A workers count of 0 uses one per CPU, up to 8
+    explicit snapshot_store(process &proc, std::size_t workers = 0);
+    snapshot_store(const snapshot_store &) = delete;
+    snapshot_store &operator=(const snapshot_store &) = delete;
+
+    // Takes a snapshot and returns its index
+    std::size_t save();
+    const snapshot &get(std::size_t index) const { return snapshots_.at(index); }
+    std::size_t size() const { return snapshots_.size(); }
+    const page_store &pages() const { return pages_; }
+    // Whether later snapshots only copy dirty pages
+    bool tracks_dirty_pages() const { return soft_dirty_; }
+
+    // Changed ranges going from snapshot from to snapshot to, in address order. Adjacent pages that
+    // changed the same way are merged.
+    std::vector<snapshot_change> diff(std::size_t from, std::size_t to) const;
+
+  private:
+    struct copy_job {
+        std::uint64_t address;
+        std::size_t n_pages;
+        page_store::id_type *out;
+    };
+    std::vector<snapshot_region> read_regions() const;
+    // Marks in dirty which pages of region the process wrote since the soft-dirty bits were last
+    // cleared
+    void read_dirty_pages(const snapshot_region &region, std::vector<bool> &dirty) const;
+    void clear_dirty_pages() const;
+    void copy_pages(const std::vector<copy_job> &jobs);
+    // Takes jobs from next on until there are none left. Every worker runs this.
+    void run_jobs(const std::vector<copy_job> &jobs, std::atomic<std::size_t> &next);
+
+    process *process_;
+    std::size_t workers_;
+    bool soft_dirty_;
+    page_store pages_;
+    std::vector<snapshot> snapshots_;
+};
+} // namespace jdb
+
+#endif // !JDB_SNAPSHOT_HPP
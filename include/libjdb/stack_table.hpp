@@ -0,0 +1,66 @@
+#ifndef JDB_STACK_TABLE_HPP
+#define JDB_STACK_TABLE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <libjdb/types.hpp>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace jdb {
+/*
+ * Call stacks interned into dense ids, each with a sample count. This is what every profiling
+ * path aggregates into. Each distinct stack is stored once: its frames sit back to back in a
+ * single flat array, and an open addressing table of ids finds it again by hash. So a sample of an
+ * already seen stack only costs hashing its frames, and allocates nothing.
+ * Frames are PCs, leaf first, the way an unwinder produces them.
+ */
+class stack_table {
+  public:
+    using id_type = std::uint32_t;
+
+    // Counts count samples of the stack, and returns its id
+    id_type add(span<const std::uint64_t> frames, std::uint64_t count = 1);
+
+    // Number of distinct stacks
+    std::size_t size() const { return stacks_.size(); }
+    bool empty() const { return stacks_.empty(); }
+    std::uint64_t total_samples() const { return total_samples_; }
+
+    span<const std::uint64_t> frames(id_type id) const {
+        auto &stack = stacks_[id];
+        return {frames_.data() + stack.offset, stack.depth};
+    }
+    std::uint64_t count(id_type id) const { return stacks_[id].count; }
+
+    void clear();
+
+    // Writes one line per stack: its frames root first, separated by ';', then its sample count.
+    // This is the folded format flamegraph.pl and most flame graph tools take. Frames are written
+    // as hexadecimal addresses unless name_frame is given.
+    void write_folded(std::ostream &out,
+                      const std::function<std::string(virt_addr)> &name_frame = nullptr) const;
+
+  private:
+    struct stack {
+        std::uint64_t hash;
+        std::uint64_t count;
+        std::uint32_t offset;
+        std::uint32_t depth;
+    };
+
+    static std::uint64_t hash_frames(span<const std::uint64_t> frames);
+    // Doubles the slot table, keeping the load factor under one half
+    void grow();
+
+    std::vector<std::uint64_t> frames_;
+    std::vector<stack> stacks_;
+    // Holds id + 1 for each used slot, 0 for empty ones. The size is always a power of two.
+    std::vector<id_type> slots_;
+    std::uint64_t total_samples_ = 0;
+};
+} // namespace jdb
+
+#endif // !JDB_STACK_TABLE_HPP
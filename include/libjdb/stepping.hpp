@@ -0,0 +1,19 @@
+#ifndef JDB_STEPPING_HPP
+#define JDB_STEPPING_HPP
+
+#include <libjdb/process.hpp>
+
+namespace jdb {
+// Source level steps of the current thread, driven by the line tables of the executable. Both
+// single step until the thread reaches the start of a statement on another line, and return the
+// reason of the last stop, which is a single step unless something else stopped the process.
+// From code without line information, they step a single instruction.
+
+// Steps into the functions called on the way, unless they have no line information (PLT stubs,
+// libraries...), in which case they run until the call returns
+stop_reason step_in(process &proc);
+// Runs every function called on the way until it returns
+stop_reason step_over(process &proc);
+} // namespace jdb
+
+#endif // !JDB_STEPPING_HPP
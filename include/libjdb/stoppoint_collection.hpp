@@ -0,0 +1,181 @@
+#ifndef JDB_STOPPOINT_COLLECTION_HPP
+#define JDB_STOPPOINT_COLLECTION_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <libjdb/error.hpp>
+#include <libjdb/types.hpp>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace jdb {
+/*
+ * Owns a set of stoppoints (breakpoint sites, watchpoints...). Stoppoints are kept in creation
+ * order, which is also id order, so lookups by id are a binary search. Lookups by address go
+ * through a hash table, so finding the stoppoint that was hit after a SIGTRAP is constant time no
+ * matter how many of them exist.
+ */
+template <class Stoppoint> class stoppoint_collection {
+  public:
+    using id_type = typename Stoppoint::id_type;
+
+    Stoppoint &push(std::unique_ptr<Stoppoint> bs);
+
+    bool contains_id(id_type id) const;
+    bool contains_address(virt_addr address) const;
+    bool enabled_stoppoint_at_address(virt_addr address) const;
+
+    Stoppoint &get_by_id(id_type id);
+    const Stoppoint &get_by_id(id_type id) const;
+    Stoppoint &get_by_address(virt_addr address);
+    const Stoppoint &get_by_address(virt_addr address) const;
+    // Returns nullptr instead of throwing when there is no stoppoint at that address
+    Stoppoint *find_by_address(virt_addr address) const;
+
+    void remove_by_id(id_type id);
+    void remove_by_address(virt_addr address);
+
+    template <class F> void for_each(F f);
+    template <class F> void for_each(F f) const;
+
+    // Stoppoints whose address lies in [low, high)
+    std::vector<Stoppoint *> get_in_region(virt_addr low, virt_addr high) const;
+
+    std::size_t size() const { return stoppoints_.size(); }
+    bool empty() const { return stoppoints_.empty(); }
+
+  private:
+    using points_t = std::vector<std::unique_ptr<Stoppoint>>;
+
+    typename points_t::iterator find_by_id(id_type id);
+    typename points_t::const_iterator find_by_id(id_type id) const;
+
+    points_t stoppoints_;
+    std::unordered_map<std::uint64_t, Stoppoint *> by_address_;
+};
+
+template <class Stoppoint>
+Stoppoint &stoppoint_collection<Stoppoint>::push(std::unique_ptr<Stoppoint> bs) {
+    // Ids only ever grow, except for the negative ones of internal stoppoints, so this is nearly
+    // always an append
+    by_address_[bs->address().addr()] = bs.get();
+    auto it = std::upper_bound(stoppoints_.begin(), stoppoints_.end(), bs->id(),
+                               [](id_type id, auto &point) { return id < point->id(); });
+    return **stoppoints_.insert(it, std::move(bs));
+}
+
+template <class Stoppoint>
+auto stoppoint_collection<Stoppoint>::find_by_id(id_type id) -> typename points_t::iterator {
+    auto it = std::lower_bound(stoppoints_.begin(), stoppoints_.end(), id,
+                               [](auto &point, id_type id) { return point->id() < id; });
+    if (it != stoppoints_.end() && (*it)->id() != id)
+        return stoppoints_.end();
+    return it;
+}
+
+template <class Stoppoint>
+auto stoppoint_collection<Stoppoint>::find_by_id(id_type id) const ->
+    typename points_t::const_iterator {
+    return const_cast<stoppoint_collection *>(this)->find_by_id(id);
+}
+
+template <class Stoppoint> bool stoppoint_collection<Stoppoint>::contains_id(id_type id) const {
+    return find_by_id(id) != stoppoints_.end();
+}
+
+template <class Stoppoint>
+bool stoppoint_collection<Stoppoint>::contains_address(virt_addr address) const {
+    return by_address_.count(address.addr()) != 0;
+}
+
+template <class Stoppoint>
+bool stoppoint_collection<Stoppoint>::enabled_stoppoint_at_address(virt_addr address) const {
+    auto point = find_by_address(address);
+    return point && point->is_enabled();
+}
+
+template <class Stoppoint> Stoppoint &stoppoint_collection<Stoppoint>::get_by_id(id_type id) {
+    auto it = find_by_id(id);
+    if (it == stoppoints_.end())
+        error::send("Invalid stoppoint id");
+    return **it;
+}
+
+template <class Stoppoint>
+const Stoppoint &stoppoint_collection<Stoppoint>::get_by_id(id_type id) const {
+    return const_cast<stoppoint_collection *>(this)->get_by_id(id);
+}
+
+template <class Stoppoint>
+Stoppoint *stoppoint_collection<Stoppoint>::find_by_address(virt_addr address) const {
+    auto it = by_address_.find(address.addr());
+    return it == by_address_.end() ? nullptr : it->second;
+}
+
+template <class Stoppoint>
+Stoppoint &stoppoint_collection<Stoppoint>::get_by_address(virt_addr address) {
+    auto point = find_by_address(address);
+    if (!point)
+        error::send("Stoppoint with given address not found");
+    return *point;
+}
+
+template <class Stoppoint>
+const Stoppoint &stoppoint_collection<Stoppoint>::get_by_address(virt_addr address) const {
+    return const_cast<stoppoint_collection *>(this)->get_by_address(address);
+}
+
+template <class Stoppoint> void stoppoint_collection<Stoppoint>::remove_by_id(id_type id) {
+    auto it = find_by_id(id);
+    if (it == stoppoints_.end())
+        error::send("Invalid stoppoint id");
+    (**it).disable();
+    by_address_.erase((**it).address().addr());
+    stoppoints_.erase(it);
+}
+
+template <class Stoppoint>
+void stoppoint_collection<Stoppoint>::remove_by_address(virt_addr address) {
+    remove_by_id(get_by_address(address).id());
+}
+
+template <class Stoppoint>
+template <class F>
+void stoppoint_collection<Stoppoint>::for_each(F f) {
+    for (auto &point : stoppoints_) {
+        f(*point);
+    }
+}
+
+template <class Stoppoint>
+template <class F>
+void stoppoint_collection<Stoppoint>::for_each(F f) const {
+    for (const auto &point : stoppoints_) {
+        f(*point);
+    }
+}
+
+template <class Stoppoint>
+std::vector<Stoppoint *> stoppoint_collection<Stoppoint>::get_in_region(virt_addr low,
+                                                                        virt_addr high) const {
+    std::vector<Stoppoint *> ret;
+    // Small regions, like the ones read by the memory commands, are cheaper to probe address by
+    // address than to scan every stoppoint
+    if (high.addr() - low.addr() < stoppoints_.size()) {
+        for (auto address = low; address < high; address += 1) {
+            if (auto point = find_by_address(address))
+                ret.push_back(point);
+        }
+        return ret;
+    }
+    for (auto &point : stoppoints_) {
+        if (point->address() >= low && point->address() < high)
+            ret.push_back(point.get());
+    }
+    return ret;
+}
+} // namespace jdb
+
+#endif // !JDB_STOPPOINT_COLLECTION_HPP
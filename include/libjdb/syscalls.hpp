@@ -0,0 +1,13 @@
+#ifndef JDB_SYSCALLS_HPP
+#define JDB_SYSCALLS_HPP
+
+#include <string_view>
+
+namespace jdb {
+// Name of an x86_64 system call, like "openat". Throws for numbers that aren't one.
+std::string_view syscall_id_to_name(int id);
+// Number of the named x86_64 system call. Throws for unknown names.
+int syscall_name_to_id(std::string_view name);
+} // namespace jdb
+
+#endif // !JDB_SYSCALLS_HPP
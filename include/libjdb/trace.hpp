@@ -0,0 +1,131 @@
+#ifndef JDB_TRACE_HPP
+#define JDB_TRACE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <libjdb/process.hpp>
+#include <libjdb/types.hpp>
+#include <optional>
+
+namespace jdb {
+namespace detail {
+/*
+ * Layout of a trace file: this header, then block_count blocks of block_size bytes used as a ring.
+ * Each block starts with a trace_block_header holding the full PC of its first record, the
+ * keyframe. The PCs after it are stored as the difference to the previous one, zigzag encoded so
+ * that small negative jumps stay small, as a LEB128 varint. Most instructions are a few bytes
+ * apart, so most records take a single byte. A block decodes without looking at any other, so
+ * once the ring is full the oldest block is just overwritten.
+ */
+struct trace_file_header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t block_size;
+    std::uint64_t block_count;
+    // Blocks ever started. The ring holds the last block_count of them.
+    std::uint64_t blocks_written;
+    std::uint64_t records_written;
+};
+
+struct trace_block_header {
+    std::uint32_t record_count;
+    // Bytes of varints after this header
+    std::uint32_t used;
+    std::uint64_t keyframe;
+};
+
+inline constexpr char trace_magic[8] = {'J', 'D', 'B', 'T', 'R', 'A', 'C', 'E'};
+inline constexpr std::uint32_t trace_version = 1;
+} // namespace detail
+
+// Appends PCs to a trace file, which it creates (or truncates) and maps in full
+class trace_writer {
+  public:
+    // block_count blocks of block_size bytes are kept. Older ones are overwritten.
+    explicit trace_writer(const std::filesystem::path &path, std::size_t block_count = 4096,
+                          std::size_t block_size = 4096);
+    ~trace_writer();
+    trace_writer(const trace_writer &) = delete;
+    trace_writer &operator=(const trace_writer &) = delete;
+
+    void append(std::uint64_t pc);
+    std::uint64_t records_written() const { return header_->records_written; }
+    // Writes the mapping back to the file. Unmapping does so as well.
+    void sync();
+
+  private:
+    void start_block(std::uint64_t pc);
+
+    int fd_ = -1;
+    std::byte *map_ = nullptr;
+    std::size_t map_size_ = 0;
+    detail::trace_file_header *header_ = nullptr;
+    detail::trace_block_header *block_ = nullptr;
+    std::uint64_t last_pc_ = 0;
+};
+
+/*
+ * Maps a trace file read-only and decodes it. for_each is a template so that the callback inlines
+ * into the decoding loop, which then runs at a few nanoseconds per record.
+ */
+class trace_reader {
+  public:
+    explicit trace_reader(const std::filesystem::path &path);
+    ~trace_reader();
+    trace_reader(const trace_reader &) = delete;
+    trace_reader &operator=(const trace_reader &) = delete;
+
+    // Records still in the ring, which are all of them unless it wrapped around
+    std::uint64_t size() const;
+    std::uint64_t records_written() const { return header_->records_written; }
+
+    // Calls f with every PC in the ring, oldest first
+    template <class F> void for_each(F f) const {
+        auto first = header_->blocks_written > header_->block_count
+                         ? header_->blocks_written - header_->block_count
+                         : 0;
+        for (auto block = first; block < header_->blocks_written; ++block) {
+            decode_block(block % header_->block_count, f);
+        }
+    }
+
+  private:
+    template <class F> void decode_block(std::uint64_t index, F &f) const {
+        auto base = map_ + sizeof(detail::trace_file_header) + index * header_->block_size;
+        auto block = reinterpret_cast<const detail::trace_block_header *>(base);
+        if (block->record_count == 0)
+            return;
+
+        auto pc = block->keyframe;
+        f(pc);
+        auto pos = reinterpret_cast<const std::uint8_t *>(base + sizeof(*block));
+        auto end = pos + block->used;
+        while (pos < end) {
+            std::uint64_t encoded = *pos & 0x7f;
+            unsigned shift = 7;
+            while (*pos++ & 0x80) {
+                encoded |= std::uint64_t(*pos & 0x7f) << shift;
+                shift += 7;
+            }
+            pc += (encoded >> 1) ^ -(encoded & 1);
+            f(pc);
+        }
+    }
+
+    int fd_ = -1;
+    const std::byte *map_ = nullptr;
+    std::size_t map_size_ = 0;
+    const detail::trace_file_header *header_ = nullptr;
+};
+
+// Single steps the current thread, appending the PC of every instruction it executes to out. Stops
+// after max_steps instructions, when the thread reaches until (without executing it), or when it
+// stops for anything but the step itself. Returns the reason of the last stop, or nullopt if there
+// was nothing to step.
+std::optional<stop_reason> trace_instructions(process &proc, trace_writer &out,
+                                              std::uint64_t max_steps,
+                                              std::optional<virt_addr> until = std::nullopt);
+} // namespace jdb
+
+#endif // !JDB_TRACE_HPP
@@ -6,6 +6,9 @@
 #include <cstdint>
 
 namespace jdb {
+// What kind of access triggers a hardware stoppoint. x64 can't trap on reads alone.
+enum class stoppoint_mode { write, read_write, execute };
+
 using byte64 = std::array<std::byte, 8>;
 using byte128 = std::array<std::byte, 16>;
 class virt_addr {
@@ -35,6 +38,28 @@ class virt_addr {
   private:
     std::uint64_t addr_ = 0;
 };
+
+// Non-owning view over contiguous memory, standing in for C++20's std::span
+template <class T> class span {
+  public:
+    span() = default;
+    span(T *data, std::size_t size) : data_(data), size_(size) {}
+    span(T *data, T *end) : data_(data), size_(end - data) {}
+    // Works for std::vector, std::array and anything else exposing data() and size()
+    template <class Container>
+    span(Container &container) : data_(container.data()), size_(container.size()) {}
+
+    T *data() const { return data_; }
+    T *begin() const { return data_; }
+    T *end() const { return data_ + size_; }
+    std::size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    T &operator[](std::size_t n) const { return *(data_ + n); }
+
+  private:
+    T *data_ = nullptr;
+    std::size_t size_ = 0;
+};
 } // namespace jdb
 
 #endif // !JDB_TYPES_HPP
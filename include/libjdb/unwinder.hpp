@@ -0,0 +1,143 @@
+#ifndef JDB_UNWINDER_HPP
+#define JDB_UNWINDER_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <libjdb/types.hpp>
+#include <map>
+#include <optional>
+#include <sys/types.h>
+#include <unordered_set>
+#include <vector>
+
+namespace jdb {
+class elf;
+class process;
+
+// How to recover a register of the caller, in terms of the canonical frame address (CFA)
+struct register_rule {
+    enum class kind : std::uint8_t {
+        // Callee saved registers without a rule are left alone by the callee
+        same_value,
+        undefined,
+        // Saved at CFA + offset
+        offset,
+        // Is CFA + offset
+        val_offset,
+        // Copied into another register
+        in_register,
+        // Saved at the address the expression computes, from the CFA
+        expression,
+        // Is the value the expression computes, from the CFA
+        val_expression,
+    };
+    kind type = kind::same_value;
+    std::int64_t value = 0;
+    span<const std::byte> expression;
+};
+
+/*
+ * The unwind rules in effect at a PC, compiled from the CIE and FDE that cover it. Only the 17
+ * registers x64 unwinding needs are tracked: the GPRs by DWARF number, and the return address
+ * (16), which stands for the caller's PC.
+ */
+struct unwind_row {
+    static constexpr std::size_t register_count = 17;
+    static constexpr std::size_t return_address = 16;
+
+    // The addresses [start, end) the row applies to, at link time unless said otherwise
+    std::uint64_t start = 0;
+    std::uint64_t end = 0;
+    // CFA = cfa_register + cfa_offset, unless there is a cfa_expression
+    std::uint32_t cfa_register = 7;
+    std::int64_t cfa_offset = 0;
+    span<const std::byte> cfa_expression;
+    std::array<register_rule, register_count> registers;
+};
+
+/*
+ * The call frame information of an ELF file (.eh_frame). FDEs are found by binary search of the
+ * sorted table .eh_frame_hdr provides, in place in the mapping. Files without a usable one get
+ * such a table built by a single pass over .eh_frame. Expressions in the rows point into the
+ * mapping, so rows are only valid while the file is loaded.
+ */
+class call_frame_information {
+  public:
+    explicit call_frame_information(const elf &file);
+
+    // The rules at the given link time address, or nullopt if no FDE covers it. They hold over the
+    // row's whole range.
+    std::optional<unwind_row> row_at(std::uint64_t file_address) const;
+    // Whether the file has any CFI at all
+    bool empty() const;
+
+  private:
+    struct fde_entry {
+        std::uint64_t start;
+        // Of the FDE in .eh_frame
+        std::uint64_t offset;
+    };
+    // Offset of the FDE whose range may cover the address
+    std::optional<std::uint64_t> find_fde(std::uint64_t file_address) const;
+    void index_eh_frame();
+
+    const elf *elf_;
+    span<const std::byte> eh_frame_;
+    std::uint64_t eh_frame_address_ = 0;
+    span<const std::byte> eh_frame_hdr_;
+    std::uint64_t eh_frame_hdr_address_ = 0;
+    // The binary search table of .eh_frame_hdr: (start, FDE) pairs of offsets from the header
+    span<const std::int32_t> hdr_table_;
+    // Used when .eh_frame_hdr is missing or uses an encoding other than the usual one
+    std::vector<fde_entry> fdes_;
+};
+
+/*
+ * Walks the stack of a thread, innermost frame first. Each frame is unwound with the CFI of the
+ * file holding its PC, using the register_info_by_dwarf numbering to go from rules to registers.
+ * Frames without CFI fall back to the frame pointer chain. Each row found is kept for the range of
+ * PCs it covers, so walking through the same functions again, as a profiler does thousands of
+ * times a second, skips CIE and FDE parsing entirely. The cache holds at most one entry per row of
+ * the loaded files' CFI, however many PCs are seen.
+ */
+class unwinder {
+  public:
+    struct stats {
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+    };
+
+    explicit unwinder(const process &proc) : process_(&proc) {}
+
+    // Fills frames with the thread's PC, then the return address of each caller, up to max_depth
+    // entries. Memory in [stack_start, stack_start + stack.size()) is read from stack rather than
+    // from the process, which lets callers fetch the top of the stack with a single read.
+    void unwind(pid_t tid, std::vector<std::uint64_t> &frames, std::size_t max_depth,
+                span<const std::byte> stack = {}, std::uint64_t stack_start = 0);
+    std::vector<virt_addr> backtrace(pid_t tid, std::size_t max_depth = 256);
+
+    // Rows point into the files they came from, so the cache has to go whenever a file is unloaded
+    void clear_cache() {
+        rows_.clear();
+        uncovered_.clear();
+    }
+    stats get_stats() const { return stats_; }
+    void reset_stats() { stats_ = {}; }
+
+  private:
+    // nullptr when no CFI covers the PC
+    const unwind_row *row_at(std::uint64_t pc);
+
+    // PCs without CFI are remembered up to this many, then forgotten all at once
+    static constexpr std::size_t max_uncovered = 4096;
+
+    const process *process_;
+    // By the end of their range, with start and end moved to run time addresses
+    std::map<std::uint64_t, unwind_row> rows_;
+    std::unordered_set<std::uint64_t> uncovered_;
+    stats stats_;
+};
+} // namespace jdb
+
+#endif // !JDB_UNWINDER_HPP
@@ -0,0 +1,30 @@
+#include <libjdb/breakpoint_site.hpp>
+#include <libjdb/process.hpp>
+
+namespace {
+auto get_next_id() {
+    static jdb::breakpoint_site::id_type id = 0;
+    return ++id;
+}
+
+auto get_next_internal_id() {
+    static jdb::breakpoint_site::id_type id = 0;
+    return --id;
+}
+} // namespace
+
+jdb::breakpoint_site::breakpoint_site(process &proc, virt_addr address, bool is_hardware,
+                                      bool is_internal)
+    : id_(is_internal ? get_next_internal_id() : get_next_id()), process_(&proc),
+      address_(address), is_enabled_(false), is_hardware_(is_hardware), is_internal_(is_internal),
+      saved_data_{} {}
+
+void jdb::breakpoint_site::enable() {
+    breakpoint_site *site = this;
+    process_->set_breakpoint_sites_enabled({&site, 1}, true);
+}
+
+void jdb::breakpoint_site::disable() {
+    breakpoint_site *site = this;
+    process_->set_breakpoint_sites_enabled({&site, 1}, false);
+}
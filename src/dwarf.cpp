@@ -0,0 +1,704 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <libjdb/detail/dwarf_cursor.hpp>
+#include <libjdb/dwarf.hpp>
+#include <libjdb/elf.hpp>
+#include <libjdb/error.hpp>
+#include <unordered_map>
+
+namespace {
+// The few DWARF constants jdb needs, from the DWARF 5 standard
+namespace dw {
+constexpr std::uint64_t form_addr = 0x01, form_block2 = 0x03, form_block4 = 0x04,
+                        form_data2 = 0x05, form_data4 = 0x06, form_data8 = 0x07,
+                        form_string = 0x08, form_block = 0x09, form_block1 = 0x0a,
+                        form_data1 = 0x0b, form_flag = 0x0c, form_sdata = 0x0d, form_strp = 0x0e,
+                        form_udata = 0x0f, form_ref_addr = 0x10, form_ref1 = 0x11,
+                        form_ref2 = 0x12, form_ref4 = 0x13, form_ref8 = 0x14,
+                        form_ref_udata = 0x15, form_indirect = 0x16, form_sec_offset = 0x17,
+                        form_exprloc = 0x18, form_flag_present = 0x19, form_strx = 0x1a,
+                        form_addrx = 0x1b, form_ref_sup4 = 0x1c, form_strp_sup = 0x1d,
+                        form_data16 = 0x1e, form_line_strp = 0x1f, form_ref_sig8 = 0x20,
+                        form_implicit_const = 0x21, form_loclistx = 0x22, form_rnglistx = 0x23,
+                        form_ref_sup8 = 0x24, form_strx1 = 0x25, form_strx2 = 0x26,
+                        form_strx3 = 0x27, form_strx4 = 0x28, form_addrx1 = 0x29,
+                        form_addrx2 = 0x2a, form_addrx3 = 0x2b, form_addrx4 = 0x2c,
+                        form_gnu_addr_index = 0x1f01, form_gnu_str_index = 0x1f02,
+                        form_gnu_ref_alt = 0x1f20, form_gnu_strp_alt = 0x1f21;
+
+constexpr std::uint64_t at_stmt_list = 0x10, at_low_pc = 0x11, at_high_pc = 0x12,
+                        at_comp_dir = 0x1b, at_ranges = 0x55, at_str_offsets_base = 0x72,
+                        at_addr_base = 0x73, at_rnglists_base = 0x74;
+
+constexpr std::uint8_t ut_compile = 0x01, ut_partial = 0x03, ut_skeleton = 0x04,
+                       ut_split_compile = 0x05;
+
+constexpr std::uint8_t lns_copy = 1, lns_advance_pc = 2, lns_advance_line = 3, lns_set_file = 4,
+                       lns_negate_stmt = 6, lns_const_add_pc = 8, lns_fixed_advance_pc = 9;
+constexpr std::uint8_t lne_end_sequence = 1, lne_set_address = 2;
+constexpr std::uint64_t lnct_path = 1, lnct_directory_index = 2;
+
+constexpr std::uint8_t rle_end_of_list = 0, rle_base_addressx = 1, rle_startx_endx = 2,
+                       rle_startx_length = 3, rle_offset_pair = 4, rle_base_address = 5,
+                       rle_start_end = 6, rle_start_length = 7;
+} // namespace dw
+
+using jdb::detail::cursor;
+
+// Returns a cursor over the unit starting at pos, which is left at the first byte after its length
+cursor unit_cursor(const std::byte *pos, const std::byte *end, bool &is_64) {
+    cursor cur(pos, end);
+    auto length = cur.initial_length(is_64);
+    if (length > std::uint64_t(end - cur.position())) {
+        jdb::error::send("Malformed DWARF: unit runs past the end of its section");
+    }
+    return {cur.position(), cur.position() + length};
+}
+
+struct sections {
+    jdb::span<const std::byte> info, abbrev, str, line_str, str_offsets, addr, ranges, rnglists;
+};
+
+std::string_view string_at(jdb::span<const std::byte> section, std::uint64_t offset) {
+    if (offset >= section.size()) {
+        jdb::error::send("Malformed DWARF: string offset out of range");
+    }
+    return cursor(section.begin() + offset, section.end()).string();
+}
+
+// The value of an attribute. Strings found in place, or at an offset into a string section, are
+// resolved as they are read. The others (strx, addrx, rnglistx...) need a base from an attribute
+// that may come later, so they are resolved by the reader of the value.
+struct attribute_value {
+    std::uint64_t form;
+    std::uint64_t value = 0;
+    std::string_view string;
+};
+
+attribute_value read_form(cursor &cur, std::uint64_t form, const sections &debug, bool is_64,
+                          std::uint8_t address_size, std::int64_t implicit_const = 0) {
+    attribute_value ret{form};
+    switch (form) {
+    case dw::form_addr:
+        ret.value = cur.address(address_size);
+        break;
+    case dw::form_data1:
+    case dw::form_ref1:
+    case dw::form_flag:
+    case dw::form_strx1:
+    case dw::form_addrx1:
+        ret.value = cur.u8();
+        break;
+    case dw::form_data2:
+    case dw::form_ref2:
+    case dw::form_strx2:
+    case dw::form_addrx2:
+        ret.value = cur.u16();
+        break;
+    case dw::form_strx3:
+    case dw::form_addrx3:
+        ret.value = cur.u24();
+        break;
+    case dw::form_data4:
+    case dw::form_ref4:
+    case dw::form_ref_sup4:
+    case dw::form_strx4:
+    case dw::form_addrx4:
+        ret.value = cur.u32();
+        break;
+    case dw::form_data8:
+    case dw::form_ref8:
+    case dw::form_ref_sig8:
+    case dw::form_ref_sup8:
+        ret.value = cur.u64();
+        break;
+    case dw::form_data16:
+        cur.skip(16);
+        break;
+    case dw::form_sdata:
+        ret.value = static_cast<std::uint64_t>(cur.sleb());
+        break;
+    case dw::form_udata:
+    case dw::form_ref_udata:
+    case dw::form_strx:
+    case dw::form_addrx:
+    case dw::form_loclistx:
+    case dw::form_rnglistx:
+    case dw::form_gnu_addr_index:
+    case dw::form_gnu_str_index:
+        ret.value = cur.uleb();
+        break;
+    case dw::form_ref_addr:
+    case dw::form_sec_offset:
+    case dw::form_strp_sup:
+    case dw::form_gnu_ref_alt:
+    case dw::form_gnu_strp_alt:
+        ret.value = cur.offset(is_64);
+        break;
+    case dw::form_string:
+        ret.string = cur.string();
+        break;
+    case dw::form_strp:
+        ret.string = string_at(debug.str, cur.offset(is_64));
+        break;
+    case dw::form_line_strp:
+        ret.string = string_at(debug.line_str, cur.offset(is_64));
+        break;
+    case dw::form_block1:
+        cur.skip(cur.u8());
+        break;
+    case dw::form_block2:
+        cur.skip(cur.u16());
+        break;
+    case dw::form_block4:
+        cur.skip(cur.u32());
+        break;
+    case dw::form_block:
+    case dw::form_exprloc:
+        cur.skip(cur.uleb());
+        break;
+    case dw::form_flag_present:
+        ret.value = 1;
+        break;
+    case dw::form_implicit_const:
+        ret.value = static_cast<std::uint64_t>(implicit_const);
+        break;
+    case dw::form_indirect:
+        return read_form(cur, cur.uleb(), debug, is_64, address_size);
+    default:
+        jdb::error::send("Unsupported DWARF form " + std::to_string(form));
+    }
+    return ret;
+}
+
+bool is_strx(std::uint64_t form) {
+    return form == dw::form_strx || (form >= dw::form_strx1 && form <= dw::form_strx4) ||
+           form == dw::form_gnu_str_index;
+}
+
+bool is_addrx(std::uint64_t form) {
+    return form == dw::form_addrx || (form >= dw::form_addrx1 && form <= dw::form_addrx4) ||
+           form == dw::form_gnu_addr_index;
+}
+
+// What jdb needs from the DIE at the root of a compile unit
+struct unit_die {
+    std::uint16_t version;
+    bool is_64;
+    std::uint8_t address_size;
+    std::optional<std::uint64_t> stmt_list;
+    std::optional<std::uint64_t> low_pc;
+    std::optional<std::uint64_t> high_pc;
+    std::optional<attribute_value> ranges;
+    std::string_view comp_dir;
+    std::uint64_t addr_base = 0;
+    std::uint64_t rnglists_base = 0;
+
+    std::uint64_t read_address(const sections &debug, std::uint64_t index) const {
+        auto offset = addr_base + index * address_size;
+        if (offset + address_size > debug.addr.size()) {
+            jdb::error::send("Malformed DWARF: address index out of range");
+        }
+        return cursor(debug.addr.begin() + offset, debug.addr.end()).address(address_size);
+    }
+};
+
+// Reads the root DIE of the unit at offset into .debug_info. Returns nullopt for the units that
+// don't describe code of their own, like type units.
+std::optional<unit_die> read_unit_die(const sections &debug, std::uint64_t offset) {
+    if (offset >= debug.info.size()) {
+        jdb::error::send("Malformed DWARF: unit offset out of range");
+    }
+    unit_die die{};
+    auto cur = unit_cursor(debug.info.begin() + offset, debug.info.end(), die.is_64);
+    die.version = cur.u16();
+    if (die.version < 2 || die.version > 5)
+        return std::nullopt;
+    std::uint64_t abbrev_offset;
+    if (die.version >= 5) {
+        auto type = cur.u8();
+        die.address_size = cur.u8();
+        abbrev_offset = cur.offset(die.is_64);
+        if (type == dw::ut_skeleton || type == dw::ut_split_compile) {
+            cur.skip(8);
+        } else if (type != dw::ut_compile && type != dw::ut_partial) {
+            return std::nullopt;
+        }
+    } else {
+        abbrev_offset = cur.offset(die.is_64);
+        die.address_size = cur.u8();
+    }
+    if (die.address_size != 4 && die.address_size != 8)
+        return std::nullopt;
+
+    // Finds the abbreviation of the DIE, leaving abbrev at its attribute specifications
+    auto code = cur.uleb();
+    if (code == 0 || abbrev_offset >= debug.abbrev.size())
+        return std::nullopt;
+    cursor abbrev(debug.abbrev.begin() + abbrev_offset, debug.abbrev.end());
+    while (true) {
+        auto entry_code = abbrev.uleb();
+        if (entry_code == 0)
+            return std::nullopt;
+        abbrev.uleb();
+        abbrev.u8();
+        if (entry_code == code)
+            break;
+        while (true) {
+            auto name = abbrev.uleb();
+            auto form = abbrev.uleb();
+            if (form == dw::form_implicit_const)
+                abbrev.sleb();
+            if (name == 0 && form == 0)
+                break;
+        }
+    }
+
+    std::optional<attribute_value> low_pc, high_pc, str_offsets_base;
+    attribute_value comp_dir{};
+    while (true) {
+        auto name = abbrev.uleb();
+        auto form = abbrev.uleb();
+        std::int64_t implicit_const = form == dw::form_implicit_const ? abbrev.sleb() : 0;
+        if (name == 0 && form == 0)
+            break;
+        auto value = read_form(cur, form, debug, die.is_64, die.address_size, implicit_const);
+        switch (name) {
+        case dw::at_stmt_list:
+            die.stmt_list = value.value;
+            break;
+        case dw::at_low_pc:
+            low_pc = value;
+            break;
+        case dw::at_high_pc:
+            high_pc = value;
+            break;
+        case dw::at_ranges:
+            die.ranges = value;
+            break;
+        case dw::at_comp_dir:
+            comp_dir = value;
+            break;
+        case dw::at_addr_base:
+            die.addr_base = value.value;
+            break;
+        case dw::at_rnglists_base:
+            die.rnglists_base = value.value;
+            break;
+        case dw::at_str_offsets_base:
+            str_offsets_base = value;
+            break;
+        }
+    }
+
+    if (is_strx(comp_dir.form)) {
+        // Without a base, the offsets start right after the table's 8 byte header
+        auto base = str_offsets_base ? str_offsets_base->value : 8;
+        auto offset_size = die.is_64 ? 8 : 4;
+        auto at = base + comp_dir.value * offset_size;
+        if (at + offset_size > debug.str_offsets.size()) {
+            jdb::error::send("Malformed DWARF: string index out of range");
+        }
+        cursor offsets(debug.str_offsets.begin() + at, debug.str_offsets.end());
+        die.comp_dir = string_at(debug.str, offsets.offset(die.is_64));
+    } else {
+        die.comp_dir = comp_dir.string;
+    }
+    if (low_pc) {
+        die.low_pc = is_addrx(low_pc->form) ? die.read_address(debug, low_pc->value)
+                                            : low_pc->value;
+        if (high_pc) {
+            // high_pc is either an address, or (since DWARF 4) an offset from low_pc
+            if (high_pc->form == dw::form_addr) {
+                die.high_pc = high_pc->value;
+            } else if (is_addrx(high_pc->form)) {
+                die.high_pc = die.read_address(debug, high_pc->value);
+            } else {
+                die.high_pc = *die.low_pc + high_pc->value;
+            }
+        }
+    }
+    return die;
+}
+
+// Calls f(start, end) for every range of the unit listed in .debug_rnglists or .debug_ranges
+template <class F> void for_each_range(const sections &debug, const unit_die &die, F f) {
+    auto base = die.low_pc.value_or(0);
+    if (die.version < 5) {
+        if (die.ranges->value >= debug.ranges.size())
+            return;
+        cursor cur(debug.ranges.begin() + die.ranges->value, debug.ranges.end());
+        auto base_selection = die.address_size == 8 ? ~std::uint64_t(0) : 0xffffffff;
+        while (true) {
+            auto start = cur.address(die.address_size);
+            auto end = cur.address(die.address_size);
+            if (start == 0 && end == 0)
+                break;
+            if (start == base_selection) {
+                base = end;
+            } else {
+                f(base + start, base + end);
+            }
+        }
+        return;
+    }
+
+    auto offset = die.ranges->value;
+    if (die.ranges->form == dw::form_rnglistx) {
+        // The index is into a table of offsets relative to the base
+        auto offset_size = die.is_64 ? 8 : 4;
+        auto at = die.rnglists_base + offset * offset_size;
+        if (at + offset_size > debug.rnglists.size())
+            return;
+        offset = die.rnglists_base +
+                 cursor(debug.rnglists.begin() + at, debug.rnglists.end()).offset(die.is_64);
+    }
+    if (offset >= debug.rnglists.size())
+        return;
+    cursor cur(debug.rnglists.begin() + offset, debug.rnglists.end());
+    while (true) {
+        auto kind = cur.u8();
+        if (kind == dw::rle_end_of_list)
+            break;
+        switch (kind) {
+        case dw::rle_base_addressx:
+            base = die.read_address(debug, cur.uleb());
+            break;
+        case dw::rle_startx_endx: {
+            auto start = die.read_address(debug, cur.uleb());
+            f(start, die.read_address(debug, cur.uleb()));
+            break;
+        }
+        case dw::rle_startx_length: {
+            auto start = die.read_address(debug, cur.uleb());
+            f(start, start + cur.uleb());
+            break;
+        }
+        case dw::rle_offset_pair: {
+            auto start = cur.uleb();
+            f(base + start, base + cur.uleb());
+            break;
+        }
+        case dw::rle_base_address:
+            base = cur.address(die.address_size);
+            break;
+        case dw::rle_start_end: {
+            auto start = cur.address(die.address_size);
+            f(start, cur.address(die.address_size));
+            break;
+        }
+        case dw::rle_start_length: {
+            auto start = cur.address(die.address_size);
+            f(start, start + cur.uleb());
+            break;
+        }
+        default:
+            jdb::error::send("Malformed DWARF: unknown range list entry");
+        }
+    }
+}
+
+sections get_sections(const jdb::elf &file) {
+    return {file.get_section_contents(".debug_info"),
+            file.get_section_contents(".debug_abbrev"),
+            file.get_section_contents(".debug_str"),
+            file.get_section_contents(".debug_line_str"),
+            file.get_section_contents(".debug_str_offsets"),
+            file.get_section_contents(".debug_addr"),
+            file.get_section_contents(".debug_ranges"),
+            file.get_section_contents(".debug_rnglists")};
+}
+
+std::string join_path(std::string_view directory, std::string_view file) {
+    if (directory.empty() || file.empty() || file.front() == '/')
+        return std::string(file);
+    return (std::filesystem::path(directory) / file).string();
+}
+} // namespace
+
+jdb::dwarf::dwarf(const elf &file) : elf_(&file) {
+    if (!file.get_section(".debug_line"))
+        return;
+    span<const std::uint64_t> offsets;
+    if (file.cached_compile_units(offsets, ranges_)) {
+        units_.reserve(offsets.size());
+        for (auto offset : offsets) {
+            units_.push_back({offset});
+        }
+        return;
+    }
+    if (file.get_section(".debug_aranges")) {
+        index_aranges();
+    } else {
+        index_unit_ranges();
+    }
+    std::sort(range_storage_.begin(), range_storage_.end(),
+              [](auto &lhs, auto &rhs) { return lhs.start < rhs.start; });
+    ranges_ = range_storage_;
+}
+
+void jdb::dwarf::index_aranges() {
+    std::unordered_map<std::uint64_t, std::uint32_t> unit_by_offset;
+    auto section = elf_->get_section_contents(".debug_aranges");
+    auto pos = section.begin();
+    while (pos < section.end()) {
+        auto set_start = pos;
+        bool is_64;
+        auto set = unit_cursor(pos, section.end(), is_64);
+        pos = set.end();
+        set.u16();
+        auto info_offset = set.offset(is_64);
+        auto address_size = set.u8();
+        auto segment_size = set.u8();
+        if (address_size != 4 && address_size != 8)
+            continue;
+        // Tuples are aligned to their own size, counting from the start of the set
+        auto tuple_size = 2 * address_size;
+        auto header_size = std::size_t(set.position() - set_start);
+        set.skip((tuple_size - header_size % tuple_size) % tuple_size);
+
+        auto [it, inserted] = unit_by_offset.emplace(info_offset, units_.size());
+        if (inserted) {
+            units_.push_back({info_offset});
+        }
+        while (!set.finished()) {
+            set.skip(segment_size);
+            auto start = set.address(address_size);
+            auto length = set.address(address_size);
+            if (start == 0 && length == 0)
+                break;
+            // Code dropped at link time is left at address 0
+            if (start != 0) {
+                range_storage_.push_back({start, start + length, it->second});
+            }
+        }
+    }
+}
+
+void jdb::dwarf::index_unit_ranges() {
+    auto debug = get_sections(*elf_);
+    auto pos = debug.info.begin();
+    while (pos < debug.info.end()) {
+        auto offset = std::uint64_t(pos - debug.info.begin());
+        bool is_64;
+        pos = unit_cursor(pos, debug.info.end(), is_64).end();
+
+        auto die = read_unit_die(debug, offset);
+        if (!die || !die->stmt_list)
+            continue;
+        auto index = static_cast<std::uint32_t>(units_.size());
+        units_.push_back({offset});
+        auto add_range = [&](std::uint64_t start, std::uint64_t end) {
+            if (start != 0 && start < end) {
+                range_storage_.push_back({start, end, index});
+            }
+        };
+        if (die->ranges) {
+            for_each_range(debug, *die, add_range);
+        } else if (die->low_pc && die->high_pc) {
+            add_range(*die->low_pc, *die->high_pc);
+        }
+    }
+}
+
+void jdb::dwarf::decode_line_program(compile_unit &unit) const {
+    unit.decoded = true;
+    auto debug = get_sections(*elf_);
+    auto die = read_unit_die(debug, unit.offset);
+    auto section = elf_->get_section_contents(".debug_line");
+    if (!die || !die->stmt_list || *die->stmt_list >= section.size())
+        return;
+
+    bool is_64;
+    auto cur = unit_cursor(section.begin() + *die->stmt_list, section.end(), is_64);
+    auto version = cur.u16();
+    if (version < 2 || version > 5) {
+        error::send("Unsupported DWARF line table version " + std::to_string(version));
+    }
+    auto address_size = die->address_size;
+    if (version >= 5) {
+        address_size = cur.u8();
+        cur.u8();
+    }
+    auto header_length = cur.offset(is_64);
+    auto program = cur.position() + header_length;
+    auto min_instruction_length = cur.u8();
+    // Only VLIW targets have more than one operation per instruction
+    if (version >= 4)
+        cur.u8();
+    auto default_is_stmt = cur.u8() != 0;
+    auto line_base = cur.s8();
+    auto line_range = cur.u8();
+    auto opcode_base = cur.u8();
+    if (line_range == 0 || opcode_base == 0) {
+        error::send("Malformed DWARF: bad line table header");
+    }
+    std::vector<std::uint8_t> opcode_lengths(opcode_base);
+    for (std::size_t i = 1; i < opcode_base; ++i) {
+        opcode_lengths[i] = cur.u8();
+    }
+
+    std::vector<std::string_view> directories;
+    if (version >= 5) {
+        // Entries are described by a list of (content, form) pairs. Only the path and the
+        // directory index matter here.
+        auto read_entries = [&](auto on_entry) {
+            std::vector<std::pair<std::uint64_t, std::uint64_t>> formats(cur.u8());
+            for (auto &[content, form] : formats) {
+                content = cur.uleb();
+                form = cur.uleb();
+            }
+            auto count = cur.uleb();
+            for (std::uint64_t i = 0; i < count; ++i) {
+                std::string_view path;
+                std::uint64_t directory = 0;
+                for (auto [content, form] : formats) {
+                    auto value = read_form(cur, form, debug, is_64, address_size);
+                    if (content == dw::lnct_path) {
+                        path = value.string;
+                    } else if (content == dw::lnct_directory_index) {
+                        directory = value.value;
+                    }
+                }
+                on_entry(path, directory);
+            }
+        };
+        // Directory 0 is the compilation directory, and file 0 the primary source file
+        read_entries([&](auto path, auto) { directories.push_back(path); });
+        read_entries([&](auto path, auto directory) {
+            auto base = directory < directories.size() ? directories[directory] : "";
+            auto relative = join_path(base, path);
+            // The other directories may be relative to the compilation directory
+            if (directory == 0 || directories.empty()) {
+                unit.files.push_back(relative);
+            } else {
+                unit.files.push_back(join_path(directories[0], relative));
+            }
+        });
+    } else {
+        // Directory and file 0 stand for the compilation directory and the primary source file,
+        // and aren't listed
+        directories.push_back(die->comp_dir);
+        for (auto directory = cur.string(); !directory.empty(); directory = cur.string()) {
+            directories.push_back(directory);
+        }
+        unit.files.emplace_back();
+        for (auto path = cur.string(); !path.empty(); path = cur.string()) {
+            auto directory = cur.uleb();
+            cur.uleb();
+            cur.uleb();
+            auto base = directory < directories.size() ? directories[directory] : "";
+            unit.files.push_back(join_path(die->comp_dir, join_path(base, path)));
+        }
+    }
+
+    if (program > cur.end()) {
+        error::send("Malformed DWARF: line program out of bounds");
+    }
+    cur = cursor(program, cur.end());
+    std::uint64_t address = 0;
+    std::int64_t line = 1;
+    std::uint64_t file = 1;
+    bool is_stmt = default_is_stmt;
+    auto sequence_start = unit.rows.size();
+    auto emit_row = [&](bool end_sequence) {
+        unit.rows.push_back({address, static_cast<std::uint32_t>(line),
+                             static_cast<std::uint16_t>(file), is_stmt, end_sequence});
+        if (end_sequence) {
+            // Code dropped at link time is left at address 0
+            if (unit.rows[sequence_start].address == 0) {
+                unit.rows.resize(sequence_start);
+            }
+            sequence_start = unit.rows.size();
+            address = 0;
+            line = 1;
+            file = 1;
+            is_stmt = default_is_stmt;
+        }
+    };
+    while (!cur.finished()) {
+        auto opcode = cur.u8();
+        if (opcode >= opcode_base) {
+            // Special opcodes advance both the address and the line, and add a row
+            auto adjusted = opcode - opcode_base;
+            address += (adjusted / line_range) * min_instruction_length;
+            line += line_base + adjusted % line_range;
+            emit_row(false);
+        } else if (opcode == 0) {
+            auto length = cur.uleb();
+            if (length == 0)
+                continue;
+            auto next = cur.position() + length;
+            auto extended = cur.u8();
+            if (extended == dw::lne_end_sequence) {
+                emit_row(true);
+            } else if (extended == dw::lne_set_address) {
+                address = cur.address(address_size);
+            }
+            cur = cursor(next, cur.end());
+        } else if (opcode == dw::lns_copy) {
+            emit_row(false);
+        } else if (opcode == dw::lns_advance_pc) {
+            address += cur.uleb() * min_instruction_length;
+        } else if (opcode == dw::lns_advance_line) {
+            line += cur.sleb();
+        } else if (opcode == dw::lns_set_file) {
+            file = cur.uleb();
+        } else if (opcode == dw::lns_negate_stmt) {
+            is_stmt = !is_stmt;
+        } else if (opcode == dw::lns_const_add_pc) {
+            address += ((255 - opcode_base) / line_range) * min_instruction_length;
+        } else if (opcode == dw::lns_fixed_advance_pc) {
+            address += cur.u16();
+        } else {
+            // Opcodes that only set state jdb doesn't track (columns, basic blocks...)
+            for (std::uint8_t i = 0; i < opcode_lengths[opcode]; ++i) {
+                cur.uleb();
+            }
+        }
+    }
+    // Sequences may come in any order. An end of sequence sorts before a row starting another
+    // sequence at the same address, so that the lookup finds the latter.
+    std::stable_sort(unit.rows.begin(), unit.rows.end(), [](auto &lhs, auto &rhs) {
+        if (lhs.address != rhs.address)
+            return lhs.address < rhs.address;
+        return lhs.end_sequence > rhs.end_sequence;
+    });
+}
+
+std::optional<jdb::line_entry> jdb::dwarf::line_entry_at_address(virt_addr address) const {
+    auto file_address = elf_->to_file_addr(address);
+    auto range = std::upper_bound(ranges_.begin(), ranges_.end(), file_address,
+                                  [](auto address, auto &range) { return address < range.start; });
+    if (range == ranges_.begin() || file_address >= std::prev(range)->end)
+        return std::nullopt;
+    auto &unit = units_[std::prev(range)->unit];
+    if (!unit.decoded) {
+        decode_line_program(unit);
+    }
+
+    auto row = std::upper_bound(unit.rows.begin(), unit.rows.end(), file_address,
+                                [](auto address, auto &row) { return address < row.address; });
+    if (row == unit.rows.begin() || std::prev(row)->end_sequence)
+        return std::nullopt;
+    --row;
+    std::string_view file;
+    if (row->file < unit.files.size()) {
+        file = unit.files[row->file];
+    }
+    return line_entry{elf_->to_virt_addr(row->address), file, row->line, row->is_stmt != 0};
+}
+
+std::vector<std::uint64_t> jdb::dwarf::unit_offsets() const {
+    std::vector<std::uint64_t> offsets;
+    offsets.reserve(units_.size());
+    for (auto &unit : units_) {
+        offsets.push_back(unit.offset);
+    }
+    return offsets;
+}
+
+std::size_t jdb::dwarf::decoded_unit_count() const {
+    return std::count_if(units_.begin(), units_.end(), [](auto &unit) { return unit.decoded; });
+}
@@ -0,0 +1,435 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <libjdb/dwarf.hpp>
+#include <libjdb/elf.hpp>
+#include <libjdb/error.hpp>
+#include <libjdb/unwinder.hpp>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace {
+// FNV-1a
+std::uint64_t hash_name(std::string_view name) {
+    std::uint64_t hash = 0xcbf29ce484222325;
+    for (auto c : name) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3;
+    }
+    return hash;
+}
+
+std::string to_hex(jdb::span<const std::byte> bytes) {
+    static constexpr char digits[] = "0123456789abcdef";
+    std::string ret;
+    for (auto byte : bytes) {
+        ret += digits[std::to_integer<unsigned>(byte) >> 4];
+        ret += digits[std::to_integer<unsigned>(byte) & 0xf];
+    }
+    return ret;
+}
+} // namespace
+
+jdb::elf::elf(const std::filesystem::path &path) : path_(path) {
+    auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error::send_errno("Could not open ELF file");
+    }
+    struct stat info;
+    if (fstat(fd, &info) < 0) {
+        close(fd);
+        error::send_errno("Could not stat ELF file");
+    }
+    size_ = static_cast<std::size_t>(info.st_size);
+    if (size_ < sizeof(Elf64_Ehdr)) {
+        close(fd);
+        error::send("Not an ELF file");
+    }
+    auto map = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps the file alive on its own
+    close(fd);
+    if (map == MAP_FAILED) {
+        error::send_errno("Could not map ELF file");
+    }
+    data_ = static_cast<const std::byte *>(map);
+    header_ = reinterpret_cast<const Elf64_Ehdr *>(data_);
+
+    auto valid = std::memcmp(header_->e_ident, ELFMAG, SELFMAG) == 0 &&
+                 header_->e_ident[EI_CLASS] == ELFCLASS64 &&
+                 header_->e_ident[EI_DATA] == ELFDATA2LSB &&
+                 header_->e_shentsize == sizeof(Elf64_Shdr) &&
+                 header_->e_shoff + header_->e_shnum * sizeof(Elf64_Shdr) <= size_ &&
+                 header_->e_shstrndx < std::max<std::size_t>(header_->e_shnum, 1) &&
+                 (header_->e_phnum == 0 || header_->e_phentsize == sizeof(Elf64_Phdr)) &&
+                 header_->e_phoff + header_->e_phnum * sizeof(Elf64_Phdr) <= size_;
+    if (!valid) {
+        munmap(map, size_);
+        error::send("Not a 64 bit little endian ELF file");
+    }
+    sections_ = {reinterpret_cast<const Elf64_Shdr *>(data_ + header_->e_shoff), header_->e_shnum};
+    segments_ = {reinterpret_cast<const Elf64_Phdr *>(data_ + header_->e_phoff), header_->e_phnum};
+}
+
+jdb::elf::~elf() {
+    munmap(const_cast<std::byte *>(data_), size_);
+    if (cache_map_) {
+        munmap(const_cast<std::byte *>(cache_map_), cache_size_);
+    }
+}
+
+std::string_view jdb::elf::get_section_name(std::size_t index) const {
+    if (sections_.empty())
+        return "";
+    auto &names = sections_[header_->e_shstrndx];
+    return reinterpret_cast<const char *>(data_ + names.sh_offset + index);
+}
+
+const Elf64_Shdr *jdb::elf::get_section(std::string_view name) const {
+    for (auto &section : sections_) {
+        if (get_section_name(section.sh_name) == name)
+            return &section;
+    }
+    return nullptr;
+}
+
+jdb::span<const std::byte> jdb::elf::get_section_contents(std::string_view name) const {
+    auto section = get_section(name);
+    if (!section || section->sh_type == SHT_NOBITS ||
+        section->sh_offset + section->sh_size > size_)
+        return {};
+    return {data_ + section->sh_offset, section->sh_size};
+}
+
+std::string_view jdb::elf::interpreter() const {
+    for (auto &segment : segments_) {
+        if (segment.p_type == PT_INTERP && segment.p_filesz > 0 &&
+            segment.p_offset + segment.p_filesz <= size_) {
+            // The size counts the terminating null
+            return {reinterpret_cast<const char *>(data_ + segment.p_offset), segment.p_filesz - 1};
+        }
+    }
+    return "";
+}
+
+bool jdb::elf::contains_address(virt_addr address) const {
+    auto file_address = to_file_addr(address);
+    return std::any_of(segments_.begin(), segments_.end(), [&](auto &segment) {
+        return segment.p_type == PT_LOAD && file_address - segment.p_vaddr < segment.p_memsz;
+    });
+}
+
+jdb::span<const std::byte> jdb::elf::build_id() const {
+    for (auto &section : sections_) {
+        if (section.sh_type != SHT_NOTE || section.sh_offset + section.sh_size > size_)
+            continue;
+        // Notes are a header, the owner's name and the description, each padded to 4 bytes
+        auto pos = data_ + section.sh_offset;
+        auto end = pos + section.sh_size;
+        while (pos + sizeof(Elf64_Nhdr) <= end) {
+            auto note = reinterpret_cast<const Elf64_Nhdr *>(pos);
+            auto name = pos + sizeof(Elf64_Nhdr);
+            auto desc = name + ((note->n_namesz + 3) & ~3u);
+            if (desc + note->n_descsz > end)
+                break;
+            if (note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4 &&
+                std::memcmp(name, "GNU", 4) == 0)
+                return {desc, note->n_descsz};
+            pos = desc + ((note->n_descsz + 3) & ~3u);
+        }
+    }
+    return {};
+}
+
+std::filesystem::path jdb::elf::index_cache_directory() {
+    if (auto cache = std::getenv("XDG_CACHE_HOME"); cache && *cache) {
+        return std::filesystem::path(cache) / "jdb";
+    }
+    if (auto home = std::getenv("HOME"); home && *home) {
+        return std::filesystem::path(home) / ".cache" / "jdb";
+    }
+    return {};
+}
+
+void jdb::elf::index_symbols() const {
+    symbols_indexed_ = true;
+    // .dynsym only holds the exported subset of .symtab, so it's only of use in stripped files
+    auto table = get_section(".symtab");
+    if (!table)
+        table = get_section(".dynsym");
+    if (!table || table->sh_link >= sections_.size() ||
+        table->sh_offset + table->sh_size > size_)
+        return;
+    auto &strings = sections_[table->sh_link];
+    if (strings.sh_offset + strings.sh_size > size_)
+        return;
+
+    auto id = build_id();
+    std::filesystem::path cache_path;
+    if (!id.empty() && id.size() <= sizeof(detail::index_file_header::build_id) &&
+        !index_cache_directory().empty()) {
+        cache_path = index_cache_directory() / (to_hex(id) + ".idx");
+        if (load_index_cache(cache_path, *table))
+            return;
+    }
+    names_ = reinterpret_cast<const char *>(data_ + strings.sh_offset);
+
+    auto first = reinterpret_cast<const Elf64_Sym *>(data_ + table->sh_offset);
+    auto count = table->sh_size / sizeof(Elf64_Sym);
+    symbol_storage_.reserve(count);
+    for (auto symbol = first; symbol != first + count; ++symbol) {
+        auto type = ELF64_ST_TYPE(symbol->st_info);
+        // Undefined symbols, section and file names have no address of their own
+        if (symbol->st_shndx == SHN_UNDEF || symbol->st_name == 0 ||
+            symbol->st_name >= strings.sh_size || type == STT_SECTION || type == STT_FILE ||
+            type == STT_TLS)
+            continue;
+        symbol_storage_.push_back({symbol->st_value, symbol->st_size, symbol->st_name,
+                                   static_cast<std::uint8_t>(type)});
+    }
+    std::sort(symbol_storage_.begin(), symbol_storage_.end(),
+              [](auto &lhs, auto &rhs) { return lhs.address < rhs.address; });
+    symbols_ = symbol_storage_;
+
+    // At most half full, so that probe sequences stay short
+    std::size_t slot_count = 1;
+    while (slot_count < symbol_storage_.size() * 2) {
+        slot_count *= 2;
+    }
+    name_slot_storage_.assign(slot_count, 0);
+    for (std::uint32_t i = 0; i < symbol_storage_.size(); ++i) {
+        auto slot = hash_name(names_ + symbol_storage_[i].name) & (slot_count - 1);
+        while (name_slot_storage_[slot] != 0) {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+        name_slot_storage_[slot] = i + 1;
+    }
+    name_slots_ = name_slot_storage_;
+
+    if (!cache_path.empty()) {
+        // The line tables' unit index is saved too, so it has to be built now. Files whose
+        // DWARF can't be read aren't cached.
+        try {
+            get_dwarf();
+        } catch (const error &) {
+            return;
+        }
+        write_index_cache(cache_path, *table, strings.sh_size);
+    }
+}
+
+bool jdb::elf::load_index_cache(const std::filesystem::path &path,
+                                const Elf64_Shdr &table) const {
+    auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if (fstat(fd, &info) < 0 ||
+        static_cast<std::size_t>(info.st_size) < sizeof(detail::index_file_header)) {
+        close(fd);
+        return false;
+    }
+    auto size = static_cast<std::size_t>(info.st_size);
+    auto map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    auto data = static_cast<const std::byte *>(map);
+    auto header = reinterpret_cast<const detail::index_file_header *>(data);
+    auto id = build_id();
+    auto debug_info = get_section(".debug_info");
+    auto debug_info_size = debug_info ? debug_info->sh_size : 0;
+    auto symbols_offset = sizeof(detail::index_file_header);
+    auto units_offset = symbols_offset + header->symbol_count * sizeof(detail::indexed_symbol);
+    auto ranges_offset = units_offset + header->unit_count * sizeof(std::uint64_t);
+    auto slots_offset =
+        ranges_offset + header->unit_range_count * sizeof(detail::indexed_unit_range);
+    auto names_offset = slots_offset + header->name_slot_count * sizeof(std::uint32_t);
+    // A stripped file shares its build-id with the original, but not its symbol table, so the
+    // table the index came from has to match too. Names must end in a null so that none runs off
+    // the mapping.
+    auto valid = std::memcmp(header->magic, detail::index_magic, sizeof(header->magic)) == 0 &&
+                 header->version == detail::index_version &&
+                 header->build_id_size == id.size() &&
+                 std::memcmp(header->build_id, id.data(), id.size()) == 0 &&
+                 header->symbol_table_type == table.sh_type &&
+                 header->symbol_table_size == table.sh_size &&
+                 header->debug_info_size == debug_info_size &&
+                 header->symbol_count < (1ull << 32) && header->name_slot_count < (1ull << 33) &&
+                 header->unit_count < (1ull << 32) && header->unit_range_count < (1ull << 32) &&
+                 (header->name_slot_count & (header->name_slot_count - 1)) == 0 &&
+                 header->name_slot_count > header->symbol_count && names_offset < size &&
+                 header->names_size > 0 && names_offset + header->names_size == size &&
+                 data[size - 1] == std::byte{0};
+
+    // Lookups trust every offset and index in the file, and the order of the symbols, so a
+    // truncated or corrupt one must not get that far
+    auto symbols = reinterpret_cast<const detail::indexed_symbol *>(data + symbols_offset);
+    for (std::size_t i = 0; valid && i < header->symbol_count; ++i) {
+        valid = symbols[i].name < header->names_size &&
+                (i == 0 || symbols[i - 1].address <= symbols[i].address);
+    }
+    // A probe only ends at an empty slot, so there has to be one
+    auto slots = reinterpret_cast<const std::uint32_t *>(data + slots_offset);
+    std::uint64_t used_slots = 0;
+    for (std::size_t i = 0; valid && i < header->name_slot_count; ++i) {
+        valid = slots[i] <= header->symbol_count;
+        used_slots += slots[i] != 0;
+    }
+    valid = valid && used_slots <= header->symbol_count;
+    auto units = reinterpret_cast<const std::uint64_t *>(data + units_offset);
+    for (std::size_t i = 0; valid && i < header->unit_count; ++i) {
+        valid = units[i] < debug_info_size;
+    }
+    auto ranges = reinterpret_cast<const detail::indexed_unit_range *>(data + ranges_offset);
+    for (std::size_t i = 0; valid && i < header->unit_range_count; ++i) {
+        valid = ranges[i].unit < header->unit_count &&
+                (i == 0 || ranges[i - 1].start <= ranges[i].start);
+    }
+    if (!valid) {
+        munmap(map, size);
+        return false;
+    }
+    cache_map_ = data;
+    cache_size_ = size;
+    symbols_ = {reinterpret_cast<const detail::indexed_symbol *>(data + symbols_offset),
+                header->symbol_count};
+    name_slots_ = {reinterpret_cast<const std::uint32_t *>(data + slots_offset),
+                   header->name_slot_count};
+    cached_unit_offsets_ = {units, header->unit_count};
+    cached_unit_ranges_ = {ranges, header->unit_range_count};
+    names_ = reinterpret_cast<const char *>(data + names_offset);
+    return true;
+}
+
+void jdb::elf::write_index_cache(const std::filesystem::path &path, const Elf64_Shdr &table,
+                                 std::size_t names_size) const {
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+    if (ec)
+        return;
+
+    detail::index_file_header header{};
+    std::memcpy(header.magic, detail::index_magic, sizeof(header.magic));
+    header.version = detail::index_version;
+    auto id = build_id();
+    header.build_id_size = static_cast<std::uint32_t>(id.size());
+    std::memcpy(header.build_id, id.data(), id.size());
+    header.symbol_count = symbols_.size();
+    header.name_slot_count = name_slots_.size();
+    header.names_size = names_size;
+    header.symbol_table_type = table.sh_type;
+    header.symbol_table_size = table.sh_size;
+    auto debug_info = get_section(".debug_info");
+    header.debug_info_size = debug_info ? debug_info->sh_size : 0;
+    auto unit_offsets = dwarf_->unit_offsets();
+    auto unit_ranges = dwarf_->unit_ranges();
+    header.unit_count = unit_offsets.size();
+    header.unit_range_count = unit_ranges.size();
+
+    // Written aside and renamed into place, so that another jdb never maps half a file
+    auto temporary = path;
+    temporary += "." + std::to_string(getpid());
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(symbols_.data()),
+                  symbols_.size() * sizeof(detail::indexed_symbol));
+        out.write(reinterpret_cast<const char *>(unit_offsets.data()),
+                  unit_offsets.size() * sizeof(std::uint64_t));
+        out.write(reinterpret_cast<const char *>(unit_ranges.data()),
+                  unit_ranges.size() * sizeof(detail::indexed_unit_range));
+        out.write(reinterpret_cast<const char *>(name_slots_.data()),
+                  name_slots_.size() * sizeof(std::uint32_t));
+        out.write(names_, names_size);
+        if (!out) {
+            out.close();
+            std::filesystem::remove(temporary, ec);
+            return;
+        }
+    }
+    std::filesystem::rename(temporary, path, ec);
+    if (ec) {
+        std::filesystem::remove(temporary, ec);
+    }
+}
+
+jdb::elf_symbol jdb::elf::make_symbol(const detail::indexed_symbol &symbol) const {
+    return {names_ + symbol.name, to_virt_addr(symbol.address), symbol.size, symbol.type};
+}
+
+std::optional<jdb::elf_symbol> jdb::elf::symbol_containing_address(virt_addr address) const {
+    if (!symbols_indexed_)
+        index_symbols();
+    auto file_address = to_file_addr(address);
+    // The last symbol starting at or before the address
+    auto it = std::upper_bound(symbols_.begin(), symbols_.end(), file_address,
+                               [](auto address, auto &symbol) { return address < symbol.address; });
+    // Symbols can be nested (or aliased), so a few may start before the address and only one of
+    // them hold it. Sizeless ones, like labels in assembly, only hold their own address. The look
+    // back is bounded so that addresses outside any symbol don't scan the whole table.
+    for (auto n = 0; n < 16 && it != symbols_.begin(); ++n) {
+        --it;
+        if (file_address - it->address < std::max<std::uint64_t>(it->size, 1))
+            return make_symbol(*it);
+    }
+    return std::nullopt;
+}
+
+std::vector<jdb::elf_symbol> jdb::elf::symbols_by_name(std::string_view name) const {
+    if (!symbols_indexed_)
+        index_symbols();
+    std::vector<elf_symbol> ret;
+    if (name_slots_.empty())
+        return ret;
+    auto mask = name_slots_.size() - 1;
+    for (auto slot = hash_name(name) & mask; name_slots_[slot] != 0; slot = (slot + 1) & mask) {
+        auto &symbol = symbols_[name_slots_[slot] - 1];
+        if (std::string_view(names_ + symbol.name) == name) {
+            ret.push_back(make_symbol(symbol));
+        }
+    }
+    return ret;
+}
+
+std::size_t jdb::elf::symbol_count() const {
+    if (!symbols_indexed_)
+        index_symbols();
+    return symbols_.size();
+}
+
+bool jdb::elf::symbols_from_cache() const {
+    if (!symbols_indexed_)
+        index_symbols();
+    return cache_map_ != nullptr;
+}
+
+const jdb::dwarf &jdb::elf::get_dwarf() const {
+    // The unit index may come from the cache with the symbols, and writing that cache builds it
+    if (!symbols_indexed_) {
+        index_symbols();
+    }
+    if (!dwarf_) {
+        dwarf_ = std::make_unique<dwarf>(*this);
+    }
+    return *dwarf_;
+}
+
+bool jdb::elf::cached_compile_units(span<const std::uint64_t> &offsets,
+                                    span<const detail::indexed_unit_range> &ranges) const {
+    if (!symbols_from_cache())
+        return false;
+    offsets = cached_unit_offsets_;
+    ranges = cached_unit_ranges_;
+    return true;
+}
+
+const jdb::call_frame_information &jdb::elf::get_call_frame_info() const {
+    if (!call_frame_info_) {
+        call_frame_info_ = std::make_unique<call_frame_information>(*this);
+    }
+    return *call_frame_info_;
+}
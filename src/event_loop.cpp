@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <libjdb/error.hpp>
+#include <libjdb/event_loop.hpp>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+// glibc only wraps pidfd_open from 2.36 onwards
+int pidfd_open(pid_t pid) { return static_cast<int>(syscall(SYS_pidfd_open, pid, 0)); }
+} // namespace
+
+jdb::event_loop::event_loop() {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    // SIGCHLD has to be blocked, otherwise it is delivered (and ignored) instead of being queued
+    // for the signalfd
+    if (pthread_sigmask(SIG_BLOCK, &mask, &previous_mask_) != 0) {
+        error::send("Could not block SIGCHLD");
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    if ((epoll_fd_ = epoll_create1(EPOLL_CLOEXEC)) < 0 ||
+        (signal_fd_ = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0 ||
+        (event.data.fd = signal_fd_,
+         epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, signal_fd_, &event) < 0)) {
+        auto saved_errno = errno;
+        release();
+        errno = saved_errno;
+        error::send_errno("Could not create event loop");
+    }
+}
+
+jdb::event_loop::~event_loop() { release(); }
+
+void jdb::event_loop::release() {
+    for (auto &watched : watched_) {
+        close(watched.pidfd);
+    }
+    watched_.clear();
+    if (signal_fd_ != -1) {
+        close(signal_fd_);
+        signal_fd_ = -1;
+    }
+    if (epoll_fd_ != -1) {
+        close(epoll_fd_);
+        epoll_fd_ = -1;
+    }
+    pthread_sigmask(SIG_SETMASK, &previous_mask_, nullptr);
+}
+
+void jdb::event_loop::add(process &proc, callback on_stop) {
+    auto fd = pidfd_open(proc.pid());
+    if (fd < 0) {
+        error::send_errno("Could not open pidfd");
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+        close(fd);
+        error::send_errno("Could not watch pidfd");
+    }
+
+    watched_.push_back({&proc, fd, std::move(on_stop)});
+}
+
+void jdb::event_loop::remove(process &proc) {
+    auto it = std::find_if(watched_.begin(), watched_.end(),
+                           [&](auto &watched) { return watched.proc == &proc; });
+    if (it == watched_.end())
+        return;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, it->pidfd, nullptr);
+    close(it->pidfd);
+    watched_.erase(it);
+}
+
+bool jdb::event_loop::any_running() const {
+    return std::any_of(watched_.begin(), watched_.end(), [](auto &watched) {
+        return watched.proc->state() == process_state::running;
+    });
+}
+
+std::size_t jdb::event_loop::dispatch_pending() {
+    // Callbacks may resume processes or remove them from the loop, so collect first
+    std::vector<std::pair<process *, stop_reason>> ready;
+    for (auto &watched : watched_) {
+        if (watched.proc->state() != process_state::running)
+            continue;
+        if (auto reason = watched.proc->try_wait()) {
+            ready.emplace_back(watched.proc, *reason);
+        }
+    }
+
+    for (auto &[proc, reason] : ready) {
+        auto it = std::find_if(watched_.begin(), watched_.end(),
+                               [proc = proc](auto &watched) { return watched.proc == proc; });
+        if (it == watched_.end())
+            continue;
+
+        // A pidfd stays readable once its process has ended, so stop watching it
+        if (reason.reason == process_state::exited || reason.reason == process_state::terminated) {
+            epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, it->pidfd, nullptr);
+        }
+        auto on_stop = it->on_stop;
+        on_stop(*proc, reason);
+    }
+    return ready.size();
+}
+
+std::size_t jdb::event_loop::run_once(std::optional<std::chrono::milliseconds> timeout) {
+    using clock = std::chrono::steady_clock;
+    std::optional<clock::time_point> deadline;
+    if (timeout) {
+        deadline = clock::now() + *timeout;
+    }
+
+    while (true) {
+        // Reaping before waiting also catches anything that happened before SIGCHLD was blocked
+        if (auto dispatched = dispatch_pending()) {
+            return dispatched;
+        }
+        if (!any_running()) {
+            return 0;
+        }
+
+        int wait_ms = -1;
+        if (deadline) {
+            auto remaining = std::chrono::ceil<std::chrono::milliseconds>(*deadline - clock::now());
+            if (remaining.count() <= 0) {
+                return 0;
+            }
+            wait_ms = static_cast<int>(remaining.count());
+        }
+
+        epoll_event events[16];
+        auto n_events = epoll_wait(epoll_fd_, events, 16, wait_ms);
+        if (n_events < 0) {
+            if (errno == EINTR)
+                continue;
+            error::send_errno("epoll_wait failed");
+        }
+
+        for (int i = 0; i < n_events; ++i) {
+            if (events[i].data.fd != signal_fd_)
+                continue;
+            // Several SIGCHLDs may have been merged into one, which is why every running process is
+            // reaped afterwards rather than only the sender
+            signalfd_siginfo info;
+            while (read(signal_fd_, &info, sizeof(info)) == sizeof(info)) {
+            }
+        }
+    }
+}
+
+void jdb::event_loop::run() {
+    while (any_running()) {
+        run_once();
+    }
+}
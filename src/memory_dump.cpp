@@ -0,0 +1,214 @@
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <emmintrin.h>
+#include <fcntl.h>
+#include <libjdb/bit.hpp>
+#include <libjdb/error.hpp>
+#include <libjdb/memory_dump.hpp>
+#include <libjdb/process.hpp>
+#include <mutex>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+constexpr std::size_t page_size = jdb::page_cache::page_size;
+constexpr std::size_t bytes_per_line = 32;
+// 16 digits of address, ": ", the bytes and a newline
+constexpr std::size_t line_length = 16 + 2 + 2 * bytes_per_line + 1;
+
+// Fills buffer with the memory at address. Pages that can't be read are zeroed, and counted in the
+// return value.
+std::size_t read_chunk(pid_t pid, std::uint64_t address, jdb::span<std::byte> buffer) {
+    std::size_t unreadable = 0;
+    std::size_t done = 0;
+    while (done < buffer.size()) {
+        iovec local{buffer.data() + done, buffer.size() - done};
+        iovec remote{reinterpret_cast<void *>(address + done), local.iov_len};
+        auto result = process_vm_readv(pid, &local, 1, &remote, 1, 0);
+        done += result > 0 ? static_cast<std::size_t>(result) : 0;
+        if (done < buffer.size()) {
+            // A read stops at the first page it can't read, which is skipped before reading on
+            auto next_page = std::min<std::uint64_t>(
+                (address + done) / page_size * page_size + page_size - address, buffer.size());
+            std::memset(buffer.data() + done, 0, next_page - done);
+            unreadable += next_page - done;
+            done = next_page;
+        }
+    }
+    return unreadable;
+}
+
+// Writes the lines for size bytes read from address to out. Returns the number of characters.
+std::size_t format_hex(std::uint64_t address, const std::byte *data, std::size_t size,
+                       char *out) {
+    auto begin = out;
+    for (std::size_t i = 0; i < size; i += bytes_per_line) {
+        // Most significant digit first
+        auto line_address = __builtin_bswap64(address + i);
+        jdb::encode_hex({jdb::as_bytes(line_address), sizeof(line_address)}, out);
+        out += 16;
+        *out++ = ':';
+        *out++ = ' ';
+        auto n_bytes = std::min(bytes_per_line, size - i);
+        jdb::encode_hex({data + i, n_bytes}, out);
+        out += 2 * n_bytes;
+        *out++ = '\n';
+    }
+    return out - begin;
+}
+
+bool write_all(int fd, const void *data, std::size_t size) {
+    auto bytes = static_cast<const char *>(data);
+    while (size > 0) {
+        auto result = write(fd, bytes, size);
+        if (result < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        bytes += result;
+        size -= result;
+    }
+    return true;
+}
+} // namespace
+
+void jdb::encode_hex(span<const std::byte> data, char *out) {
+    auto nibble_mask = _mm_set1_epi8(0x0f);
+    auto nine = _mm_set1_epi8(9);
+    auto zero = _mm_set1_epi8('0');
+    // From the character after '9' to 'a'
+    auto letter_gap = _mm_set1_epi8('a' - '9' - 1);
+    auto to_digits = [&](__m128i nibbles) {
+        auto letters = _mm_and_si128(_mm_cmpgt_epi8(nibbles, nine), letter_gap);
+        return _mm_add_epi8(_mm_add_epi8(nibbles, zero), letters);
+    };
+
+    std::size_t i = 0;
+    for (; i + 16 <= data.size(); i += 16) {
+        auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data.begin() + i));
+        // There is no 8 bit shift. The 16 bit one moves bits of the next byte in, which the mask
+        // takes out again.
+        auto high = _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble_mask);
+        auto low = _mm_and_si128(bytes, nibble_mask);
+        // Interleaving puts the high digit of each byte before the low one
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i),
+                         to_digits(_mm_unpacklo_epi8(high, low)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i + 16),
+                         to_digits(_mm_unpackhi_epi8(high, low)));
+    }
+    static constexpr char digits[] = "0123456789abcdef";
+    for (; i < data.size(); ++i) {
+        auto byte = static_cast<std::uint8_t>(data[i]);
+        out[2 * i] = digits[byte >> 4];
+        out[2 * i + 1] = digits[byte & 0xf];
+    }
+}
+
+jdb::dump_stats jdb::dump_memory(const process &proc, virt_addr start, std::uint64_t size,
+                                 const std::filesystem::path &path, dump_format format,
+                                 std::size_t chunk_size) {
+    if (proc.state() != process_state::stopped) {
+        error::send("Memory can only be dumped from a stopped process");
+    }
+    if (start.addr() + size < start.addr()) {
+        error::send("Dump runs past the end of the address space");
+    }
+    // Whole lines, so that every chunk starts a new one
+    chunk_size = std::max<std::size_t>(chunk_size / bytes_per_line, 1) * bytes_per_line;
+
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        error::send_errno("Could not open dump file");
+    }
+
+    struct slot {
+        std::vector<std::byte> data;
+        std::size_t size = 0;
+        std::size_t unreadable = 0;
+        // Read, and waiting to be written
+        bool full = false;
+    };
+    std::array<slot, 2> slots;
+    auto buffer_size = static_cast<std::size_t>(std::min<std::uint64_t>(chunk_size, size));
+    for (auto &slot : slots) {
+        slot.data.resize(buffer_size);
+    }
+    std::vector<char> text;
+    if (format == dump_format::hex) {
+        text.resize((buffer_size + bytes_per_line - 1) / bytes_per_line * line_length);
+    }
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool cancelled = false;
+    auto n_chunks = (size + chunk_size - 1) / chunk_size;
+    auto pid = proc.pid();
+
+    // Only touches the slots and the pid, so it doesn't race with the use of proc below
+    std::thread reader([&] {
+        for (std::uint64_t i = 0; i < n_chunks; ++i) {
+            auto &slot = slots[i % 2];
+            {
+                std::unique_lock lock(mutex);
+                changed.wait(lock, [&] { return !slot.full || cancelled; });
+                if (cancelled)
+                    return;
+            }
+            auto offset = i * chunk_size;
+            slot.size = std::min<std::uint64_t>(chunk_size, size - offset);
+            slot.unreadable = read_chunk(pid, start.addr() + offset, {slot.data.data(), slot.size});
+            {
+                std::lock_guard lock(mutex);
+                slot.full = true;
+            }
+            changed.notify_all();
+        }
+    });
+
+    dump_stats stats;
+    int write_error = 0;
+    for (std::uint64_t i = 0; i < n_chunks; ++i) {
+        auto &slot = slots[i % 2];
+        {
+            std::unique_lock lock(mutex);
+            changed.wait(lock, [&] { return slot.full; });
+        }
+        auto address = start + i * chunk_size;
+        proc.remove_traps(address, {slot.data.data(), slot.size});
+        stats.bytes_read += slot.size - slot.unreadable;
+        stats.bytes_unreadable += slot.unreadable;
+
+        bool written;
+        if (format == dump_format::raw) {
+            written = write_all(fd, slot.data.data(), slot.size);
+        } else {
+            auto length = format_hex(address.addr(), slot.data.data(), slot.size, text.data());
+            written = write_all(fd, text.data(), length);
+        }
+        if (!written) {
+            write_error = errno;
+        }
+
+        {
+            std::lock_guard lock(mutex);
+            slot.full = false;
+            cancelled = !written;
+        }
+        changed.notify_all();
+        if (!written)
+            break;
+    }
+
+    reader.join();
+    close(fd);
+    if (write_error) {
+        errno = write_error;
+        error::send_errno("Could not write dump file");
+    }
+    return stats;
+}
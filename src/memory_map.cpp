@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <libjdb/error.hpp>
+#include <libjdb/memory_map.hpp>
+#include <string>
+#include <unistd.h>
+
+namespace {
+// Reads digits in the given base from cursor on, and leaves cursor on the first character that
+// isn't one
+std::uint64_t parse_number(const char *&cursor, const char *end, int base) {
+    std::uint64_t value = 0;
+    for (; cursor != end; ++cursor) {
+        auto c = *cursor;
+        int digit;
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if (base == 16 && c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else {
+            break;
+        }
+        value = value * base + digit;
+    }
+    return value;
+}
+
+void skip(const char *&cursor, const char *end, char c) {
+    while (cursor != end && *cursor == c) {
+        ++cursor;
+    }
+}
+
+// Moves past the current field and the spaces after it
+void skip_field(const char *&cursor, const char *end) {
+    while (cursor != end && *cursor != ' ' && *cursor != '\n') {
+        ++cursor;
+    }
+    skip(cursor, end, ' ');
+}
+} // namespace
+
+void jdb::memory_map::load(pid_t pid) {
+    auto path = "/proc/" + std::to_string(pid) + "/maps";
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error::send_errno("Could not read memory map");
+    }
+    // The size of the file is only known once it has been read, so the buffer grows until a read
+    // comes back empty. It keeps its capacity for the next load.
+    text_.resize(std::max<std::size_t>(text_.capacity(), 0x4000));
+    std::size_t size = 0;
+    while (true) {
+        if (size == text_.size()) {
+            text_.resize(text_.size() * 2);
+        }
+        auto result = read(fd, text_.data() + size, text_.size() - size);
+        if (result < 0) {
+            if (errno == EINTR)
+                continue;
+            close(fd);
+            error::send_errno("Could not read memory map");
+        }
+        if (result == 0)
+            break;
+        size += result;
+    }
+    close(fd);
+    text_.resize(size);
+    parse();
+    ++loads_;
+}
+
+void jdb::memory_map::parse() {
+    regions_.clear();
+    const char *cursor = text_.data();
+    const char *end = text_.data() + text_.size();
+    // start-end perms offset major:minor inode name
+    while (cursor != end) {
+        memory_region region;
+        region.start = virt_addr{parse_number(cursor, end, 16)};
+        skip(cursor, end, '-');
+        region.end = virt_addr{parse_number(cursor, end, 16)};
+        skip(cursor, end, ' ');
+
+        auto perms = cursor;
+        skip_field(cursor, end);
+        if (cursor - perms < 5) {
+            error::send("Invalid memory map");
+        }
+        region.readable = perms[0] == 'r';
+        region.writable = perms[1] == 'w';
+        region.executable = perms[2] == 'x';
+        region.shared = perms[3] == 's';
+
+        region.offset = parse_number(cursor, end, 16);
+        skip(cursor, end, ' ');
+        skip_field(cursor, end);
+        region.inode = parse_number(cursor, end, 10);
+        skip(cursor, end, ' ');
+
+        // The name runs to the end of the line, spaces included
+        auto name = cursor;
+        cursor = std::find(cursor, end, '\n');
+        region.name = std::string_view(name, cursor - name);
+        if (cursor != end) {
+            ++cursor;
+        }
+        regions_.push_back(region);
+    }
+}
+
+const jdb::memory_region *jdb::memory_map::find(virt_addr address) const {
+    // The first region ending after the address is the only one that can hold it
+    auto it = std::upper_bound(regions_.begin(), regions_.end(), address,
+                               [](virt_addr address, auto &region) { return address < region.end; });
+    if (it == regions_.end() || !it->contains(address)) {
+        return nullptr;
+    }
+    return &*it;
+}
+
+jdb::span<const jdb::memory_region> jdb::memory_map::regions_in(virt_addr start,
+                                                                 virt_addr end) const {
+    auto first = std::upper_bound(regions_.begin(), regions_.end(), start,
+                                  [](virt_addr address, auto &region) { return address < region.end; });
+    auto last = std::lower_bound(first, regions_.end(), end,
+                                 [](auto &region, virt_addr address) { return region.start < address; });
+    return {regions_.data() + (first - regions_.begin()), static_cast<std::size_t>(last - first)};
+}
@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <cstring>
+#include <immintrin.h>
+#include <libjdb/error.hpp>
+#include <libjdb/memory_search.hpp>
+#include <libjdb/process.hpp>
+#include <sys/uio.h>
+#include <thread>
+
+namespace {
+constexpr std::size_t page_size = jdb::page_cache::page_size;
+// Bytes a worker reads with a single process_vm_readv. Large enough to amortize the syscall, small
+// enough that the work spreads evenly among workers and the buffers stay in L2.
+constexpr std::size_t chunk_size = 1 << 20;
+// Below this, starting threads costs more than the search
+constexpr std::size_t min_bytes_per_worker = 8 * chunk_size;
+
+// Compares the candidates flagged by mask, which are relative to position, in full
+void verify_candidates(std::uint32_t mask, std::size_t position, const std::uint8_t *data,
+                       const std::uint8_t *needle, std::size_t size,
+                       std::vector<std::size_t> &offsets) {
+    while (mask) {
+        auto candidate = position + __builtin_ctz(mask);
+        // The first and last bytes are known to match
+        if (size <= 2 || std::memcmp(data + candidate + 1, needle + 1, size - 2) == 0) {
+            offsets.push_back(candidate);
+        }
+        mask &= mask - 1;
+    }
+}
+
+// Each of these scans from position on while a whole vector of candidate positions fits, and
+// returns where it stopped
+std::size_t find_sse2(const std::uint8_t *data, std::size_t n_candidates,
+                      const std::uint8_t *needle, std::size_t size,
+                      std::vector<std::size_t> &offsets) {
+    auto first = _mm_set1_epi8(static_cast<char>(needle[0]));
+    auto last = _mm_set1_epi8(static_cast<char>(needle[size - 1]));
+    std::size_t position = 0;
+    for (; position + 16 <= n_candidates; position += 16) {
+        auto starts = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + position));
+        auto ends =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + position + size - 1));
+        auto matches = _mm_and_si128(_mm_cmpeq_epi8(starts, first), _mm_cmpeq_epi8(ends, last));
+        auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(matches));
+        verify_candidates(mask, position, data, needle, size, offsets);
+    }
+    return position;
+}
+
+__attribute__((target("avx2"))) std::size_t find_avx2(const std::uint8_t *data,
+                                                      std::size_t n_candidates,
+                                                      const std::uint8_t *needle,
+                                                      std::size_t size,
+                                                      std::vector<std::size_t> &offsets) {
+    auto first = _mm256_set1_epi8(static_cast<char>(needle[0]));
+    auto last = _mm256_set1_epi8(static_cast<char>(needle[size - 1]));
+    std::size_t position = 0;
+    for (; position + 32 <= n_candidates; position += 32) {
+        auto starts = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + position));
+        auto ends =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + position + size - 1));
+        auto matches =
+            _mm256_and_si256(_mm256_cmpeq_epi8(starts, first), _mm256_cmpeq_epi8(ends, last));
+        auto mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(matches));
+        verify_candidates(mask, position, data, needle, size, offsets);
+    }
+    return position;
+}
+
+bool has_avx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+} // namespace
+
+void jdb::find_in_buffer(span<const std::byte> haystack, span<const std::byte> needle,
+                         std::vector<std::size_t> &offsets) {
+    if (needle.empty() || haystack.size() < needle.size()) {
+        return;
+    }
+    auto data = reinterpret_cast<const std::uint8_t *>(haystack.data());
+    auto pattern = reinterpret_cast<const std::uint8_t *>(needle.data());
+    auto size = needle.size();
+    // Positions a match can start at
+    auto n_candidates = haystack.size() - size + 1;
+
+    auto position = has_avx2() ? find_avx2(data, n_candidates, pattern, size, offsets)
+                               : find_sse2(data, n_candidates, pattern, size, offsets);
+    // What's left is less than a vector
+    for (; position < n_candidates; ++position) {
+        if (data[position] == pattern[0] && std::memcmp(data + position, pattern, size) == 0) {
+            offsets.push_back(position);
+        }
+    }
+}
+
+jdb::memory_searcher::memory_searcher(process &proc, std::size_t workers)
+    : process_(&proc) {
+    if (workers == 0) {
+        workers = std::clamp<std::size_t>(std::thread::hardware_concurrency(), 1, 8);
+    }
+    workers_ = workers;
+    buffers_.resize(workers);
+}
+
+std::vector<jdb::virt_addr> jdb::memory_searcher::find(span<const std::byte> pattern,
+                                                       virt_addr start, virt_addr end,
+                                                       std::size_t alignment,
+                                                       std::size_t max_matches) {
+    if (process_->state() != process_state::stopped) {
+        error::send("Memory can only be searched in a stopped process");
+    }
+    if (pattern.empty()) {
+        error::send("Search pattern is empty");
+    }
+
+    std::vector<chunk> chunks;
+    std::uint64_t total = 0;
+    for (auto &region : process_->get_memory_map().regions_in(start, end)) {
+        // [vvar] and [vsyscall] belong to the kernel, and can't be read through process_vm_readv
+        if (!region.readable || region.name.rfind("[vvar", 0) == 0 ||
+            region.name == "[vsyscall]")
+            continue;
+        auto low = std::max(region.start, start).addr();
+        auto high = std::min(region.end, end).addr();
+        for (auto address = low; address < high; address += chunk_size) {
+            // Reads go on past the range, but never past the region, so matches that start in the
+            // range and end after it are found
+            auto read_end = std::min<std::uint64_t>(address + chunk_size + pattern.size() - 1,
+                                                    region.end.addr());
+            auto starts_end = std::min<std::uint64_t>(address + chunk_size, high);
+            chunks.push_back({address, static_cast<std::size_t>(read_end - address), starts_end});
+            total += read_end - address;
+        }
+    }
+
+    pattern_ = pattern;
+    alignment_ = std::max<std::size_t>(alignment, 1);
+    max_matches_ = max_matches;
+    match_count_ = 0;
+    bytes_scanned_ = 0;
+    matches_.clear();
+
+    auto n_threads = std::clamp<std::size_t>(total / min_bytes_per_worker, 1, workers_);
+    std::atomic<std::size_t> next = 0;
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < n_threads; ++i) {
+        threads.emplace_back([this, i, &chunks, &next] { run_jobs(i, chunks, next); });
+    }
+    // The calling thread is a worker too
+    run_jobs(0, chunks, next);
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    std::sort(matches_.begin(), matches_.end());
+    if (matches_.size() > max_matches) {
+        matches_.resize(max_matches);
+    }
+    return std::move(matches_);
+}
+
+void jdb::memory_searcher::run_jobs(std::size_t worker, const std::vector<chunk> &chunks,
+                                    std::atomic<std::size_t> &next) {
+    auto &buffer = buffers_[worker];
+    buffer.resize(chunk_size + pattern_.size() - 1);
+    std::vector<std::size_t> offsets;
+    std::vector<virt_addr> found;
+
+    while (match_count_ < max_matches_) {
+        auto index = next.fetch_add(1);
+        if (index >= chunks.size())
+            break;
+        auto &job = chunks[index];
+
+        // A read goes up to the first unreadable page, which is skipped before reading the rest
+        std::size_t done = 0;
+        while (done < job.size) {
+            auto address = job.address + done;
+            iovec local{buffer.data(), job.size - done};
+            iovec remote{reinterpret_cast<void *>(address), local.iov_len};
+            auto result = process_vm_readv(process_->pid(), &local, 1, &remote, 1, 0);
+            auto n_read = result > 0 ? static_cast<std::size_t>(result) : 0;
+            bytes_scanned_ += n_read;
+
+            offsets.clear();
+            find_in_buffer({buffer.data(), n_read}, pattern_, offsets);
+            for (auto offset : offsets) {
+                auto match = address + offset;
+                if (match >= job.starts_end)
+                    break;
+                if (match % alignment_ == 0) {
+                    found.push_back(virt_addr{match});
+                    ++match_count_;
+                }
+            }
+
+            done += n_read;
+            if (done < job.size) {
+                done = (address + n_read) / page_size * page_size + page_size - job.address;
+            }
+        }
+    }
+
+    std::lock_guard lock(matches_mutex_);
+    matches_.insert(matches_.end(), found.begin(), found.end());
+}
@@ -0,0 +1,56 @@
+#include <libjdb/page_cache.hpp>
+
+const std::byte *jdb::page_cache::lookup(std::uint64_t page_number) {
+    auto it = slots_by_page_.find(page_number);
+    if (it == slots_by_page_.end()) {
+        ++stats_.misses;
+        return nullptr;
+    }
+    ++stats_.hits;
+    return storage_.get() + it->second * page_size;
+}
+
+std::byte *jdb::page_cache::allocate(std::uint64_t page_number) {
+    if (!storage_) {
+        storage_.reset(new std::byte[capacity * page_size]);
+        slot_pages_.fill(no_page);
+    }
+
+    auto slot = next_slot_;
+    next_slot_ = (next_slot_ + 1) % capacity;
+
+    if (slot_pages_[slot] != no_page) {
+        slots_by_page_.erase(slot_pages_[slot]);
+    }
+    slot_pages_[slot] = page_number;
+    slots_by_page_[page_number] = slot;
+
+    return storage_.get() + slot * page_size;
+}
+
+void jdb::page_cache::discard(std::uint64_t page_number) {
+    auto it = slots_by_page_.find(page_number);
+    if (it == slots_by_page_.end())
+        return;
+    slot_pages_[it->second] = no_page;
+    slots_by_page_.erase(it);
+}
+
+void jdb::page_cache::invalidate() {
+    if (slots_by_page_.empty())
+        return;
+    slot_pages_.fill(no_page);
+    slots_by_page_.clear();
+}
+
+void jdb::page_cache::invalidate(std::uint64_t first_page, std::uint64_t last_page) {
+    if (slots_by_page_.empty())
+        return;
+    // Scanning the slots is bounded by capacity, whatever the size of the range
+    for (auto &page : slot_pages_) {
+        if (page != no_page && page >= first_page && page <= last_page) {
+            slots_by_page_.erase(page);
+            page = no_page;
+        }
+    }
+}
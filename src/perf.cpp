@@ -0,0 +1,97 @@
+#include <cerrno>
+#include <cstdint>
+#include <libjdb/perf.hpp>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace {
+struct counter_kind {
+    std::uint64_t config;
+    std::optional<std::uint64_t> jdb::perf_counts::*field;
+};
+
+constexpr counter_kind counter_kinds[] = {
+    {PERF_COUNT_HW_INSTRUCTIONS, &jdb::perf_counts::instructions},
+    {PERF_COUNT_HW_CPU_CYCLES, &jdb::perf_counts::cycles},
+    {PERF_COUNT_HW_CACHE_MISSES, &jdb::perf_counts::cache_misses},
+    {PERF_COUNT_HW_BRANCH_MISSES, &jdb::perf_counts::branch_misses},
+};
+
+// What read() returns for the read_format used below
+struct counter_value {
+    std::uint64_t value;
+    std::uint64_t time_enabled;
+    std::uint64_t time_running;
+};
+} // namespace
+
+jdb::perf_counters::~perf_counters() { clear(); }
+
+void jdb::perf_counters::clear() {
+    for (auto &counter : counters_) {
+        close(counter.fd);
+    }
+    counters_.clear();
+    started_ = false;
+}
+
+void jdb::perf_counters::add_thread(pid_t tid) {
+    static_assert(sizeof(counter_kinds) / sizeof(counter_kinds[0]) == n_kinds);
+    for (std::size_t kind = 0; kind < n_kinds; ++kind) {
+        if (unavailable_[kind])
+            continue;
+
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = counter_kinds[kind].config;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        // The PMU has only a few counters. When more events are open than it has, the kernel
+        // multiplexes them, and the times are needed to scale the counts back up.
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        auto fd = perf_event_open(attr, tid);
+        if (fd >= 0) {
+            counters_.push_back({fd, kind});
+        } else if (errno != ESRCH) {
+            // No PMU, no such event on this CPU, or perf_event_paranoid forbids it
+            unavailable_[kind] = true;
+        }
+    }
+}
+
+void jdb::perf_counters::start() {
+    for (auto &counter : counters_) {
+        ioctl(counter.fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(counter.fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    started_ = true;
+}
+
+std::optional<jdb::perf_counts> jdb::perf_counters::stop() {
+    if (!started_ || counters_.empty()) {
+        return std::nullopt;
+    }
+    started_ = false;
+
+    perf_counts counts;
+    for (auto &counter : counters_) {
+        ioctl(counter.fd, PERF_EVENT_IOC_DISABLE, 0);
+        counter_value value;
+        if (read(counter.fd, &value, sizeof(value)) != sizeof(value))
+            continue;
+        auto scaled = value.value;
+        if (value.time_running == 0) {
+            scaled = 0;
+        } else if (value.time_running < value.time_enabled) {
+            scaled = static_cast<std::uint64_t>(static_cast<double>(value.value) *
+                                                value.time_enabled / value.time_running);
+        }
+        auto &field = counts.*counter_kinds[counter.kind].field;
+        field = field.value_or(0) + scaled;
+    }
+    return counts;
+}
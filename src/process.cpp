@@ -1,24 +1,40 @@
 #include "libjdb/bit.hpp"
+#include <algorithm>
 #include <cerrno>
+#include <climits>
 #include <csignal>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <elf.h>
+#include <fcntl.h>
+#include <filesystem>
 #include <iostream>
 #include <libjdb/bit.hpp>
 #include <libjdb/error.hpp>
+#include <libjdb/event_loop.hpp>
 #include <libjdb/pipe.hpp>
 #include <libjdb/process.hpp>
 #include <libjdb/register_info.hpp>
+#include <link.h>
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
 #include <memory>
 #include <optional>
 #include <string>
+#include <system_error>
+#include <sys/prctl.h>
 #include <sys/ptrace.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/user.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#include <unordered_map>
+#include <vector>
 
 namespace {
 void exit_with_perror(jdb::pipe &channel, std::string const &prefix) {
@@ -26,10 +42,172 @@ void exit_with_perror(jdb::pipe &channel, std::string const &prefix) {
     channel.write(reinterpret_cast<std::byte *>(message.data()), message.size());
     exit(-1);
 }
+
+constexpr std::size_t page_size = jdb::page_cache::page_size;
+// Upper bound on the number of iovecs process_vm_readv/writev accept in a single call (IOV_MAX)
+constexpr std::size_t max_iovecs = 1024;
+
+/*
+ * Splits [address, address + size) into page sized iovecs, filling at most max_iovecs of them.
+ * Splitting at page boundaries means a transfer that faults stops exactly where the unmapped (or
+ * protected) page starts, so everything before it is still transferred. Returns the number of
+ * iovecs used and sets covered to the number of bytes they span.
+ */
+std::size_t split_at_pages(std::uint64_t address, std::size_t size, iovec *iovecs,
+                           std::size_t &covered) {
+    std::size_t count = 0;
+    covered = 0;
+    while (covered < size && count < max_iovecs) {
+        auto current = address + covered;
+        auto up_to_next_page = page_size - (current & (page_size - 1));
+        auto chunk_size = std::min<std::size_t>(size - covered, up_to_next_page);
+        iovecs[count++] = {reinterpret_cast<void *>(current), chunk_size};
+        covered += chunk_size;
+    }
+    return count;
+}
+
+// Size of the transfer from address to the end of its page, capped at size
+std::size_t bytes_to_page_end(std::uint64_t address, std::size_t size) {
+    return std::min<std::size_t>(size, page_size - (address & (page_size - 1)));
+}
+
+// Every traced thread of every live process object. waitpid(-1) can reap a status that belongs to
+// another process, which then gets it handed over through this.
+std::unordered_map<pid_t, jdb::process *> &thread_owners() {
+    static std::unordered_map<pid_t, jdb::process *> owners;
+    return owners;
+}
+
+// Stops of tids nobody tracks yet. The first stop of a new thread can be reaped before the clone
+// event that announces it, and checkpoints and forks are waited on by pid later.
+std::unordered_map<pid_t, int> &unclaimed_statuses() {
+    static std::unordered_map<pid_t, int> statuses;
+    return statuses;
+}
+
+bool is_clone_event(int wait_status) {
+    return wait_status >> 8 == (SIGTRAP | (PTRACE_EVENT_CLONE << 8));
+}
+
+// Stop reported for PTRACE_INTERRUPT, and by new threads of seized processes
+bool is_interrupt_stop(int wait_status) {
+    return wait_status >> 8 == (SIGTRAP | (PTRACE_EVENT_STOP << 8));
+}
+
+bool has_ended(int wait_status) { return WIFEXITED(wait_status) || WIFSIGNALED(wait_status); }
+
+bool is_fork_event(int wait_status) {
+    return wait_status >> 8 == (SIGTRAP | (PTRACE_EVENT_FORK << 8));
+}
+
+// Waits for a tracee no process object tracks, like a checkpoint or a fork that isn't adopted yet
+int wait_for_untracked(pid_t tid) {
+    auto unclaimed = unclaimed_statuses().find(tid);
+    if (unclaimed != unclaimed_statuses().end()) {
+        auto wait_status = unclaimed->second;
+        unclaimed_statuses().erase(unclaimed);
+        return wait_status;
+    }
+    int wait_status;
+    while (waitpid(tid, &wait_status, __WALL) < 0) {
+        if (errno != EINTR) {
+            jdb::error::send_errno("waitpid failed");
+        }
+    }
+    return wait_status;
+}
+
+// Overwrites size bytes at address a word at a time with PTRACE_POKEDATA, which writes through
+// read-only code pages, and stores the bytes it replaced in old
+void poke_bytes(pid_t tid, std::uint64_t address, const std::byte *data, std::size_t size,
+                std::byte *old = nullptr) {
+    for (std::size_t done = 0; done < size;) {
+        auto word_address = (address + done) & ~std::uint64_t(7);
+        auto offset = (address + done) - word_address;
+        auto n = std::min<std::size_t>(size - done, 8 - offset);
+
+        errno = 0;
+        auto word = ptrace(PTRACE_PEEKDATA, tid, word_address, nullptr);
+        if (errno != 0) {
+            jdb::error::send_errno("Could not read memory");
+        }
+        auto bytes = reinterpret_cast<std::byte *>(&word);
+        if (old) {
+            std::copy(bytes + offset, bytes + offset + n, old + done);
+        }
+        std::copy(data + done, data + done + n, bytes + offset);
+        if (ptrace(PTRACE_POKEDATA, tid, word_address, word) < 0) {
+            jdb::error::send_errno("Could not write memory");
+        }
+        done += n;
+    }
+}
+
+bool is_seccomp_stop(int wait_status) {
+    return wait_status >> 8 == (SIGTRAP | (PTRACE_EVENT_SECCOMP << 8));
+}
+
+// With PTRACE_O_TRACESYSGOOD, syscall stops set bit 7 of the signal, unlike a real SIGTRAP
+bool is_syscall_stop(int wait_status) {
+    return WIFSTOPPED(wait_status) && WSTOPSIG(wait_status) == (SIGTRAP | 0x80);
+}
+
+// Syscalls whose return means /proc/<pid>/maps may read differently
+constexpr int mapping_syscalls[] = {SYS_mmap, SYS_munmap, SYS_mprotect, SYS_mremap,
+                                    SYS_brk,  SYS_shmat,  SYS_shmdt};
+
+bool changes_mappings(int id) {
+    return std::find(std::begin(mapping_syscalls), std::end(mapping_syscalls), id) !=
+           std::end(mapping_syscalls);
+}
+
+// Threads created by a traced thread are traced as well, and inherit its options
+constexpr long ptrace_options =
+    PTRACE_O_TRACECLONE | PTRACE_O_TRACESECCOMP | PTRACE_O_TRACESYSGOOD;
+
+void set_ptrace_options(pid_t tid) {
+    if (ptrace(PTRACE_SETOPTIONS, tid, nullptr, ptrace_options) < 0) {
+        jdb::error::send_errno("Failed to set ptrace options");
+    }
+}
+
+/*
+ * Builds a seccomp filter that hands the given syscalls to the tracer and allows everything else.
+ * Syscalls of other architectures, made through the 32 bit entry points, are allowed as well:
+ * their numbers mean something else.
+ */
+std::vector<sock_filter> make_syscall_filter(const std::vector<int> &traced_syscalls) {
+    std::vector<sock_filter> filter;
+    filter.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, arch)));
+    filter.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, AUDIT_ARCH_X86_64, 1, 0));
+    filter.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+    filter.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, nr)));
+    // x32 syscalls share the architecture, and set this bit in the number
+    filter.push_back(BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, __X32_SYSCALL_BIT, 0, 1));
+    filter.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+    // A compare per traced syscall. The jump offsets are 8 bit, which is why each one jumps over
+    // the trace return that follows it rather than to a shared one.
+    for (auto id : traced_syscalls) {
+        filter.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, static_cast<std::uint32_t>(id), 0, 1));
+        filter.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_TRACE));
+    }
+    filter.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+    return filter;
+}
 } // namespace
 
 std::unique_ptr<jdb::process> jdb::process::launch(std::filesystem::path path, bool debug,
-                                                   std::optional<int> stdout_replacement) {
+                                                   std::optional<int> stdout_replacement,
+                                                   const std::vector<int> &traced_syscalls) {
+    // Without a tracer, the filter would make the traced syscalls fail with ENOSYS
+    if (!debug && !traced_syscalls.empty()) {
+        error::send("Syscalls can only be traced in a debugged process");
+    }
+    // Built before forking, since the child shouldn't allocate
+    auto filter = make_syscall_filter(traced_syscalls);
+    sock_fprog filter_program{static_cast<unsigned short>(filter.size()), filter.data()};
+
     pipe channel(true);
     pid_t pid;
     // fork is a syscall that splits the running process into two different processes
@@ -52,6 +230,18 @@ std::unique_ptr<jdb::process> jdb::process::launch(std::filesystem::path path, b
         if (debug && ptrace(PTRACE_TRACEME, 0, nullptr, nullptr)) {
             exit_with_perror(channel, "Tracing failed");
         }
+        if (!traced_syscalls.empty()) {
+            // The filter stops at syscalls only once the tracer has set PTRACE_O_TRACESECCOMP, so
+            // wait for it to do so. Without the option, traced syscalls would fail with ENOSYS.
+            raise(SIGSTOP);
+            // Unprivileged processes may only install a filter if they can't gain privileges
+            if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) < 0) {
+                exit_with_perror(channel, "Could not set no_new_privs");
+            }
+            if (prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &filter_program) < 0) {
+                exit_with_perror(channel, "Could not install seccomp filter");
+            }
+        }
         // exec* is a family of syscalls that replaces the currently executing program with a
         // new one. The l means that the arguments will be passed to the program individually,
         // as opposed to an array. The p tells exec to look for the given program name in the
@@ -61,6 +251,19 @@ std::unique_ptr<jdb::process> jdb::process::launch(std::filesystem::path path, b
         }
     }
     channel.close_write();
+    if (!traced_syscalls.empty()) {
+        int wait_status;
+        if (waitpid(pid, &wait_status, 0) < 0) {
+            error::send_errno("waitpid failed");
+        }
+        // Otherwise the child exited, and the pipe tells why
+        if (WIFSTOPPED(wait_status)) {
+            set_ptrace_options(pid);
+            if (ptrace(PTRACE_CONT, pid, nullptr, nullptr) < 0) {
+                error::send_errno("Could not resume");
+            }
+        }
+    }
     auto data = channel.read();
     channel.close_read();
     // If any data has been written to the pipe, then an error has been thrown by the child.
@@ -71,8 +274,15 @@ std::unique_ptr<jdb::process> jdb::process::launch(std::filesystem::path path, b
     }
     std::unique_ptr<process> proc(
         new process(pid, /*terminate_on_end=*/true, /*is_attached=*/debug));
+    proc->mappings_traced_ =
+        std::all_of(std::begin(mapping_syscalls), std::end(mapping_syscalls), [&](int id) {
+            return std::find(traced_syscalls.begin(), traced_syscalls.end(), id) !=
+                   traced_syscalls.end();
+        });
     if (debug) {
         proc->wait_on_signal();
+        set_ptrace_options(pid);
+        proc->counters_.add_thread(pid);
     }
     return proc;
 }
@@ -88,33 +298,250 @@ std::unique_ptr<jdb::process> jdb::process::attach(pid_t pid) {
     std::unique_ptr<process> proc(
         new process(pid, /*terminate_on_end=*/false, /*is_attached=*/true));
     proc->wait_on_signal();
+    set_ptrace_options(pid);
+    proc->attach_remaining_threads();
+    for (auto &[tid, thread] : proc->threads_) {
+        proc->counters_.add_thread(tid);
+    }
+
+    return proc;
+}
+
+std::unique_ptr<jdb::process> jdb::process::seize(pid_t pid) {
+    if (pid == 0) {
+        error::send("Invalid PID");
+    }
+    // Unlike PTRACE_ATTACH, this neither stops the process nor sends it a signal, and it sets the
+    // options in the same call
+    if (ptrace(PTRACE_SEIZE, pid, nullptr, ptrace_options) < 0) {
+        error::send_errno("Could not seize");
+    }
+
+    std::unique_ptr<process> proc(
+        new process(pid, /*terminate_on_end=*/false, /*is_attached=*/true));
+    proc->is_seized_ = true;
+    proc->state_ = process_state::running;
+    proc->attach_remaining_threads();
+    for (auto &[tid, thread] : proc->threads_) {
+        proc->counters_.add_thread(tid);
+    }
 
     return proc;
 }
 
+void jdb::process::attach_remaining_threads() {
+    // Threads may be created while we attach to the others, so go over the task list until a pass
+    // finds nothing new. Threads created by the ones already traced show up as clone events, and
+    // can't be attached to a second time.
+    auto task_dir = "/proc/" + std::to_string(pid_) + "/task";
+    bool found_new = true;
+    while (found_new) {
+        found_new = false;
+        std::error_code ec;
+        for (auto &entry : std::filesystem::directory_iterator(task_dir, ec)) {
+            auto tid = static_cast<pid_t>(std::stoi(entry.path().filename().string()));
+            if (threads_.count(tid))
+                continue;
+            // The thread may have exited since the directory was read
+            if (is_seized_) {
+                if (ptrace(PTRACE_SEIZE, tid, nullptr, ptrace_options) < 0)
+                    continue;
+                add_thread(tid);
+                found_new = true;
+                continue;
+            }
+            if (ptrace(PTRACE_ATTACH, tid, nullptr, nullptr) < 0)
+                continue;
+
+            auto &thread = add_thread(tid);
+            auto [_, wait_status] = *reap(tid, true);
+            if (has_ended(wait_status)) {
+                remove_thread(tid);
+                continue;
+            }
+            record_stop(thread, wait_status);
+            set_ptrace_options(tid);
+            found_new = true;
+        }
+    }
+}
+
+jdb::thread_state &jdb::process::add_thread(pid_t tid) {
+    auto &thread = threads_[tid];
+    thread.tid = tid;
+    thread.regs.reset(new registers(*this, tid));
+    thread_owners()[tid] = this;
+    return thread;
+}
+
+void jdb::process::remove_thread(pid_t tid) {
+    auto owner = thread_owners().find(tid);
+    if (owner != thread_owners().end() && owner->second == this) {
+        thread_owners().erase(owner);
+    }
+    threads_.erase(tid);
+    if (current_thread_ == tid && !threads_.empty()) {
+        current_thread_ = threads_.count(pid_) ? pid_ : threads_.begin()->first;
+    }
+}
+
+jdb::thread_state *jdb::process::add_cloned_thread(pid_t parent_tid) {
+    unsigned long tid;
+    if (ptrace(PTRACE_GETEVENTMSG, parent_tid, nullptr, &tid) < 0) {
+        error::send_errno("Could not get the new thread id");
+    }
+
+    // New threads start with a SIGSTOP, which is consumed here rather than reported
+    auto &thread = add_thread(static_cast<pid_t>(tid));
+    auto [_, wait_status] = *reap(thread.tid, true);
+    if (has_ended(wait_status)) {
+        remove_thread(thread.tid);
+        return nullptr;
+    }
+    thread.state = process_state::stopped;
+    copy_debug_registers(thread);
+    return &thread;
+}
+
+void jdb::process::set_current_thread(pid_t tid) {
+    if (!threads_.count(tid)) {
+        error::send("No thread with tid " + std::to_string(tid));
+    }
+    current_thread_ = tid;
+}
+
+jdb::registers &jdb::process::get_registers(std::optional<pid_t> tid) {
+    auto thread = threads_.find(tid.value_or(current_thread_));
+    if (thread == threads_.end()) {
+        error::send("No thread with tid " + std::to_string(tid.value_or(current_thread_)));
+    }
+    return *thread->second.regs;
+}
+
+const jdb::registers &jdb::process::get_registers(std::optional<pid_t> tid) const {
+    return const_cast<process *>(this)->get_registers(tid);
+}
+
 jdb::process::~process() {
+    if (mem_fd_ != -1) {
+        close(mem_fd_);
+    }
     if (pid_ != 0) {
         int status;
         if (is_attached_) {
-            if (state_ == process_state::running) {
-                kill(pid_, SIGSTOP);
-                waitpid(pid_, &status, 0);
+            try {
+                if (state_ == process_state::running) {
+                    stop_running_threads();
+                    state_ = process_state::stopped;
+                }
+                // Pending write-back registers would otherwise be lost on detach, and enabled
+                // sites would leave int3 instructions behind in a process that keeps running
+                if (state_ == process_state::stopped) {
+                    if (!terminate_on_end_) {
+                        std::vector<breakpoint_site *> sites;
+                        breakpoint_sites_.for_each([&](auto &site) { sites.push_back(&site); });
+                        set_breakpoint_sites_enabled(sites, false);
+                        watchpoints_.for_each([](auto &point) { point.disable(); });
+                    }
+                    for (auto &[tid, thread] : threads_) {
+                        thread.regs->flush();
+                    }
+                }
+            } catch (const error &) {
+            }
+            for (auto &[tid, thread] : threads_) {
+                ptrace(PTRACE_DETACH, tid, nullptr,
+                       reinterpret_cast<void *>(static_cast<std::uintptr_t>(thread.pending_signal)));
+            }
+            // Seized threads were stopped with PTRACE_INTERRUPT, which leaves no SIGSTOP behind
+            if (!is_seized_) {
+                kill(pid_, SIGCONT);
             }
-            ptrace(PTRACE_DETACH, pid_, nullptr, nullptr);
-            kill(pid_, SIGCONT);
         }
 
+        for (auto &[tid, thread] : threads_) {
+            auto owner = thread_owners().find(tid);
+            if (owner != thread_owners().end() && owner->second == this) {
+                thread_owners().erase(owner);
+            }
+        }
         if (terminate_on_end_) {
             kill(pid_, SIGKILL);
             waitpid(pid_, &status, 0);
         }
     }
+    for (auto &point : checkpoints_) {
+        kill(point.pid, SIGKILL);
+        waitpid(point.pid, nullptr, __WALL);
+    }
+}
+
+void jdb::process::resume_thread(thread_state &thread, int request) {
+    thread.regs->flush();
+    // Any syscall the thread makes may change the mappings, unless those stop it on their way out
+    if (!mappings_traced_) {
+        memory_map_stale_ = true;
+    }
+    if (thread.in_syscall) {
+        // Single stepping runs the syscall to completion without reporting its exit
+        if (request == PTRACE_SINGLESTEP) {
+            thread.in_syscall = false;
+            memory_map_stale_ = true;
+        } else {
+            request = PTRACE_SYSCALL;
+        }
+    }
+    auto signal = reinterpret_cast<void *>(static_cast<std::uintptr_t>(thread.pending_signal));
+    if (ptrace(static_cast<__ptrace_request>(request), thread.tid, nullptr, signal) < 0) {
+        error::send_errno(request == PTRACE_SINGLESTEP ? "Could not single step"
+                                                       : "Could not resume");
+    }
+    thread.state = process_state::running;
+    thread.reason.reset();
+    thread.pending_signal = 0;
+    thread.report_pending = false;
 }
 
 // Wrapper for PTRACE_CONT
 void jdb::process::resume() {
-    if (ptrace(PTRACE_CONT, pid_, nullptr, nullptr) < 0) {
-        error::send_errno("Could not resume");
+    if (state_ != process_state::stopped) {
+        error::send("Could not resume: process is not stopped");
+    }
+    // Nothing runs until every stop that came in during the last all-stop has been reported
+    if (has_pending_report()) {
+        state_ = process_state::running;
+        return;
+    }
+    // Continuing from an enabled site would execute its int3 again, so the original instruction is
+    // single stepped first. Without any sites, this costs nothing.
+    // Hardware sites need no such care: the kernel sets the resume flag for them.
+    // Only the thread that reported the last stop and the current thread are stepped over. Any
+    // other thread sitting on a site hasn't reported it yet, so it runs into the int3 again and
+    // reports it then.
+    for (auto tid : {reporting_thread_, current_thread_}) {
+        if (breakpoint_sites_.empty())
+            break;
+        auto thread = threads_.find(tid);
+        if (thread == threads_.end() || thread->second.state != process_state::stopped)
+            continue;
+        auto site = breakpoint_sites_.find_by_address(get_pc(tid));
+        if (site && site->is_enabled() && !site->is_hardware()) {
+            step_instruction(tid);
+            if (state_ != process_state::stopped) {
+                return;
+            }
+        }
+    }
+    memory_cache_.invalidate();
+    // Started after stepping over sites, so only what the user asked to run is counted. Counters
+    // left running by an internal stop keep what they counted so far.
+    if (!counters_.running()) {
+        counters_.start();
+    }
+    for (auto &[tid, thread] : threads_) {
+        if (thread.state == process_state::stopped) {
+            resume_thread(thread, PTRACE_CONT);
+        }
     }
     state_ = process_state::running;
 }
@@ -132,58 +559,1230 @@ jdb::stop_reason::stop_reason(int wait_status) {
     }
 }
 
-// Wrapper for waitpid
-jdb::stop_reason jdb::process::wait_on_signal() {
-    int wait_status;
-    int options = 0;
-    if (waitpid(pid_, &wait_status, options) < 0) {
-        error::send_errno("waitpid failed");
+jdb::stop_reason jdb::process::wait_on_signal() { return *poll_stop(std::nullopt); }
+
+std::optional<jdb::stop_reason>
+jdb::process::poll_stop(std::optional<std::chrono::milliseconds> timeout) {
+    // Without a timeout, a plain blocking waitpid is the cheapest way to wait
+    if (!timeout) {
+        while (true) {
+            if (auto reason = take_pending_report()) {
+                return reason;
+            }
+            auto [tid, wait_status] = *reap(-1, true);
+            if (auto reason = handle_thread_status(tid, wait_status)) {
+                return reason;
+            }
+        }
+    }
+
+    if (auto reason = try_wait()) {
+        return reason;
+    }
+    if (timeout->count() <= 0) {
+        return std::nullopt;
+    }
+
+    std::optional<stop_reason> ret;
+    event_loop loop;
+    loop.add(*this, [&ret](process &, stop_reason reason) { ret = reason; });
+    loop.run_once(timeout);
+    return ret;
+}
+
+std::optional<jdb::stop_reason> jdb::process::try_wait() {
+    while (true) {
+        if (auto reason = take_pending_report()) {
+            return reason;
+        }
+        auto status = reap(-1, false);
+        if (!status) {
+            return std::nullopt;
+        }
+        if (auto reason = handle_thread_status(status->first, status->second)) {
+            return reason;
+        }
+    }
+}
+
+std::optional<std::pair<pid_t, int>> jdb::process::reap(pid_t tid, bool block) {
+    auto queued = std::find_if(queued_statuses_.begin(), queued_statuses_.end(),
+                               [tid](auto &status) { return tid == -1 || status.first == tid; });
+    if (queued != queued_statuses_.end()) {
+        auto ret = *queued;
+        queued_statuses_.erase(queued);
+        return ret;
+    }
+    if (tid != -1) {
+        auto unclaimed = unclaimed_statuses().find(tid);
+        if (unclaimed != unclaimed_statuses().end()) {
+            auto ret = *unclaimed;
+            unclaimed_statuses().erase(unclaimed);
+            return ret;
+        }
+    }
+
+    // A single thread is waited on by tid, which leaves the children of everybody else alone.
+    // With more, waitpid(-1) returns whichever thread changed state first in O(1), rather than
+    // polling every thread in turn.
+    if (tid == -1 && threads_.size() == 1) {
+        tid = threads_.begin()->first;
+    }
+    while (true) {
+        int wait_status;
+        auto result = waitpid(tid, &wait_status, __WALL | (block ? 0 : WNOHANG));
+        if (result < 0) {
+            if (errno == EINTR)
+                continue;
+            error::send_errno("waitpid failed");
+        }
+        if (result == 0) {
+            return std::nullopt;
+        }
+        if (threads_.count(result)) {
+            return std::pair{result, wait_status};
+        }
+
+        auto owner = thread_owners().find(result);
+        if (owner != thread_owners().end()) {
+            owner->second->queued_statuses_.emplace_back(result, wait_status);
+        } else if (WIFSTOPPED(wait_status)) {
+            // Only tracees report stops
+            unclaimed_statuses()[result] = wait_status;
+        }
+        // The end of a child nobody traces, which nobody waits for either
+    }
+}
+
+std::optional<jdb::stop_reason> jdb::process::handle_thread_status(pid_t tid, int wait_status) {
+    auto &thread = threads_.at(tid);
+
+    if (has_ended(wait_status)) {
+        if (tid != pid_) {
+            remove_thread(tid);
+            return std::nullopt;
+        }
+        // The main thread is reported last, once every other thread is gone. Its entry is kept so
+        // the process always has a current thread.
+        stop_reason reason(wait_status);
+        reason.tid = tid;
+        for (auto it = threads_.begin(); it != threads_.end();) {
+            auto next = std::next(it);
+            if (it->first != pid_) {
+                remove_thread(it->first);
+            }
+            it = next;
+        }
+        thread_owners().erase(pid_);
+        thread.state = reason.reason;
+        current_thread_ = pid_;
+        state_ = reason.reason;
+        reason.counters = counters_.stop();
+        return reason;
+    }
+
+    if (is_clone_event(wait_status)) {
+        if (auto new_thread = add_cloned_thread(tid)) {
+            resume_thread(*new_thread, PTRACE_CONT);
+        }
+        resume_thread(thread, PTRACE_CONT);
+        return std::nullopt;
+    }
+
+    // Stops jdb asked for only get reported when the user asked for them through interrupt()
+    if (consume_stop_request(thread, wait_status) && !interrupt_requested_) {
+        resume_thread(thread, PTRACE_CONT);
+        return std::nullopt;
+    }
+
+    // All-stop: the first thread to stop stops every other one
+    auto reason = record_stop(thread, wait_status);
+    interrupt_requested_ = false;
+    current_thread_ = tid;
+    reporting_thread_ = tid;
+    state_ = process_state::stopped;
+    stop_running_threads();
+
+    // Hits of the dynamic linker's hook only update the library list. The counters go on, as the
+    // continue they are counting isn't over.
+    if (rendezvous_hook_ && reason.trap_reason == trap_type::software_break &&
+        get_pc(tid) == *rendezvous_hook_) {
+        update_shared_libraries();
+        resume();
+        return std::nullopt;
+    }
+    // Every thread is stopped by now, so nothing counts anymore
+    reason.counters = counters_.stop();
+    return reason;
+}
+
+void jdb::process::record_other_stop(thread_state &thread, int wait_status) {
+    auto requested = consume_stop_request(thread, wait_status);
+    auto reason = record_stop(thread, wait_status);
+    if (requested) {
+        return;
+    }
+    if (reason.trap_reason == trap_type::software_break) {
+        auto site = breakpoint_sites_.find_by_address(get_pc(thread.tid));
+        if (site && site->is_enabled() && !site->is_hardware()) {
+            return;
+        }
+    }
+    thread.report_pending = true;
+}
+
+bool jdb::process::has_pending_report() const {
+    return std::any_of(threads_.begin(), threads_.end(),
+                       [](auto &entry) { return entry.second.report_pending; });
+}
+
+std::optional<jdb::stop_reason> jdb::process::take_pending_report() {
+    auto it = std::find_if(threads_.begin(), threads_.end(),
+                           [](auto &entry) { return entry.second.report_pending; });
+    if (it == threads_.end()) {
+        return std::nullopt;
+    }
+    auto &thread = it->second;
+    thread.report_pending = false;
+    interrupt_requested_ = false;
+    current_thread_ = thread.tid;
+    reporting_thread_ = thread.tid;
+    state_ = process_state::stopped;
+    auto reason = *thread.reason;
+    reason.counters = counters_.stop();
+    return reason;
+}
+
+bool jdb::process::consume_stop_request(thread_state &thread, int wait_status) {
+    if (is_interrupt_stop(wait_status)) {
+        return true;
+    }
+    if (WSTOPSIG(wait_status) == SIGSTOP && thread.pending_sigstop) {
+        thread.pending_sigstop = false;
+        return true;
+    }
+    return false;
+}
+
+void jdb::process::interrupt() {
+    if (state_ != process_state::running) {
+        error::send("Could not interrupt: process is not running");
+    }
+    // The next wait reports a stop anyway
+    if (has_pending_report()) {
+        return;
+    }
+    // Stopping one thread is enough, the all-stop that follows takes care of the others
+    auto thread = threads_.find(current_thread_);
+    if (thread == threads_.end() || thread->second.state != process_state::running) {
+        thread = std::find_if(threads_.begin(), threads_.end(), [](auto &entry) {
+            return entry.second.state == process_state::running;
+        });
+    }
+    if (thread == threads_.end()) {
+        error::send("Could not interrupt: no thread is running");
+    }
+
+    auto tid = thread->first;
+    if (is_seized_) {
+        if (ptrace(PTRACE_INTERRUPT, tid, nullptr, nullptr) < 0) {
+            error::send_errno("Could not interrupt");
+        }
+    } else if (!thread->second.pending_sigstop) {
+        if (tgkill(pid_, tid, SIGSTOP) < 0) {
+            error::send_errno("Could not interrupt");
+        }
+        thread->second.pending_sigstop = true;
+    }
+    interrupt_requested_ = true;
+}
+
+void jdb::process::stop_running_threads() {
+    // All the requests go out before any wait, so the threads stop concurrently and each wait
+    // below is a single blocking waitpid on a thread that is already stopping
+    std::vector<pid_t> signalled;
+    std::vector<pid_t> gone;
+    for (auto &[tid, thread] : threads_) {
+        if (thread.state != process_state::running)
+            continue;
+        // PTRACE_INTERRUPT leaves nothing pending once the thread has stopped for any reason
+        if (is_seized_) {
+            if (ptrace(PTRACE_INTERRUPT, tid, nullptr, nullptr) < 0) {
+                gone.push_back(tid);
+            } else {
+                signalled.push_back(tid);
+            }
+            continue;
+        }
+        // A SIGSTOP that hasn't been reported yet stops the thread just as well. Sending another
+        // one would leave a spare one behind, reported as a stop of its own later on.
+        if (thread.pending_sigstop) {
+            signalled.push_back(tid);
+            continue;
+        }
+        if (tgkill(pid_, tid, SIGSTOP) < 0) {
+            gone.push_back(tid);
+            continue;
+        }
+        thread.pending_sigstop = true;
+        signalled.push_back(tid);
+    }
+    for (auto tid : gone) {
+        remove_thread(tid);
     }
+
+    for (auto tid : signalled) {
+        while (true) {
+            auto it = threads_.find(tid);
+            if (it == threads_.end() || it->second.state != process_state::running)
+                break;
+            auto &thread = it->second;
+
+            auto [_, wait_status] = *reap(tid, true);
+            if (has_ended(wait_status)) {
+                remove_thread(tid);
+            } else if (is_clone_event(wait_status)) {
+                // Both threads stay stopped. The SIGSTOP is still pending for the parent.
+                add_cloned_thread(tid);
+                thread.state = process_state::stopped;
+                thread.regs->invalidate();
+            } else {
+                // A thread that stopped for another reason, like a signal, still has our SIGSTOP
+                // coming
+                record_other_stop(thread, wait_status);
+            }
+        }
+    }
+}
+
+jdb::stop_reason jdb::process::record_stop(thread_state &thread, int wait_status,
+                                           bool single_stepped) {
     stop_reason reason(wait_status);
-    state_ = reason.reason;
+    reason.tid = thread.tid;
+    thread.state = reason.reason;
+    thread.pending_signal = 0;
+
+    // Register groups are fetched on their first access after the stop
+    if (is_attached_ && reason.reason == process_state::stopped) {
+        thread.regs->invalidate();
+        if (is_interrupt_stop(wait_status)) {
+            reason.trap_reason = trap_type::interrupt;
+        } else if (is_seccomp_stop(wait_status) || is_syscall_stop(wait_status)) {
+            // Only traced syscalls stop, at seccomp's say on entry, and then on exit because the
+            // thread was resumed with PTRACE_SYSCALL
+            reason.info = SIGTRAP;
+            reason.trap_reason = trap_type::syscall;
+            reason.syscall_info = read_syscall_information(thread, is_seccomp_stop(wait_status));
+            thread.in_syscall = reason.syscall_info->entry;
+            if (!reason.syscall_info->entry && changes_mappings(reason.syscall_info->id)) {
+                memory_map_stale_ = true;
+            }
+        } else {
+            augment_stop_reason(reason, single_stepped);
+            // Signal-delivery stops carry no event. SIGSTOP is how jdb stops threads, so it isn't
+            // passed on.
+            if ((wait_status >> 16) == 0 && reason.info != SIGTRAP && reason.info != SIGSTOP) {
+                thread.pending_signal = reason.info;
+            }
+        }
+
+        // After executing int3, the PC points to the byte after it. Move it back so the original
+        // instruction is executed when the process resumes.
+        if (reason.trap_reason == trap_type::software_break) {
+            auto instruction_begin = get_pc(thread.tid) - 1;
+            auto site = breakpoint_sites_.find_by_address(instruction_begin);
+            if (site && site->is_enabled() && !site->is_hardware()) {
+                set_pc(instruction_begin, thread.tid);
+            }
+        }
 
-    if (is_attached_ && state_ == process_state::stopped) {
-        read_all_registers();
+        if (reason.trap_reason == trap_type::hardware_break && !watchpoints_.empty()) {
+            auto id = get_current_hardware_stoppoint(thread.tid);
+            if (id.index() == 1) {
+                watchpoints_.get_by_id(std::get<1>(id)).update_data();
+            }
+        }
     }
 
+    thread.reason = reason;
     return reason;
 }
 
-void jdb::process::read_all_registers() {
-    if (ptrace(PTRACE_GETREGS, pid_, nullptr, &get_registers().data_.regs) < 0) {
-        error::send_errno("Could not read GPR registers");
+jdb::syscall_information jdb::process::read_syscall_information(thread_state &thread,
+                                                                bool entry) {
+    auto &regs = *thread.regs;
+    syscall_information info;
+    info.id = static_cast<std::uint16_t>(regs.read_by_id_as<std::uint64_t>(register_id::orig_rax));
+    info.entry = entry;
+    if (entry) {
+        // The syscall ABI passes arguments in these registers, in this order
+        static constexpr register_id arg_registers[] = {register_id::rdi, register_id::rsi,
+                                                        register_id::rdx, register_id::r10,
+                                                        register_id::r8,  register_id::r9};
+        for (std::size_t i = 0; i < info.args.size(); ++i) {
+            info.args[i] = regs.read_by_id_as<std::uint64_t>(arg_registers[i]);
+        }
+    } else {
+        info.ret = static_cast<std::int64_t>(regs.read_by_id_as<std::uint64_t>(register_id::rax));
     }
-    if (ptrace(PTRACE_GETFPREGS, pid_, nullptr, &get_registers().data_.i387) < 0) {
-        error::send_errno("Could not read FPR registers");
+    return info;
+}
+
+void jdb::process::augment_stop_reason(stop_reason &reason, bool single_stepped) {
+    // Only SIGTRAP needs telling apart, which saves a syscall on every other stop
+    if (reason.info != SIGTRAP) {
+        return;
+    }
+    // Without an enabled hardware stoppoint, nothing but the step traps a single stepped thread.
+    // An int3 it runs into ends up where stepping over it would. This saves a syscall per step of
+    // a trace.
+    if (single_stepped && debug_control_ == 0) {
+        reason.trap_reason = trap_type::single_step;
+        return;
+    }
+    // A stoppoint that triggers during a step is reported as TRAP_TRACE, so dr6 tells instead
+    if (single_stepped) {
+        auto status = read_user_area(register_info_by_id(register_id::dr6).offset, reason.tid);
+        // The low 4 bits flag which of dr0-dr3 triggered the trap
+        reason.trap_reason =
+            (status & 0b1111) ? trap_type::hardware_break : trap_type::single_step;
+        return;
     }
-    for (int i = 0; i < 8; ++i) {
-        auto id = static_cast<int>(register_id::dr0) + i;
-        auto info = register_info_by_id(static_cast<register_id>(id));
 
-        errno = 0;
-        std::int64_t data = ptrace(PTRACE_PEEKUSER, pid_, info.offset, nullptr);
-        if (errno != 0) {
-            error::send_errno("Could not read debug register");
+    siginfo_t info;
+    if (ptrace(PTRACE_GETSIGINFO, reason.tid, nullptr, &info) < 0) {
+        error::send_errno("Failed to get signal info");
+    }
+
+    switch (info.si_code) {
+    case TRAP_TRACE:
+    // Single stepping a syscall instruction reports TRAP_BRKPT when the syscall returns. int3 is
+    // reported as SI_KERNEL, so nothing else sends it.
+    case TRAP_BRKPT:
+        reason.trap_reason = trap_type::single_step;
+        break;
+    case SI_KERNEL:
+        reason.trap_reason = trap_type::software_break;
+        break;
+    case TRAP_HWBKPT:
+        reason.trap_reason = trap_type::hardware_break;
+        break;
+    default:
+        reason.trap_reason = trap_type::unknown;
+        break;
+    }
+}
+
+jdb::stop_reason jdb::process::step_instruction(std::optional<pid_t> tid) {
+    auto stepped = tid.value_or(current_thread_);
+    auto thread_it = threads_.find(stepped);
+    if (thread_it == threads_.end()) {
+        error::send("No thread with tid " + std::to_string(stepped));
+    }
+    auto &thread = thread_it->second;
+
+    breakpoint_site *to_reenable = nullptr;
+    if (!breakpoint_sites_.empty()) {
+        // Only rip is read, which is all a trace loop fetches as well
+        auto site = breakpoint_sites_.find_by_address(virt_addr{thread.regs->read_pc()});
+        if (site && site->is_enabled() && !site->is_hardware()) {
+            to_reenable = site;
+            to_reenable->disable();
+        }
+    }
+
+    memory_cache_.invalidate();
+    resume_thread(thread, PTRACE_SINGLESTEP);
+    state_ = process_state::running;
+
+    // Only the stepped thread runs, but any thread may still report its exit: exit_group kills the
+    // stopped ones too
+    std::optional<stop_reason> reason;
+    while (!reason) {
+        auto [reported, wait_status] = *reap(-1, true);
+        if (has_ended(wait_status)) {
+            if (reported == pid_) {
+                reason = handle_thread_status(reported, wait_status);
+                break;
+            }
+            remove_thread(reported);
+            if (reported == stepped) {
+                reason = stop_reason(wait_status);
+                reason->tid = reported;
+                state_ = process_state::stopped;
+            }
+        } else if (reported != stepped) {
+            record_other_stop(threads_.at(reported), wait_status);
+        } else if (is_clone_event(wait_status)) {
+            add_cloned_thread(stepped);
+            resume_thread(thread, PTRACE_SINGLESTEP);
+        } else if (consume_stop_request(thread, wait_status)) {
+            resume_thread(thread, PTRACE_SINGLESTEP);
+        } else {
+            reason = record_stop(thread, wait_status, /*single_stepped=*/true);
+            reporting_thread_ = stepped;
+            state_ = process_state::stopped;
         }
+    }
+
+    if (to_reenable && state_ == process_state::stopped) {
+        to_reenable->enable();
+    }
+    return *reason;
+}
 
-        get_registers().data_.u_debugreg[i] = data;
+jdb::breakpoint_site &jdb::process::create_breakpoint_site(virt_addr address, bool hardware,
+                                                          bool internal) {
+    if (breakpoint_sites_.contains_address(address)) {
+        error::send("Breakpoint site already created at address " +
+                    std::to_string(address.addr()));
     }
+    return breakpoint_sites_.push(
+        std::unique_ptr<breakpoint_site>(new breakpoint_site(*this, address, hardware, internal)));
 }
 
-void jdb::process::write_user_area(std::size_t offset, std::uint64_t data) {
-    if (ptrace(PTRACE_POKEUSER, pid_, offset, data) < 0) {
+void jdb::process::set_breakpoint_sites_enabled(span<breakpoint_site *const> sites, bool enable) {
+    std::vector<breakpoint_site *> pending;
+    for (auto site : sites) {
+        if (site->is_enabled_ == enable)
+            continue;
+
+        // Hardware sites only touch the debug registers, so there is nothing to batch
+        if (site->is_hardware_) {
+            if (enable) {
+                site->hardware_register_index_ = set_hardware_breakpoint(site->address_);
+            } else {
+                clear_hardware_stoppoint(site->hardware_register_index_);
+                site->hardware_register_index_ = -1;
+            }
+            site->is_enabled_ = enable;
+            continue;
+        }
+        pending.push_back(site);
+    }
+    std::sort(pending.begin(), pending.end(),
+              [](auto lhs, auto rhs) { return lhs->address_ < rhs->address_; });
+
+    std::vector<std::byte> buffer;
+    auto first = pending.begin();
+    while (first != pending.end()) {
+        // Every site on the same page is patched by one read and one write of the bytes between
+        // the first and the last of them
+        auto page = (*first)->address_.addr() / page_size;
+        auto last = std::find_if(first, pending.end(), [page](auto site) {
+            return site->address_.addr() / page_size != page;
+        });
+
+        auto low = (*first)->address_;
+        auto high = (*(last - 1))->address_ + 1;
+        buffer.resize(high.addr() - low.addr());
+        if (read_memory_into(low, buffer) != buffer.size()) {
+            error::send("Could not read memory at breakpoint site");
+        }
+
+        for (auto it = first; it != last; ++it) {
+            auto &byte = buffer[(*it)->address_.addr() - low.addr()];
+            if (enable) {
+                (*it)->saved_data_ = byte;
+                byte = std::byte{0xcc};
+            } else {
+                byte = (*it)->saved_data_;
+            }
+        }
+
+        write_memory(low, buffer);
+        for (auto it = first; it != last; ++it) {
+            (*it)->is_enabled_ = enable;
+        }
+        first = last;
+    }
+}
+
+void jdb::process::read_gprs(user_regs_struct &gprs, std::optional<pid_t> tid) const {
+    if (ptrace(PTRACE_GETREGS, tid.value_or(current_thread_), nullptr, &gprs) < 0) {
+        error::send_errno("Could not read GPR registers");
+    }
+}
+
+void jdb::process::read_fprs(user_fpregs_struct &fprs, std::optional<pid_t> tid) const {
+    if (ptrace(PTRACE_GETFPREGS, tid.value_or(current_thread_), nullptr, &fprs) < 0) {
+        error::send_errno("Could not read FPR registers");
+    }
+}
+
+std::uint64_t jdb::process::read_user_area(std::size_t offset, std::optional<pid_t> tid) const {
+    // PTRACE_PEEKUSER returns the data itself, so errors can only be told apart through errno
+    errno = 0;
+    std::int64_t data = ptrace(PTRACE_PEEKUSER, tid.value_or(current_thread_), offset, nullptr);
+    if (errno != 0) {
+        error::send_errno("Could not read user area");
+    }
+    return data;
+}
+
+void jdb::process::write_user_area(std::size_t offset, std::uint64_t data,
+                                   std::optional<pid_t> tid) {
+    if (ptrace(PTRACE_POKEUSER, tid.value_or(current_thread_), offset, data) < 0) {
         error::send_errno("Could not write to user area");
     }
 }
 
-void jdb::process::write_fprs(const user_fpregs_struct &fprs) {
-    if (ptrace(PTRACE_SETFPREGS, pid_, nullptr, &fprs) < 0) {
+void jdb::process::write_fprs(const user_fpregs_struct &fprs, std::optional<pid_t> tid) {
+    if (ptrace(PTRACE_SETFPREGS, tid.value_or(current_thread_), nullptr, &fprs) < 0) {
         error::send_errno("Could not write floating point registers");
     }
 }
 
-void jdb::process::write_gprs(const user_regs_struct &gprs) {
-    if (ptrace(PTRACE_SETREGS, pid_, nullptr, &gprs) < 0) {
+void jdb::process::write_gprs(const user_regs_struct &gprs, std::optional<pid_t> tid) {
+    if (ptrace(PTRACE_SETREGS, tid.value_or(current_thread_), nullptr, &gprs) < 0) {
         error::send_errno("Could not write general purpose registers");
     }
 }
+
+int jdb::process::mem_fd() const {
+    if (mem_fd_ == -1) {
+        auto path = "/proc/" + std::to_string(pid_) + "/mem";
+        mem_fd_ = open(path.c_str(), O_RDWR | O_CLOEXEC);
+    }
+    return mem_fd_;
+}
+
+std::unordered_map<std::uint64_t, std::uint64_t> jdb::process::get_auxv() const {
+    auto path = "/proc/" + std::to_string(pid_) + "/auxv";
+    auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error::send_errno("Could not open auxiliary vector");
+    }
+    std::unordered_map<std::uint64_t, std::uint64_t> ret;
+    // (type, value) pairs, up to AT_NULL
+    std::uint64_t entry[2];
+    while (read(fd, entry, sizeof(entry)) == sizeof(entry) && entry[0] != AT_NULL) {
+        ret[entry[0]] = entry[1];
+    }
+    close(fd);
+    return ret;
+}
+
+const jdb::elf &jdb::process::get_elf() const {
+    if (!elf_) {
+        auto exe = std::filesystem::read_symlink("/proc/" + std::to_string(pid_) + "/exe");
+        elf_ = std::make_unique<elf>(exe);
+        auto auxv = get_auxv();
+        if (auxv.count(AT_ENTRY)) {
+            elf_->set_load_bias(auxv[AT_ENTRY] - elf_->header().e_entry);
+        }
+    }
+    return *elf_;
+}
+
+const jdb::memory_map &jdb::process::get_memory_map() const {
+    if (memory_map_stale_) {
+        memory_map_.load(pid_);
+        memory_map_stale_ = false;
+    }
+    return memory_map_;
+}
+
+const jdb::elf *jdb::process::elf_containing_address(virt_addr address) const {
+    if (get_elf().contains_address(address))
+        return &get_elf();
+    for (auto &library : libraries_) {
+        if (library.file && library.file->contains_address(address))
+            return library.file.get();
+    }
+    return nullptr;
+}
+
+std::optional<jdb::elf_symbol> jdb::process::symbol_containing_address(virt_addr address) const {
+    auto file = elf_containing_address(address);
+    return file ? file->symbol_containing_address(address) : std::nullopt;
+}
+
+std::optional<jdb::line_entry> jdb::process::line_entry_at_address(virt_addr address) const {
+    auto file = elf_containing_address(address);
+    return file ? file->get_dwarf().line_entry_at_address(address) : std::nullopt;
+}
+
+std::vector<jdb::virt_addr> jdb::process::backtrace(std::optional<pid_t> tid) {
+    if (state_ != process_state::stopped) {
+        error::send("Could not unwind: process is not stopped");
+    }
+    return unwinder_.backtrace(tid.value_or(current_thread_));
+}
+
+void jdb::process::track_shared_libraries() {
+    if (rendezvous_hook_)
+        return;
+    if (state_ != process_state::stopped) {
+        error::send("Could not track shared libraries: process is not stopped");
+    }
+    // The dynamic linker is loaded at AT_BASE, which is 0 for static executables
+    auto auxv = get_auxv();
+    auto interpreter = get_elf().interpreter();
+    if (!auxv[AT_BASE] || interpreter.empty())
+        return;
+    elf linker{std::filesystem::path(interpreter)};
+    linker.set_load_bias(auxv[AT_BASE]);
+    auto debug = linker.symbols_by_name("_r_debug");
+    if (debug.empty()) {
+        error::send("Could not find the dynamic linker's r_debug");
+    }
+    rendezvous_address_ = debug.front().address;
+
+    // r_brk is only set once the linker has initialized. Before that, as right after exec, the
+    // hook is found by name.
+    auto rendezvous = read_memory_as<r_debug>(*rendezvous_address_);
+    if (rendezvous.r_brk) {
+        rendezvous_hook_ = virt_addr{rendezvous.r_brk};
+    } else {
+        auto hook = linker.symbols_by_name("_dl_debug_state");
+        if (hook.empty()) {
+            error::send("Could not find the dynamic linker's debug hook");
+        }
+        rendezvous_hook_ = hook.front().address;
+    }
+    create_breakpoint_site(*rendezvous_hook_, false, true).enable();
+    update_shared_libraries();
+}
+
+void jdb::process::update_shared_libraries() {
+    auto rendezvous = read_memory_as<r_debug>(*rendezvous_address_);
+    // The hook is called once before a change, and once after. Only the latter has a list worth
+    // reading.
+    if (rendezvous.r_state != r_debug::RT_CONSISTENT)
+        return;
+
+    std::vector<shared_library> libraries;
+    for (auto entry = rendezvous.r_map; entry; ) {
+        auto map = read_memory_as<link_map>(virt_addr{reinterpret_cast<std::uint64_t>(entry)});
+        auto address = virt_addr{reinterpret_cast<std::uint64_t>(entry)};
+        entry = map.l_next;
+
+        // The executable comes first, with an empty name
+        auto name_bytes = read_memory(virt_addr{reinterpret_cast<std::uint64_t>(map.l_name)},
+                                      PATH_MAX);
+        auto name = reinterpret_cast<const char *>(name_bytes.data());
+        auto name_end = std::find(name, name + name_bytes.size(), '\0');
+        if (name == name_end)
+            continue;
+        std::string path(name, name_end);
+
+        // After a dlclose, another library can get the same entry address, and even be loaded at
+        // the same place
+        auto known = std::find_if(libraries_.begin(), libraries_.end(), [&](auto &library) {
+            return library.link_map == address && library.path == path &&
+                   (!library.file ||
+                    library.file->load_bias() == static_cast<std::int64_t>(map.l_addr));
+        });
+        if (known != libraries_.end()) {
+            libraries.push_back(std::move(*known));
+            libraries_.erase(known);
+            continue;
+        }
+
+        shared_library library{std::move(path), address, nullptr};
+        try {
+            library.file = std::make_unique<elf>(library.path);
+            library.file->set_load_bias(map.l_addr);
+        } catch (const error &) {
+        }
+        libraries.push_back(std::move(library));
+    }
+    libraries_ = std::move(libraries);
+    memory_map_stale_ = true;
+    // Cached rules point into the files, and PCs without CFI may now be covered by a new one
+    unwinder_.clear_cache();
+}
+
+std::vector<std::byte> jdb::process::read_memory(virt_addr address, std::size_t amount) const {
+    std::vector<std::byte> ret(amount);
+    ret.resize(read_memory_into(address, ret));
+    return ret;
+}
+
+std::size_t jdb::process::read_memory_into(virt_addr address, span<std::byte> buffer) const {
+    // Memory can change under our feet while the inferior runs, so the cache is only used while it
+    // is stopped
+    if (!is_attached_ || state_ != process_state::stopped ||
+        buffer.size() > page_cache::max_cached_read || buffer.empty()) {
+        return read_memory_uncached_into(address, buffer);
+    }
+
+    auto first_page = address.addr() / page_size;
+    auto last_page = (address.addr() + buffer.size() - 1) / page_size;
+    auto n_pages = last_page - first_page + 1;
+
+    // Copies the part of page i that the read covers to its place in buffer
+    auto copy_page = [&](std::size_t i, const std::byte *page) {
+        auto page_start = (first_page + i) * page_size;
+        auto from = std::max(page_start, address.addr());
+        auto to = std::min(page_start + page_size, address.addr() + buffer.size());
+        std::copy(page + (from - page_start), page + (to - page_start),
+                  buffer.begin() + (from - address.addr()));
+    };
+
+    // Hits are copied out right away, since allocating slots for the misses may evict them
+    bool cached[page_cache::capacity];
+    std::uint64_t missing[page_cache::capacity];
+    std::size_t n_missing = 0;
+    for (std::size_t i = 0; i < n_pages; ++i) {
+        auto page = memory_cache_.lookup(first_page + i);
+        cached[i] = page != nullptr;
+        if (page) {
+            copy_page(i, page);
+        } else {
+            missing[n_missing++] = first_page + i;
+        }
+    }
+
+    // All the missing pages are fetched with a single vectored read, straight into their cache
+    // slots. Only pages that fail there are retried one at a time.
+    iovec local_iovecs[page_cache::capacity];
+    iovec remote_iovecs[page_cache::capacity];
+    for (std::size_t i = 0; i < n_missing; ++i) {
+        local_iovecs[i] = {memory_cache_.allocate(missing[i]), page_size};
+        remote_iovecs[i] = {reinterpret_cast<void *>(missing[i] * page_size), page_size};
+    }
+
+    bool unreadable[page_cache::capacity] = {};
+    std::size_t fetched = 0;
+    while (fetched < n_missing) {
+        auto count = n_missing - fetched;
+        auto result = process_vm_readv(pid_, local_iovecs + fetched, count, remote_iovecs + fetched,
+                                       count, 0);
+        if (result < 0 && errno != EFAULT) {
+            error::send_errno("Could not read process memory");
+        }
+        if (result > 0) {
+            fetched += result / page_size;
+        }
+        if (fetched == n_missing) {
+            break;
+        }
+
+        // Mappings are page aligned, so a page is either readable as a whole or not at all
+        auto page = missing[fetched];
+        auto slot = static_cast<std::byte *>(local_iovecs[fetched].iov_base);
+        if (read_memory_uncached_into(virt_addr{page * page_size}, {slot, page_size}) !=
+            page_size) {
+            memory_cache_.discard(page);
+            unreadable[fetched] = true;
+        }
+        ++fetched;
+    }
+
+    // The read ends at the first unreadable page
+    std::size_t next_missing = 0;
+    std::size_t total = 0;
+    for (std::size_t i = 0; i < n_pages; ++i) {
+        if (!cached[i]) {
+            if (unreadable[next_missing]) {
+                break;
+            }
+            copy_page(i, static_cast<const std::byte *>(local_iovecs[next_missing].iov_base));
+            ++next_missing;
+        }
+        auto page_start = (first_page + i) * page_size;
+        total = std::min(page_start + page_size, address.addr() + buffer.size()) - address.addr();
+    }
+
+    return total;
+}
+
+std::size_t jdb::process::read_memory_uncached_into(virt_addr address,
+                                                    span<std::byte> buffer) const {
+    iovec remote_iovecs[max_iovecs];
+    std::size_t total = 0;
+
+    while (total < buffer.size()) {
+        auto remote_address = address.addr() + total;
+        std::size_t requested;
+        auto count =
+            split_at_pages(remote_address, buffer.size() - total, remote_iovecs, requested);
+        iovec local_iovec{buffer.begin() + total, requested};
+
+        auto result = process_vm_readv(pid_, &local_iovec, 1, remote_iovecs, count, 0);
+        if (result < 0 && errno != EFAULT) {
+            error::send_errno("Could not read process memory");
+        }
+        if (result > 0) {
+            total += result;
+        }
+        if (result == static_cast<ssize_t>(requested)) {
+            continue;
+        }
+
+        // process_vm_readv honours page protections, but /proc/<pid>/mem can read pages that
+        // aren't readable by the inferior itself. If that fails as well, the page isn't mapped.
+        remote_address = address.addr() + total;
+        auto chunk_size = bytes_to_page_end(remote_address, buffer.size() - total);
+        auto fd = mem_fd();
+        if (fd == -1) {
+            break;
+        }
+        auto fallback = pread(fd, buffer.begin() + total, chunk_size, remote_address);
+        if (fallback <= 0) {
+            break;
+        }
+        total += fallback;
+    }
+
+    return total;
+}
+
+std::vector<std::byte> jdb::process::read_memory_without_traps(virt_addr address,
+                                                               std::size_t amount) const {
+    auto memory = read_memory(address, amount);
+    remove_traps(address, {memory.data(), memory.size()});
+    return memory;
+}
+
+void jdb::process::remove_traps(virt_addr address, span<std::byte> memory) const {
+    auto sites = breakpoint_sites_.get_in_region(address, address + memory.size());
+    for (auto site : sites) {
+        // Hardware sites leave the code as it is
+        if (!site->is_enabled() || site->is_hardware())
+            continue;
+        memory[site->address().addr() - address.addr()] = site->saved_data_;
+    }
+}
+
+void jdb::process::write_memory(virt_addr address, span<const std::byte> data) {
+    if (!data.empty()) {
+        memory_cache_.invalidate(address.addr() / page_size,
+                                 (address.addr() + data.size() - 1) / page_size);
+    }
+
+    iovec remote_iovecs[max_iovecs];
+    std::size_t written = 0;
+
+    while (written < data.size()) {
+        auto remote_address = address.addr() + written;
+        std::size_t requested;
+        auto count = split_at_pages(remote_address, data.size() - written, remote_iovecs, requested);
+        iovec local_iovec{const_cast<std::byte *>(data.begin() + written), requested};
+
+        auto result = process_vm_writev(pid_, &local_iovec, 1, remote_iovecs, count, 0);
+        if (result < 0 && errno != EFAULT) {
+            error::send_errno("Could not write process memory");
+        }
+        if (result > 0) {
+            written += result;
+        }
+        if (result == static_cast<ssize_t>(requested)) {
+            continue;
+        }
+
+        // Read-only pages, like the ones holding code, can only be written through
+        // /proc/<pid>/mem, which writes to a private copy of the page
+        remote_address = address.addr() + written;
+        auto chunk_size = bytes_to_page_end(remote_address, data.size() - written);
+        auto fd = mem_fd();
+        if (fd == -1) {
+            error::send_errno("Could not open process memory");
+        }
+        auto fallback = pwrite(fd, data.begin() + written, chunk_size, remote_address);
+        if (fallback <= 0) {
+            error::send_errno("Could not write process memory");
+        }
+        written += fallback;
+    }
+}
+
+jdb::watchpoint &jdb::process::create_watchpoint(virt_addr address, stoppoint_mode mode,
+                                                 std::size_t size) {
+    if (watchpoints_.contains_address(address)) {
+        error::send("Watchpoint already created at address " + std::to_string(address.addr()));
+    }
+    return watchpoints_.push(
+        std::unique_ptr<watchpoint>(new watchpoint(*this, address, mode, size)));
+}
+
+namespace {
+// Values of the R/W bits of dr7 for each mode
+std::uint64_t encode_hardware_stoppoint_mode(jdb::stoppoint_mode mode) {
+    switch (mode) {
+    case jdb::stoppoint_mode::write:
+        return 0b01;
+    case jdb::stoppoint_mode::read_write:
+        return 0b11;
+    case jdb::stoppoint_mode::execute:
+        return 0b00;
+    default:
+        jdb::error::send("Invalid stoppoint mode");
+    }
+}
+
+// Values of the LEN bits of dr7 for each size. Note that 8 bytes is 0b10, not 0b11.
+std::uint64_t encode_hardware_stoppoint_size(std::size_t size) {
+    switch (size) {
+    case 1:
+        return 0b00;
+    case 2:
+        return 0b01;
+    case 4:
+        return 0b11;
+    case 8:
+        return 0b10;
+    default:
+        jdb::error::send("Invalid stoppoint size");
+    }
+}
+
+jdb::register_id debug_address_register(int index) {
+    return static_cast<jdb::register_id>(static_cast<int>(jdb::register_id::dr0) + index);
+}
+} // namespace
+
+int jdb::process::set_hardware_breakpoint(virt_addr address) {
+    return set_hardware_stoppoint(address, stoppoint_mode::execute, 1);
+}
+
+int jdb::process::set_watchpoint(virt_addr address, stoppoint_mode mode, std::size_t size) {
+    return set_hardware_stoppoint(address, mode, size);
+}
+
+int jdb::process::set_hardware_stoppoint(virt_addr address, stoppoint_mode mode,
+                                         std::size_t size) {
+    // The lowest free slot, straight from the allocation bitmask
+    int free_space = -1;
+    for (int i = 0; i < 4; ++i) {
+        if (!(hardware_slots_in_use_ & (1 << i))) {
+            free_space = i;
+            break;
+        }
+    }
+    if (free_space == -1) {
+        error::send("No remaining hardware debug registers");
+    }
+
+    // Each slot has a local enable bit at 2 * index, and a 4 bit field at 16 + 4 * index holding
+    // the mode (R/W, low 2 bits) and the size (LEN, high 2 bits)
+    std::uint64_t enable_bit = 1 << (free_space * 2);
+    std::uint64_t mode_bits = encode_hardware_stoppoint_mode(mode) << (free_space * 4 + 16);
+    std::uint64_t size_bits = encode_hardware_stoppoint_size(size) << (free_space * 4 + 18);
+    std::uint64_t clear_mask = (std::uint64_t{0b11} << (free_space * 2)) |
+                               (std::uint64_t{0b1111} << (free_space * 4 + 16));
+
+    auto masked = debug_control_ & ~clear_mask;
+    masked |= enable_bit | mode_bits | size_bits;
+
+    // Debug registers are per thread, so every thread gets the stoppoint. The address has to be in
+    // place before dr7 enables it.
+    for (auto &[tid, thread] : threads_) {
+        thread.regs->write_by_id(debug_address_register(free_space), address.addr());
+        thread.regs->write_by_id(register_id::dr7, masked);
+    }
+
+    debug_addresses_[free_space] = address.addr();
+    debug_control_ = masked;
+    hardware_slots_in_use_ |= 1 << free_space;
+    return free_space;
+}
+
+void jdb::process::clear_hardware_stoppoint(int index) {
+    std::uint64_t clear_mask = (std::uint64_t{0b11} << (index * 2)) |
+                               (std::uint64_t{0b1111} << (index * 4 + 16));
+    debug_control_ &= ~clear_mask;
+    debug_addresses_[index] = 0;
+
+    for (auto &[tid, thread] : threads_) {
+        thread.regs->write_by_id(register_id::dr7, debug_control_);
+        thread.regs->write_by_id(debug_address_register(index), std::uint64_t{0});
+    }
+
+    hardware_slots_in_use_ &= ~(1 << index);
+}
+
+void jdb::process::copy_debug_registers(thread_state &thread) {
+    if (!hardware_slots_in_use_)
+        return;
+    for (int i = 0; i < 4; ++i) {
+        if (hardware_slots_in_use_ & (1 << i)) {
+            thread.regs->write_by_id(debug_address_register(i), debug_addresses_[i]);
+        }
+    }
+    thread.regs->write_by_id(register_id::dr7, debug_control_);
+}
+
+std::variant<jdb::breakpoint_site::id_type, jdb::watchpoint::id_type>
+jdb::process::get_current_hardware_stoppoint(std::optional<pid_t> tid) const {
+    auto &regs = get_registers(tid);
+    auto status = regs.read_by_id_as<std::uint64_t>(register_id::dr6);
+    // The low 4 bits of dr6 flag which of dr0-dr3 triggered the trap
+    if ((status & 0b1111) == 0) {
+        error::send("No hardware stoppoint was hit");
+    }
+    auto index = __builtin_ctzll(status & 0b1111);
+
+    using ret = std::variant<breakpoint_site::id_type, watchpoint::id_type>;
+    auto address = virt_addr{regs.read_by_id_as<std::uint64_t>(debug_address_register(index))};
+
+    auto point = watchpoints_.find_by_address(address);
+    if (point && point->hardware_register_index_ == index) {
+        return ret{std::in_place_index<1>, point->id()};
+    }
+    auto site = breakpoint_sites_.find_by_address(address);
+    if (site && site->hardware_register_index_ == index) {
+        return ret{std::in_place_index<0>, site->id()};
+    }
+    error::send("Hit hardware stoppoint is unknown");
+}
+
+pid_t jdb::process::inject_fork(pid_t tid) {
+    auto thread = threads_.find(tid);
+    // Pending register writes are part of the state being copied
+    if (thread != threads_.end()) {
+        thread->second.regs->flush();
+    }
+    auto wait = [&] { return thread != threads_.end() ? reap(tid, true)->second
+                                                      : wait_for_untracked(tid); };
+
+    user_regs_struct saved;
+    read_gprs(saved, tid);
+    const std::byte syscall_instruction[] = {std::byte{0x0f}, std::byte{0x05}};
+    std::byte original[2];
+    poke_bytes(tid, saved.rip, syscall_instruction, 2, original);
+    auto regs = saved;
+    regs.rax = SYS_fork;
+    write_gprs(regs, tid);
+    // With TRACEFORK, the child is traced and stopped before its first instruction, so it can be
+    // put back before it runs
+    if (ptrace(PTRACE_SETOPTIONS, tid, nullptr, ptrace_options | PTRACE_O_TRACEFORK) < 0) {
+        error::send_errno("Failed to set ptrace options");
+    }
+
+    pid_t child = 0;
+    while (true) {
+        if (ptrace(PTRACE_SINGLESTEP, tid, nullptr, nullptr) < 0) {
+            error::send_errno("Could not single step");
+        }
+        auto wait_status = wait();
+        if (has_ended(wait_status)) {
+            error::send("Process ended while forking");
+        }
+        if (is_fork_event(wait_status)) {
+            unsigned long message;
+            ptrace(PTRACE_GETEVENTMSG, tid, nullptr, &message);
+            child = static_cast<pid_t>(message);
+            continue;
+        }
+        // The trap of the step itself, as opposed to another event stop
+        if (WSTOPSIG(wait_status) == SIGTRAP && (wait_status >> 16) == 0) {
+            break;
+        }
+        // Any signal that came in meanwhile, like the SIGCHLD a checkpoint gets when one of its
+        // forks is killed, is dropped. A pending stop request is consumed.
+        if (thread != threads_.end()) {
+            consume_stop_request(thread->second, wait_status);
+        }
+    }
+
+    ptrace(PTRACE_SETOPTIONS, tid, nullptr, ptrace_options);
+    poke_bytes(tid, saved.rip, original, 2);
+    write_gprs(saved, tid);
+    if (thread != threads_.end()) {
+        thread->second.regs->invalidate();
+    }
+    if (child == 0) {
+        error::send("Could not fork the process");
+    }
+
+    // The child has the syscall instruction in its copy of memory, and sits right after it
+    if (has_ended(wait_for_untracked(child))) {
+        error::send("Fork ended before it started");
+    }
+    poke_bytes(child, saved.rip, original, 2);
+    write_gprs(saved, child);
+    return child;
+}
+
+std::size_t jdb::process::create_checkpoint() {
+    if (state_ != process_state::stopped) {
+        error::send("Could not create checkpoint: process is not stopped");
+    }
+    checkpoint point;
+    point.pc = get_pc();
+    breakpoint_sites_.for_each([&](auto &site) {
+        if (site.is_enabled() && !site.is_hardware()) {
+            point.site_bytes.emplace_back(site.address(), site.saved_data_);
+        }
+    });
+    point.pid = inject_fork(current_thread_);
+    checkpoints_.push_back(std::move(point));
+    return checkpoints_.size() - 1;
+}
+
+void jdb::process::restart(std::size_t index) {
+    if (index >= checkpoints_.size()) {
+        error::send("No checkpoint " + std::to_string(index));
+    }
+    if (state_ == process_state::running) {
+        error::send("Could not restart: process is running");
+    }
+    auto &point = checkpoints_[index];
+    auto new_pid = inject_fork(point.pid);
+
+    // The old process is killed and reaped, its threads first: the main thread is only reported
+    // once the others are gone
+    if (state_ == process_state::stopped) {
+        kill(pid_, SIGKILL);
+        std::vector<pid_t> tids;
+        for (auto &[tid, thread] : threads_) {
+            if (tid != pid_)
+                tids.push_back(tid);
+        }
+        tids.push_back(pid_);
+        for (auto tid : tids) {
+            while (!has_ended(reap(tid, true)->second)) {
+            }
+        }
+    }
+    for (auto &[tid, thread] : threads_) {
+        auto owner = thread_owners().find(tid);
+        if (owner != thread_owners().end() && owner->second == this) {
+            thread_owners().erase(owner);
+        }
+    }
+    threads_.clear();
+    queued_statuses_.clear();
+
+    // Everything cached about the old process goes, and the fork takes its place
+    pid_ = new_pid;
+    if (mem_fd_ != -1) {
+        close(mem_fd_);
+        mem_fd_ = -1;
+    }
+    memory_cache_.invalidate();
+    memory_map_stale_ = true;
+    auto &thread = add_thread(new_pid);
+    thread.state = process_state::stopped;
+    current_thread_ = new_pid;
+    reporting_thread_ = new_pid;
+    state_ = process_state::stopped;
+    interrupt_requested_ = false;
+    // The fork is ours to clean up, whether or not the original process was
+    terminate_on_end_ = true;
+    copy_debug_registers(thread);
+    counters_.clear();
+    counters_.add_thread(new_pid);
+
+    // Memory is as it was at the checkpoint, int3s included. Those are undone, then the sites
+    // enabled now are placed.
+    for (auto &[address, byte] : point.site_bytes) {
+        write_memory(address, {&byte, 1});
+    }
+    std::vector<breakpoint_site *> enabled;
+    breakpoint_sites_.for_each([&](auto &site) {
+        if (site.is_enabled() && !site.is_hardware()) {
+            site.is_enabled_ = false;
+            enabled.push_back(&site);
+        }
+    });
+    set_breakpoint_sites_enabled(enabled, true);
+    watchpoints_.for_each([](auto &point) { point.update_data(); });
+    // The fork has the libraries of the checkpoint. The linker's hook was placed with the sites.
+    if (rendezvous_address_) {
+        update_shared_libraries();
+    }
+}
@@ -0,0 +1,289 @@
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <filesystem>
+#include <libjdb/bit.hpp>
+#include <libjdb/error.hpp>
+#include <libjdb/perf.hpp>
+#include <libjdb/process.hpp>
+#include <libjdb/profiler.hpp>
+#include <poll.h>
+#include <string>
+#include <sys/mman.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+
+jdb::sampling_profiler::sampling_profiler(process &proc, std::size_t max_depth,
+                                          std::size_t stack_bytes)
+    : process_(&proc), max_depth_(max_depth), stack_buffer_(stack_bytes) {
+    frames_.reserve(max_depth);
+}
+
+bool jdb::sampling_profiler::sample() {
+    while (true) {
+        process_->interrupt();
+        auto reason = process_->wait_on_signal();
+        if (reason.reason != process_state::stopped) {
+            return false;
+        }
+        // Seized processes report the interrupt as such, the others the SIGSTOP it sent
+        if (reason.trap_reason == trap_type::interrupt ||
+            (reason.info == SIGSTOP && !reason.trap_reason)) {
+            break;
+        }
+        // The process stopped on its own first, like for a signal. That isn't a sample: resuming
+        // passes the signal on, and the interrupt is asked for again.
+        process_->resume();
+    }
+
+    // The interrupt stopped every thread, so they are all sampled at the same point in time
+    for (auto &[tid, thread] : process_->thread_states()) {
+        if (thread.state == process_state::stopped) {
+            sample_thread(tid);
+        }
+    }
+    process_->resume();
+    return true;
+}
+
+void jdb::sampling_profiler::sample_thread(pid_t tid) {
+    // Comes from the PTRACE_GETREGS the unwinder needs anyway
+    auto sp = process_->get_registers(tid).read_by_id_as<std::uint64_t>(register_id::rsp);
+
+    // A single read covers the part of the stack the walk is likely to visit. It is shorter when
+    // the stack ends before stack_bytes.
+    auto read = process_->read_memory_into(virt_addr{sp}, stack_buffer_);
+    process_->get_unwinder().unwind(tid, frames_, max_depth_, {stack_buffer_.data(), read}, sp);
+
+    stacks_.add(frames_);
+}
+
+std::size_t jdb::sampling_profiler::run(double hz, std::chrono::nanoseconds duration) {
+    using clock = std::chrono::steady_clock;
+    auto period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1 / hz));
+    auto start = clock::now();
+    auto end = start + duration;
+
+    std::size_t samples = 0;
+    // Ticks are scheduled from the previous tick rather than from the end of the previous sample,
+    // so the time spent sampling doesn't make the rate drift. Ticks missed because a sample took
+    // longer than the period are skipped rather than made up for with a burst.
+    auto next = start;
+    while (next < end) {
+        std::this_thread::sleep_until(next);
+        if (!sample()) {
+            break;
+        }
+        ++samples;
+        next = std::max(next + period, clock::now());
+    }
+    return samples;
+}
+
+namespace {
+// Samples below this are context markers, like PERF_CONTEXT_USER, rather than addresses
+constexpr std::uint64_t first_callchain_context = PERF_CONTEXT_MAX;
+
+std::size_t system_page_size() { return static_cast<std::size_t>(sysconf(_SC_PAGESIZE)); }
+} // namespace
+
+jdb::perf_profiler::perf_profiler(pid_t pid, double hz, std::size_t ring_pages)
+    : pid_(pid), hz_(hz), ring_pages_(ring_pages) {
+    if (ring_pages == 0 || (ring_pages & (ring_pages - 1)) != 0) {
+        error::send("Ring buffer size must be a power of two");
+    }
+    open_threads();
+    if (rings_.empty()) {
+        error::send("Could not find any thread of process " + std::to_string(pid));
+    }
+}
+
+jdb::perf_profiler::~perf_profiler() {
+    for (auto &buffer : rings_) {
+        close_ring(buffer);
+    }
+}
+
+std::size_t jdb::perf_profiler::open_threads() {
+    auto task_dir = "/proc/" + std::to_string(pid_) + "/task";
+    std::error_code ec;
+    std::vector<pid_t> live;
+    for (auto &entry : std::filesystem::directory_iterator(task_dir, ec)) {
+        auto tid = static_cast<pid_t>(std::stoi(entry.path().filename().string()));
+        live.push_back(tid);
+        auto known = std::any_of(rings_.begin(), rings_.end(),
+                                 [tid](auto &buffer) { return buffer.tid == tid; });
+        if (!known) {
+            open_thread(tid);
+        }
+    }
+    // Once the whole process is gone, its rings are kept until the end
+    if (ec || live.empty()) {
+        return 0;
+    }
+
+    // The rings of threads that exited are read one last time, and give their fd and locked
+    // memory back
+    std::size_t samples = 0;
+    auto exited = std::stable_partition(rings_.begin(), rings_.end(), [&](auto &buffer) {
+        return std::find(live.begin(), live.end(), buffer.tid) != live.end();
+    });
+    for (auto it = exited; it != rings_.end(); ++it) {
+        samples += drain(*it);
+        close_ring(*it);
+    }
+    rings_.erase(exited, rings_.end());
+    return samples;
+}
+
+void jdb::perf_profiler::close_ring(ring &buffer) {
+    munmap(buffer.base, (ring_pages_ + 1) * system_page_size());
+    close(buffer.fd);
+}
+
+bool jdb::perf_profiler::open_thread(pid_t tid) {
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.freq = 1;
+    attr.sample_freq = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(hz_));
+    attr.sample_type = PERF_SAMPLE_IP | PERF_SAMPLE_TID | PERF_SAMPLE_CALLCHAIN;
+    // Only user space is sampled, which is also all an unprivileged user may sample
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.exclude_callchain_kernel = 1;
+    // Wake poll up once a quarter of the buffer is used, rather than on every sample
+    attr.watermark = 1;
+    attr.wakeup_watermark = ring_pages_ * system_page_size() / 4;
+
+    int fd;
+    while (true) {
+        if (event_ == event::cycles) {
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        } else {
+            attr.type = PERF_TYPE_SOFTWARE;
+            attr.config = PERF_COUNT_SW_CPU_CLOCK;
+        }
+        fd = perf_event_open(attr, tid);
+        // These are what the kernel answers when there is no PMU, or it doesn't count cycles
+        if (fd < 0 && event_ == event::cycles &&
+            (errno == ENOENT || errno == ENODEV || errno == EOPNOTSUPP)) {
+            event_ = event::cpu_clock;
+            continue;
+        }
+        break;
+    }
+    if (fd < 0) {
+        // The thread exited since it was listed
+        if (errno == ESRCH) {
+            return false;
+        }
+        error::send_errno("Could not open perf event");
+    }
+
+    auto base = mmap(nullptr, (ring_pages_ + 1) * system_page_size(), PROT_READ | PROT_WRITE,
+                     MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        error::send_errno("Could not map perf ring buffer");
+    }
+    rings_.push_back({tid, fd, base});
+    return true;
+}
+
+std::size_t jdb::perf_profiler::drain() {
+    std::size_t samples = 0;
+    for (auto &buffer : rings_) {
+        samples += drain(buffer);
+    }
+    return samples;
+}
+
+std::size_t jdb::perf_profiler::drain(ring &buffer) {
+    auto meta = static_cast<perf_event_mmap_page *>(buffer.base);
+    auto data = static_cast<std::byte *>(buffer.base) + system_page_size();
+    auto data_size = ring_pages_ * system_page_size();
+
+    // The kernel publishes data_head after writing the records, and reuses space once data_tail
+    // moves past it
+    auto head = __atomic_load_n(&meta->data_head, __ATOMIC_ACQUIRE);
+    auto tail = meta->data_tail;
+
+    std::size_t samples = 0;
+    while (tail < head) {
+        auto offset = tail % data_size;
+        // Records are 8 byte aligned, so at least the header is always contiguous
+        auto header = reinterpret_cast<const perf_event_header *>(data + offset);
+        const std::byte *record = data + offset;
+        if (offset + header->size > data_size) {
+            record_.resize(header->size);
+            auto first_part = data_size - offset;
+            std::copy(data + offset, data + data_size, record_.begin());
+            std::copy(data, data + (header->size - first_part), record_.begin() + first_part);
+            record = record_.data();
+        }
+
+        auto body = record + sizeof(perf_event_header);
+        if (header->type == PERF_RECORD_SAMPLE) {
+            // Laid out in sample_type bit order: ip, then pid and tid, then the callchain
+            auto ip = from_bytes<std::uint64_t>(body);
+            auto n_frames = from_bytes<std::uint64_t>(body + 16);
+            frames_.clear();
+            for (std::uint64_t i = 0; i < n_frames; ++i) {
+                auto frame = from_bytes<std::uint64_t>(body + 24 + i * 8);
+                if (frame < first_callchain_context) {
+                    frames_.push_back(frame);
+                }
+            }
+            if (frames_.empty()) {
+                frames_.push_back(ip);
+            }
+            stacks_.add(frames_);
+            ++samples;
+        } else if (header->type == PERF_RECORD_LOST) {
+            // An id, then the number of records lost
+            lost_ += from_bytes<std::uint64_t>(body + 8);
+        }
+        tail += header->size;
+    }
+
+    __atomic_store_n(&meta->data_tail, tail, __ATOMIC_RELEASE);
+    return samples;
+}
+
+std::size_t jdb::perf_profiler::run(std::chrono::nanoseconds duration) {
+    using clock = std::chrono::steady_clock;
+    auto end = clock::now() + duration;
+    // Short enough that new threads are picked up quickly, long enough to cost nothing
+    constexpr auto rescan_period = std::chrono::milliseconds(100);
+
+    std::size_t samples = 0;
+    std::vector<pollfd> fds;
+    while (true) {
+        auto remaining = std::chrono::ceil<std::chrono::milliseconds>(end - clock::now());
+        if (remaining.count() <= 0) {
+            break;
+        }
+
+        fds.clear();
+        for (auto &buffer : rings_) {
+            fds.push_back({buffer.fd, POLLIN, 0});
+        }
+        auto timeout = std::min<std::chrono::milliseconds>(remaining, rescan_period);
+        if (poll(fds.data(), fds.size(), static_cast<int>(timeout.count())) < 0 && errno != EINTR) {
+            error::send_errno("poll failed");
+        }
+        samples += drain();
+
+        // Events of exited threads hang up. Once they all have, the process is gone.
+        auto all_exited = std::all_of(fds.begin(), fds.end(),
+                                      [](auto &fd) { return (fd.revents & POLLHUP) != 0; });
+        if (all_exited) {
+            break;
+        }
+        samples += open_threads();
+    }
+
+    return samples + drain();
+}
@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <cstddef>
 #include <cstdint>
 #include <iostream>
 #include <libjdb/bit.hpp>
@@ -37,7 +38,55 @@ template <class T> jdb::byte128 widen(const jdb::register_info &info, T t) {
 }
 } // namespace
 
+void jdb::registers::invalidate() {
+    gprs_loaded_ = false;
+    fprs_loaded_ = false;
+    drs_loaded_ = false;
+    pc_loaded_ = false;
+    gprs_dirty_ = false;
+    fprs_dirty_ = false;
+    drs_dirty_ = 0;
+}
+
+void jdb::registers::ensure_loaded(register_type type) const {
+    switch (type) {
+    case register_type::gpr:
+    case register_type::sub_gpr:
+        if (!gprs_loaded_) {
+            proc_->read_gprs(data_.regs, tid_);
+            gprs_loaded_ = true;
+        }
+        break;
+    case register_type::fpr:
+        if (!fprs_loaded_) {
+            proc_->read_fprs(data_.i387, tid_);
+            fprs_loaded_ = true;
+        }
+        break;
+    case register_type::dr:
+        if (!drs_loaded_) {
+            // There is no PTRACE_GETDBGREGS on x64, so the debug registers are peeked one by one
+            for (int i = 0; i < 8; ++i) {
+                auto id = static_cast<int>(register_id::dr0) + i;
+                auto &info = register_info_by_id(static_cast<register_id>(id));
+                data_.u_debugreg[i] = proc_->read_user_area(info.offset, tid_);
+            }
+            drs_loaded_ = true;
+        }
+        break;
+    }
+}
+
+std::uint64_t jdb::registers::read_pc() const {
+    if (!gprs_loaded_ && !pc_loaded_) {
+        data_.regs.rip = proc_->read_user_area(register_info_by_id(register_id::rip).offset, tid_);
+        pc_loaded_ = true;
+    }
+    return data_.regs.rip;
+}
+
 jdb::registers::value jdb::registers::read(const register_info &info) const {
+    ensure_loaded(info.type);
     // Pointer to the raw bytes of the register data
     auto bytes = as_bytes(data_);
     if (info.format == register_format::uint) {
@@ -69,6 +118,9 @@ jdb::registers::value jdb::registers::read(const register_info &info) const {
 }
 
 void jdb::registers::write(const register_info &info, value val) {
+    // The whole group is written back (or an aligned 8 byte word of it), so the bytes around the
+    // register being written must be up to date first
+    ensure_loaded(info.type);
     auto bytes = as_bytes(data_);
     std::visit(
         [&](auto v) {
@@ -83,10 +135,48 @@ void jdb::registers::write(const register_info &info, value val) {
         },
         val);
 
+    if (write_mode_ == register_write_mode::write_back) {
+        if (info.type == register_type::fpr) {
+            fprs_dirty_ = true;
+        } else if (info.type == register_type::dr) {
+            auto index = (info.offset - offsetof(user, u_debugreg)) / 8;
+            drs_dirty_ |= 1 << index;
+        } else {
+            gprs_dirty_ = true;
+        }
+        return;
+    }
+
     if (info.type == register_type::fpr) {
-        proc_->write_fprs(data_.i387);
+        proc_->write_fprs(data_.i387, tid_);
     } else {
         auto aligned_offset = info.offset & ~0b111;
-        proc_->write_user_area(aligned_offset, from_bytes<std::uint64_t>(bytes + aligned_offset));
+        proc_->write_user_area(aligned_offset, from_bytes<std::uint64_t>(bytes + aligned_offset),
+                              tid_);
+    }
+}
+
+void jdb::registers::set_write_mode(register_write_mode mode) {
+    if (mode == register_write_mode::write_through) {
+        flush();
+    }
+    write_mode_ = mode;
+}
+
+void jdb::registers::flush() {
+    if (gprs_dirty_) {
+        proc_->write_gprs(data_.regs, tid_);
+        gprs_dirty_ = false;
+    }
+    if (fprs_dirty_) {
+        proc_->write_fprs(data_.i387, tid_);
+        fprs_dirty_ = false;
+    }
+    // Written in index order so that the address registers are set before dr7 enables them
+    for (int i = 0; i < 8; ++i) {
+        if (drs_dirty_ & (1 << i)) {
+            proc_->write_user_area(offsetof(user, u_debugreg) + i * 8, data_.u_debugreg[i], tid_);
+        }
     }
+    drs_dirty_ = 0;
 }
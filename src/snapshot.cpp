@@ -0,0 +1,310 @@
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <libjdb/error.hpp>
+#include <libjdb/process.hpp>
+#include <libjdb/snapshot.hpp>
+#include <sstream>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+constexpr std::size_t page_size = jdb::page_store::page_size;
+// Pages a worker reads with a single process_vm_readv. Large enough to amortize the syscall, small
+// enough that the work spreads evenly among workers.
+constexpr std::size_t pages_per_job = 256;
+// Below this, starting threads costs more than the copy
+constexpr std::size_t min_pages_per_worker = 1024;
+constexpr std::uint64_t pagemap_soft_dirty = std::uint64_t(1) << 55;
+} // namespace
+
+std::uint64_t jdb::page_store::hash(const std::byte *page) {
+    // Four independent lanes, so the multiplications overlap. Collisions are resolved by intern.
+    std::uint64_t lanes[4] = {0x9e3779b97f4a7c15, 0xbf58476d1ce4e5b9, 0x94d049bb133111eb,
+                              0x2545f4914f6cdd1d};
+    for (std::size_t offset = 0; offset < page_size; offset += 32) {
+        for (int i = 0; i < 4; ++i) {
+            std::uint64_t word;
+            std::memcpy(&word, page + offset + i * 8, sizeof(word));
+            lanes[i] = (lanes[i] ^ word) * 0xff51afd7ed558ccd;
+            lanes[i] ^= lanes[i] >> 29;
+        }
+    }
+    auto h = lanes[0] ^ (lanes[1] << 1) ^ (lanes[2] << 2) ^ (lanes[3] << 3);
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53;
+    h ^= h >> 33;
+    return h;
+}
+
+jdb::page_store::id_type jdb::page_store::intern(const std::byte *page, std::uint64_t hash) {
+    // The top bits pick the shard, the others the bucket in its map
+    auto shard_index = hash >> (64 - shard_bits);
+    auto &shard = shards_[shard_index];
+    std::lock_guard lock(shard.mutex);
+    auto [first, last] = shard.by_hash.equal_range(hash);
+    for (auto it = first; it != last; ++it) {
+        if (std::memcmp(this->page(it->second), page, page_size) == 0) {
+            return it->second;
+        }
+    }
+
+    auto local = shard.count++;
+    if (local % pages_per_chunk == 0) {
+        shard.chunks.push_back(std::make_unique<std::byte[]>(pages_per_chunk * page_size));
+    }
+    std::memcpy(shard.chunks.back().get() + (local % pages_per_chunk) * page_size, page, page_size);
+    auto id = static_cast<id_type>(local << shard_bits | shard_index);
+    shard.by_hash.emplace(hash, id);
+    ++count_;
+    return id;
+}
+
+const std::byte *jdb::page_store::page(id_type id) const {
+    auto &shard = shards_[id & (shard_count - 1)];
+    auto local = id >> shard_bits;
+    return shard.chunks[local / pages_per_chunk].get() + (local % pages_per_chunk) * page_size;
+}
+
+jdb::snapshot_store::snapshot_store(process &proc, std::size_t workers) : process_(&proc) {
+    if (workers == 0) {
+        workers = std::clamp<std::size_t>(std::thread::hardware_concurrency(), 1, 8);
+    }
+    workers_ = workers;
+
+    // Kernels with soft-dirty support flag mappings that were never cleared with "sd". Without the
+    // flag, pagemap would report every page as clean, so every page has to be copied instead.
+    soft_dirty_ = false;
+    std::ifstream smaps("/proc/" + std::to_string(proc.pid()) + "/smaps");
+    std::string line;
+    while (std::getline(smaps, line)) {
+        if (line.rfind("VmFlags:", 0) == 0 && (line + ' ').find(" sd ") != std::string::npos) {
+            soft_dirty_ = true;
+            break;
+        }
+    }
+}
+
+std::vector<jdb::snapshot_region> jdb::snapshot_store::read_regions() const {
+    std::ifstream maps("/proc/" + std::to_string(process_->pid()) + "/maps");
+    if (!maps) {
+        error::send("Could not read memory map");
+    }
+    std::vector<snapshot_region> regions;
+    std::string line;
+    while (std::getline(maps, line)) {
+        std::istringstream fields(line);
+        std::string range, perms, offset, device, inode, name;
+        fields >> range >> perms >> offset >> device >> inode;
+        std::getline(fields >> std::ws, name);
+        // Only memory the process can change is worth saving. [vvar] and friends belong to the
+        // kernel.
+        if (perms.size() < 2 || perms[0] != 'r' || perms[1] != 'w' ||
+            name.rfind("[v", 0) == 0)
+            continue;
+
+        auto dash = range.find('-');
+        auto start = std::stoull(range.substr(0, dash), nullptr, 16);
+        auto end = std::stoull(range.substr(dash + 1), nullptr, 16);
+        regions.push_back({virt_addr{start}, virt_addr{end}, name, {}});
+    }
+    return regions;
+}
+
+void jdb::snapshot_store::read_dirty_pages(const snapshot_region &region,
+                                           std::vector<bool> &dirty) const {
+    auto n_pages = (region.end.addr() - region.start.addr()) / page_size;
+    dirty.assign(n_pages, true);
+
+    auto path = "/proc/" + std::to_string(process_->pid()) + "/pagemap";
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    // One 64 bit entry per page, indexed by page number
+    std::vector<std::uint64_t> entries(n_pages);
+    auto size = n_pages * sizeof(std::uint64_t);
+    auto offset = static_cast<off_t>(region.start.addr() / page_size * sizeof(std::uint64_t));
+    if (pread(fd, entries.data(), size, offset) == static_cast<ssize_t>(size)) {
+        for (std::size_t i = 0; i < n_pages; ++i) {
+            dirty[i] = (entries[i] & pagemap_soft_dirty) != 0;
+        }
+    }
+    close(fd);
+}
+
+void jdb::snapshot_store::clear_dirty_pages() const {
+    auto path = "/proc/" + std::to_string(process_->pid()) + "/clear_refs";
+    int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error::send_errno("Could not open clear_refs");
+    }
+    // 4 clears the soft-dirty bits of every page, and nothing else
+    auto written = write(fd, "4", 1);
+    close(fd);
+    if (written != 1) {
+        error::send_errno("Could not clear soft-dirty bits");
+    }
+}
+
+void jdb::snapshot_store::run_jobs(const std::vector<copy_job> &jobs,
+                                   std::atomic<std::size_t> &next) {
+    std::vector<std::byte> buffer(pages_per_job * page_size);
+    while (true) {
+        auto index = next.fetch_add(1);
+        if (index >= jobs.size())
+            break;
+        auto &job = jobs[index];
+
+        // A run reads until its first unreadable page, which is skipped before reading the rest
+        std::size_t done = 0;
+        while (done < job.n_pages) {
+            iovec local{buffer.data() + done * page_size, (job.n_pages - done) * page_size};
+            iovec remote{reinterpret_cast<void *>(job.address + done * page_size), local.iov_len};
+            auto result = process_vm_readv(process_->pid(), &local, 1, &remote, 1, 0);
+            auto n_read = result > 0 ? static_cast<std::size_t>(result) / page_size : 0;
+            for (std::size_t i = done; i < done + n_read; ++i) {
+                auto page = buffer.data() + i * page_size;
+                job.out[i] = pages_.intern(page, page_store::hash(page));
+            }
+            done += n_read;
+            if (done < job.n_pages) {
+                job.out[done++] = page_store::no_page;
+            }
+        }
+    }
+}
+
+void jdb::snapshot_store::copy_pages(const std::vector<copy_job> &jobs) {
+    std::size_t total_pages = 0;
+    for (auto &job : jobs) {
+        total_pages += job.n_pages;
+    }
+    auto n_threads = std::min(workers_, total_pages / min_pages_per_worker);
+
+    std::atomic<std::size_t> next = 0;
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < n_threads; ++i) {
+        threads.emplace_back([&] { run_jobs(jobs, next); });
+    }
+    // The calling thread is a worker too
+    run_jobs(jobs, next);
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+std::size_t jdb::snapshot_store::save() {
+    if (process_->state() != process_state::stopped) {
+        error::send("Snapshots need a stopped process");
+    }
+
+    snapshot current;
+    current.regions = read_regions();
+    const snapshot *previous = snapshots_.empty() ? nullptr : &snapshots_.back();
+
+    // Pages of the previous snapshot are reused where they are known to be clean. Everything else,
+    // pages that couldn't be read last time included, becomes a copy job, with runs of consecutive
+    // pages read together.
+    std::vector<copy_job> jobs;
+    std::vector<bool> dirty;
+    std::size_t previous_index = 0;
+    for (auto &region : current.regions) {
+        auto n_pages = (region.end.addr() - region.start.addr()) / page_size;
+        region.pages.assign(n_pages, page_store::no_page);
+
+        // Clean pages keep their id from the previous snapshot, found by address, so regions that
+        // grew, shrank or were split since then share their unchanged pages too
+        if (previous && soft_dirty_) {
+            read_dirty_pages(region, dirty);
+            // Both region lists are in address order, so the previous one is walked once
+            auto &previous_regions = previous->regions;
+            while (previous_index < previous_regions.size() &&
+                   previous_regions[previous_index].end <= region.start) {
+                ++previous_index;
+            }
+            for (auto j = previous_index;
+                 j < previous_regions.size() && previous_regions[j].start < region.end; ++j) {
+                auto &old = previous_regions[j];
+                auto low = std::max(old.start, region.start).addr();
+                auto high = std::min(old.end, region.end).addr();
+                for (auto address = low; address < high; address += page_size) {
+                    auto i = (address - region.start.addr()) / page_size;
+                    if (!dirty[i]) {
+                        region.pages[i] = old.pages[(address - old.start.addr()) / page_size];
+                    }
+                }
+            }
+        }
+
+        for (std::size_t i = 0; i < n_pages;) {
+            if (region.pages[i] != page_store::no_page) {
+                ++i;
+                continue;
+            }
+            auto run_start = i;
+            while (i < n_pages && region.pages[i] == page_store::no_page &&
+                   i - run_start < pages_per_job) {
+                ++i;
+            }
+            jobs.push_back({region.start.addr() + run_start * page_size, i - run_start,
+                            region.pages.data() + run_start});
+            current.pages_copied += i - run_start;
+        }
+    }
+
+    copy_pages(jobs);
+    if (soft_dirty_) {
+        clear_dirty_pages();
+    }
+    snapshots_.push_back(std::move(current));
+    return snapshots_.size() - 1;
+}
+
+std::vector<jdb::snapshot_change> jdb::snapshot_store::diff(std::size_t from,
+                                                            std::size_t to) const {
+    // Flattens a snapshot into (page address, page id) pairs, which are in address order since the
+    // regions are
+    auto flatten = [](const snapshot &snap) {
+        std::vector<std::pair<std::uint64_t, page_store::id_type>> pages;
+        for (auto &region : snap.regions) {
+            for (std::size_t i = 0; i < region.pages.size(); ++i) {
+                pages.emplace_back(region.start.addr() + i * page_size, region.pages[i]);
+            }
+        }
+        return pages;
+    };
+    auto old_pages = flatten(get(from));
+    auto new_pages = flatten(get(to));
+
+    std::vector<snapshot_change> changes;
+    auto record = [&](snapshot_change::kind type, std::uint64_t address) {
+        if (!changes.empty() && changes.back().type == type &&
+            changes.back().start.addr() + changes.back().size == address) {
+            changes.back().size += page_size;
+        } else {
+            changes.push_back({type, virt_addr{address}, page_size});
+        }
+    };
+
+    // Equal content means equal ids, so comparing ids compares pages
+    auto old_it = old_pages.begin();
+    auto new_it = new_pages.begin();
+    while (old_it != old_pages.end() || new_it != new_pages.end()) {
+        if (new_it == new_pages.end() ||
+            (old_it != old_pages.end() && old_it->first < new_it->first)) {
+            record(snapshot_change::kind::removed, old_it++->first);
+        } else if (old_it == old_pages.end() || new_it->first < old_it->first) {
+            record(snapshot_change::kind::added, new_it++->first);
+        } else {
+            if (old_it->second != new_it->second) {
+                record(snapshot_change::kind::modified, new_it->first);
+            }
+            ++old_it;
+            ++new_it;
+        }
+    }
+    return changes;
+}
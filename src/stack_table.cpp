@@ -0,0 +1,92 @@
+#include <algorithm>
+#include <cstdio>
+#include <libjdb/error.hpp>
+#include <libjdb/stack_table.hpp>
+
+std::uint64_t jdb::stack_table::hash_frames(span<const std::uint64_t> frames) {
+    // FNV-1a over whole words, with a murmur finalizer since the low bits of code addresses are
+    // far from random
+    std::uint64_t hash = 0xcbf29ce484222325;
+    for (auto frame : frames) {
+        hash ^= frame;
+        hash *= 0x100000001b3;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccd;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+jdb::stack_table::id_type jdb::stack_table::add(span<const std::uint64_t> frames,
+                                                std::uint64_t count) {
+    total_samples_ += count;
+    if ((stacks_.size() + 1) * 2 > slots_.size()) {
+        grow();
+    }
+
+    auto hash = hash_frames(frames);
+    auto mask = slots_.size() - 1;
+    for (auto slot = hash & mask;; slot = (slot + 1) & mask) {
+        if (slots_[slot] == 0) {
+            if (frames_.size() + frames.size() > UINT32_MAX) {
+                error::send("Stack table is full");
+            }
+            auto id = static_cast<id_type>(stacks_.size());
+            stacks_.push_back({hash, count, static_cast<std::uint32_t>(frames_.size()),
+                               static_cast<std::uint32_t>(frames.size())});
+            frames_.insert(frames_.end(), frames.begin(), frames.end());
+            slots_[slot] = id + 1;
+            return id;
+        }
+
+        auto id = slots_[slot] - 1;
+        auto &stack = stacks_[id];
+        if (stack.hash == hash && stack.depth == frames.size() &&
+            std::equal(frames.begin(), frames.end(), frames_.begin() + stack.offset)) {
+            stack.count += count;
+            return id;
+        }
+    }
+}
+
+void jdb::stack_table::grow() {
+    std::vector<id_type> slots(std::max<std::size_t>(slots_.size() * 2, 64), 0);
+    auto mask = slots.size() - 1;
+    for (id_type id = 0; id < stacks_.size(); ++id) {
+        auto slot = stacks_[id].hash & mask;
+        while (slots[slot] != 0) {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = id + 1;
+    }
+    slots_ = std::move(slots);
+}
+
+void jdb::stack_table::clear() {
+    frames_.clear();
+    stacks_.clear();
+    slots_.clear();
+    total_samples_ = 0;
+}
+
+void jdb::stack_table::write_folded(
+    std::ostream &out, const std::function<std::string(virt_addr)> &name_frame) const {
+    for (id_type id = 0; id < stacks_.size(); ++id) {
+        auto stack = frames(id);
+        for (auto it = stack.end(); it != stack.begin();) {
+            --it;
+            if (name_frame) {
+                out << name_frame(virt_addr{*it});
+            } else {
+                char address[19];
+                std::snprintf(address, sizeof(address), "%#llx",
+                              static_cast<unsigned long long>(*it));
+                out << address;
+            }
+            if (it != stack.begin()) {
+                out << ';';
+            }
+        }
+        out << ' ' << stacks_[id].count << '\n';
+    }
+}
@@ -0,0 +1,100 @@
+#include <libjdb/process.hpp>
+#include <libjdb/register_info.hpp>
+#include <libjdb/stepping.hpp>
+
+namespace {
+bool is_single_step(const jdb::stop_reason &reason) {
+    return reason.reason == jdb::process_state::stopped &&
+           reason.trap_reason == jdb::trap_type::single_step;
+}
+
+std::uint64_t read_sp(jdb::process &proc) {
+    return proc.get_registers().read_by_id_as<std::uint64_t>(jdb::register_id::rsp);
+}
+
+// After a single step from previous_pc, tells where the call it executed returns to, or nullopt if
+// it wasn't a call. A call pushes the address of the next instruction, at most 15 bytes after it.
+std::optional<jdb::virt_addr> return_address_of_call(jdb::process &proc, std::uint64_t previous_pc,
+                                                     std::uint64_t previous_sp) {
+    auto sp = read_sp(proc);
+    if (sp != previous_sp - 8)
+        return std::nullopt;
+    auto ret = proc.read_memory_as<std::uint64_t>(jdb::virt_addr{sp});
+    if (ret <= previous_pc || ret > previous_pc + 15)
+        return std::nullopt;
+    return jdb::virt_addr{ret};
+}
+
+// Runs the process until the call made with the stack pointer at frame_sp returns to address.
+// Returns nullopt once it did, or the reason of any other stop. Recursive calls hitting the return
+// address deeper in the stack are run through.
+std::optional<jdb::stop_reason> run_until_return(jdb::process &proc, jdb::virt_addr address,
+                                                 std::uint64_t frame_sp) {
+    auto site = proc.breakpoint_sites().find_by_address(address);
+    auto created = !site;
+    auto was_enabled = site && site->is_enabled();
+    if (created) {
+        site = &proc.create_breakpoint_site(address, false, true);
+    }
+    site->enable();
+
+    std::optional<jdb::stop_reason> ret;
+    while (true) {
+        proc.resume();
+        auto reason = proc.wait_on_signal();
+        if (reason.reason != jdb::process_state::stopped || proc.get_pc() != address) {
+            ret = reason;
+            break;
+        }
+        if (read_sp(proc) == frame_sp)
+            break;
+    }
+
+    // The process may be gone, along with its breakpoint sites
+    if (proc.state() == jdb::process_state::stopped) {
+        if (created) {
+            proc.breakpoint_sites().remove_by_address(address);
+        } else if (!was_enabled) {
+            site->disable();
+        }
+    }
+    return ret;
+}
+
+jdb::stop_reason step_line(jdb::process &proc, bool over) {
+    auto start = proc.line_entry_at_address(proc.get_pc());
+    if (!start)
+        return proc.step_instruction();
+
+    while (true) {
+        auto previous_pc = proc.get_pc().addr();
+        auto previous_sp = read_sp(proc);
+        auto reason = proc.step_instruction();
+        if (!is_single_step(reason))
+            return reason;
+
+        auto pc = proc.get_pc();
+        auto entry = proc.line_entry_at_address(pc);
+        if (over || !entry) {
+            if (auto ret = return_address_of_call(proc, previous_pc, previous_sp)) {
+                if (auto other = run_until_return(proc, *ret, previous_sp))
+                    return *other;
+                pc = *ret;
+                entry = proc.line_entry_at_address(pc);
+            }
+        }
+        // Anything else reaching code without line information, like main returning, leaves the
+        // code that can be stepped through
+        if (!entry)
+            return reason;
+        // Returns land in the middle of a line, which is stepped through as well
+        if (entry->address == pc && entry->is_stmt &&
+            (entry->line != start->line || entry->file != start->file))
+            return reason;
+    }
+}
+} // namespace
+
+jdb::stop_reason jdb::step_in(process &proc) { return step_line(proc, false); }
+
+jdb::stop_reason jdb::step_over(process &proc) { return step_line(proc, true); }
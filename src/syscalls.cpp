@@ -0,0 +1,41 @@
+#include <algorithm>
+#include <iterator>
+#include <libjdb/error.hpp>
+#include <libjdb/syscalls.hpp>
+#include <string>
+
+namespace {
+struct syscall_entry {
+    std::string_view name;
+    int id;
+};
+
+constexpr syscall_entry syscall_table[] = {
+#define DEFINE_SYSCALL(name, id) {#name, id},
+#include <libjdb/detail/syscalls.inc>
+#undef DEFINE_SYSCALL
+};
+} // namespace
+
+std::string_view jdb::syscall_id_to_name(int id) {
+    // Numbers are dense, so the table is indexed by them
+    if (id >= 0 && static_cast<std::size_t>(id) < std::size(syscall_table) &&
+        syscall_table[id].id == id) {
+        return syscall_table[id].name;
+    }
+    auto it = std::find_if(std::begin(syscall_table), std::end(syscall_table),
+                           [id](auto &entry) { return entry.id == id; });
+    if (it == std::end(syscall_table)) {
+        error::send("No such syscall: " + std::to_string(id));
+    }
+    return it->name;
+}
+
+int jdb::syscall_name_to_id(std::string_view name) {
+    auto it = std::find_if(std::begin(syscall_table), std::end(syscall_table),
+                           [name](auto &entry) { return entry.name == name; });
+    if (it == std::end(syscall_table)) {
+        error::send("No such syscall: " + std::string(name));
+    }
+    return it->id;
+}
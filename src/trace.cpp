@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <libjdb/error.hpp>
+#include <libjdb/process.hpp>
+#include <libjdb/trace.hpp>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+// A 64 bit delta takes at most 10 varint bytes
+constexpr std::size_t max_varint_size = 10;
+} // namespace
+
+jdb::trace_writer::trace_writer(const std::filesystem::path &path, std::size_t block_count,
+                                std::size_t block_size) {
+    if (block_count == 0 || block_size < sizeof(detail::trace_block_header) + max_varint_size) {
+        error::send("Trace blocks are too small");
+    }
+    fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        error::send_errno("Could not create trace file");
+    }
+    map_size_ = sizeof(detail::trace_file_header) + block_count * block_size;
+    if (ftruncate(fd_, map_size_) < 0) {
+        close(fd_);
+        error::send_errno("Could not size trace file");
+    }
+    auto map = mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (map == MAP_FAILED) {
+        close(fd_);
+        error::send_errno("Could not map trace file");
+    }
+    map_ = static_cast<std::byte *>(map);
+
+    // The file was just truncated, so everything else is already zero
+    header_ = reinterpret_cast<detail::trace_file_header *>(map_);
+    std::memcpy(header_->magic, detail::trace_magic, sizeof(header_->magic));
+    header_->version = detail::trace_version;
+    header_->block_size = static_cast<std::uint32_t>(block_size);
+    header_->block_count = block_count;
+}
+
+jdb::trace_writer::~trace_writer() {
+    munmap(map_, map_size_);
+    close(fd_);
+}
+
+void jdb::trace_writer::sync() {
+    if (msync(map_, map_size_, MS_SYNC) < 0) {
+        error::send_errno("Could not write trace file");
+    }
+}
+
+void jdb::trace_writer::start_block(std::uint64_t pc) {
+    auto index = header_->blocks_written % header_->block_count;
+    auto base = map_ + sizeof(detail::trace_file_header) + index * header_->block_size;
+    block_ = reinterpret_cast<detail::trace_block_header *>(base);
+    block_->used = 0;
+    block_->keyframe = pc;
+    block_->record_count = 1;
+    ++header_->blocks_written;
+}
+
+void jdb::trace_writer::append(std::uint64_t pc) {
+    auto capacity = header_->block_size - sizeof(detail::trace_block_header);
+    if (!block_ || capacity - block_->used < max_varint_size) {
+        start_block(pc);
+    } else {
+        auto delta = static_cast<std::int64_t>(pc - last_pc_);
+        auto encoded = (static_cast<std::uint64_t>(delta) << 1) ^
+                       static_cast<std::uint64_t>(delta >> 63);
+        auto out = reinterpret_cast<std::uint8_t *>(block_ + 1) + block_->used;
+        auto start = out;
+        while (encoded >= 0x80) {
+            *out++ = static_cast<std::uint8_t>(encoded) | 0x80;
+            encoded >>= 7;
+        }
+        *out++ = static_cast<std::uint8_t>(encoded);
+        block_->used += static_cast<std::uint32_t>(out - start);
+        ++block_->record_count;
+    }
+    last_pc_ = pc;
+    ++header_->records_written;
+}
+
+jdb::trace_reader::trace_reader(const std::filesystem::path &path) {
+    fd_ = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) {
+        error::send_errno("Could not open trace file");
+    }
+    struct stat info;
+    if (fstat(fd_, &info) < 0) {
+        close(fd_);
+        error::send_errno("Could not stat trace file");
+    }
+    map_size_ = static_cast<std::size_t>(info.st_size);
+    if (map_size_ < sizeof(detail::trace_file_header)) {
+        close(fd_);
+        error::send("Not a trace file");
+    }
+    auto map = mmap(nullptr, map_size_, PROT_READ, MAP_SHARED, fd_, 0);
+    if (map == MAP_FAILED) {
+        close(fd_);
+        error::send_errno("Could not map trace file");
+    }
+    map_ = static_cast<const std::byte *>(map);
+    header_ = reinterpret_cast<const detail::trace_file_header *>(map_);
+
+    auto valid = std::memcmp(header_->magic, detail::trace_magic, sizeof(header_->magic)) == 0 &&
+                 header_->version == detail::trace_version &&
+                 header_->block_size > sizeof(detail::trace_block_header) &&
+                 header_->block_count > 0 &&
+                 map_size_ >= sizeof(detail::trace_file_header) +
+                                  header_->block_count * header_->block_size;
+    if (!valid) {
+        munmap(map, map_size_);
+        close(fd_);
+        error::send("Not a trace file, or one of another version");
+    }
+}
+
+jdb::trace_reader::~trace_reader() {
+    munmap(const_cast<std::byte *>(map_), map_size_);
+    close(fd_);
+}
+
+std::uint64_t jdb::trace_reader::size() const {
+    if (header_->blocks_written <= header_->block_count) {
+        return header_->records_written;
+    }
+    std::uint64_t count = 0;
+    for (std::uint64_t i = 0; i < header_->block_count; ++i) {
+        auto base = map_ + sizeof(detail::trace_file_header) + i * header_->block_size;
+        count += reinterpret_cast<const detail::trace_block_header *>(base)->record_count;
+    }
+    return count;
+}
+
+std::optional<jdb::stop_reason> jdb::trace_instructions(process &proc, trace_writer &out,
+                                                        std::uint64_t max_steps,
+                                                        std::optional<virt_addr> until) {
+    std::optional<stop_reason> reason;
+    for (std::uint64_t step = 0; step < max_steps; ++step) {
+        // The PC is all a trace needs, so the rest of the registers are never fetched
+        auto pc = proc.get_registers().read_pc();
+        if (until && pc == until->addr())
+            break;
+        out.append(pc);
+
+        reason = proc.step_instruction();
+        if (reason->reason != process_state::stopped ||
+            reason->trap_reason != trap_type::single_step)
+            break;
+    }
+    return reason;
+}
@@ -0,0 +1,870 @@
+#include <algorithm>
+#include <libjdb/bit.hpp>
+#include <libjdb/detail/dwarf_cursor.hpp>
+#include <libjdb/elf.hpp>
+#include <libjdb/error.hpp>
+#include <libjdb/process.hpp>
+#include <libjdb/register_info.hpp>
+#include <libjdb/unwinder.hpp>
+#include <limits>
+
+using jdb::detail::cursor;
+
+namespace {
+// The few DWARF and LSB constants the unwinder needs
+namespace dw {
+constexpr std::uint8_t eh_pe_absptr = 0x00, eh_pe_uleb128 = 0x01, eh_pe_udata2 = 0x02,
+                       eh_pe_udata4 = 0x03, eh_pe_udata8 = 0x04, eh_pe_sleb128 = 0x09,
+                       eh_pe_sdata2 = 0x0a, eh_pe_sdata4 = 0x0b, eh_pe_sdata8 = 0x0c,
+                       eh_pe_pcrel = 0x10, eh_pe_datarel = 0x30, eh_pe_indirect = 0x80,
+                       eh_pe_omit = 0xff;
+
+constexpr std::uint8_t cfa_advance_loc = 0x40, cfa_offset = 0x80, cfa_restore = 0xc0,
+                       cfa_nop = 0x00, cfa_set_loc = 0x01, cfa_advance_loc1 = 0x02,
+                       cfa_advance_loc2 = 0x03, cfa_advance_loc4 = 0x04,
+                       cfa_offset_extended = 0x05, cfa_restore_extended = 0x06,
+                       cfa_undefined = 0x07, cfa_same_value = 0x08, cfa_register = 0x09,
+                       cfa_remember_state = 0x0a, cfa_restore_state = 0x0b, cfa_def_cfa = 0x0c,
+                       cfa_def_cfa_register = 0x0d, cfa_def_cfa_offset = 0x0e,
+                       cfa_def_cfa_expression = 0x0f, cfa_expression = 0x10,
+                       cfa_offset_extended_sf = 0x11, cfa_def_cfa_sf = 0x12,
+                       cfa_def_cfa_offset_sf = 0x13, cfa_val_offset = 0x14,
+                       cfa_val_offset_sf = 0x15, cfa_val_expression = 0x16,
+                       cfa_gnu_args_size = 0x2e, cfa_gnu_negative_offset_extended = 0x2f;
+
+constexpr std::uint8_t op_addr = 0x03, op_deref = 0x06, op_const1u = 0x08, op_const1s = 0x09,
+                       op_const2u = 0x0a, op_const2s = 0x0b, op_const4u = 0x0c,
+                       op_const4s = 0x0d, op_const8u = 0x0e, op_const8s = 0x0f, op_constu = 0x10,
+                       op_consts = 0x11, op_dup = 0x12, op_drop = 0x13, op_over = 0x14,
+                       op_pick = 0x15, op_swap = 0x16, op_and = 0x1a, op_div = 0x1b,
+                       op_minus = 0x1c, op_mul = 0x1e, op_neg = 0x1f, op_not = 0x20, op_or = 0x21,
+                       op_plus = 0x22, op_plus_uconst = 0x23, op_shl = 0x24, op_shr = 0x25,
+                       op_shra = 0x26, op_xor = 0x27, op_bra = 0x28, op_eq = 0x29, op_ge = 0x2a,
+                       op_gt = 0x2b, op_le = 0x2c, op_lt = 0x2d, op_ne = 0x2e, op_skip = 0x2f,
+                       op_lit0 = 0x30, op_lit31 = 0x4f, op_breg0 = 0x70, op_breg31 = 0x8f,
+                       op_bregx = 0x92, op_nop = 0x96;
+} // namespace dw
+
+// A section, and where it is in the file's address space, which pc-relative pointers need
+struct section_view {
+    jdb::span<const std::byte> data;
+    std::uint64_t address;
+
+    std::uint64_t address_of(const std::byte *pos) const {
+        return address + (pos - data.begin());
+    }
+};
+
+// Reads a pointer stored with one of the DW_EH_PE encodings
+std::uint64_t read_encoded(cursor &cur, std::uint8_t encoding, const section_view &section,
+                           std::uint64_t data_base = 0) {
+    if (encoding == dw::eh_pe_omit) {
+        return 0;
+    }
+    auto field_address = section.address_of(cur.position());
+    std::uint64_t value;
+    switch (encoding & 0x0f) {
+    case dw::eh_pe_absptr:
+    case dw::eh_pe_udata8:
+    case dw::eh_pe_sdata8:
+        value = cur.u64();
+        break;
+    case dw::eh_pe_uleb128:
+        value = cur.uleb();
+        break;
+    case dw::eh_pe_udata2:
+        value = cur.u16();
+        break;
+    case dw::eh_pe_udata4:
+        value = cur.u32();
+        break;
+    case dw::eh_pe_sleb128:
+        value = cur.sleb();
+        break;
+    case dw::eh_pe_sdata2:
+        value = cur.fixed<std::int16_t>();
+        break;
+    case dw::eh_pe_sdata4:
+        value = cur.fixed<std::int32_t>();
+        break;
+    default:
+        jdb::error::send("Unsupported pointer encoding in CFI");
+    }
+    switch (encoding & 0x70) {
+    case 0:
+        break;
+    case dw::eh_pe_pcrel:
+        value += field_address;
+        break;
+    case dw::eh_pe_datarel:
+        value += data_base;
+        break;
+    default:
+        jdb::error::send("Unsupported pointer encoding in CFI");
+    }
+    // The value would be the address of the pointer, in the inferior
+    if (encoding & dw::eh_pe_indirect) {
+        jdb::error::send("Unsupported pointer encoding in CFI");
+    }
+    return value;
+}
+
+struct cie {
+    std::uint64_t code_alignment;
+    std::int64_t data_alignment;
+    std::uint8_t fde_encoding = dw::eh_pe_absptr;
+    bool has_augmentation_data = false;
+    jdb::span<const std::byte> instructions;
+};
+
+// Reads the entry (CIE or FDE) at offset. Returns a cursor over its contents, after the CIE id or
+// pointer, which is stored in id. id_position is where that field starts.
+cursor entry_cursor(const section_view &section, std::uint64_t offset, std::uint32_t &id,
+                    const std::byte *&id_position) {
+    if (offset >= section.data.size()) {
+        jdb::error::send("Malformed CFI: entry offset out of range");
+    }
+    cursor cur(section.data.begin() + offset, section.data.end());
+    bool is_64;
+    auto length = cur.initial_length(is_64);
+    if (length == 0 || is_64 || length > std::uint64_t(section.data.end() - cur.position())) {
+        jdb::error::send("Malformed CFI: bad entry length");
+    }
+    cursor contents(cur.position(), cur.position() + length);
+    id_position = contents.position();
+    id = contents.u32();
+    return contents;
+}
+
+cie parse_cie(const section_view &section, std::uint64_t offset) {
+    std::uint32_t id;
+    const std::byte *id_position;
+    auto cur = entry_cursor(section, offset, id, id_position);
+    if (id != 0) {
+        jdb::error::send("Malformed CFI: FDE points to an FDE");
+    }
+    cie ret;
+    auto version = cur.u8();
+    auto augmentation = cur.string();
+    if (augmentation.find("eh") != std::string_view::npos) {
+        cur.u64();
+    }
+    ret.code_alignment = cur.uleb();
+    ret.data_alignment = cur.sleb();
+    auto return_register = version == 1 ? cur.u8() : cur.uleb();
+    if (return_register != jdb::unwind_row::return_address) {
+        jdb::error::send("Unsupported return address register in CFI");
+    }
+
+    if (!augmentation.empty() && augmentation[0] == 'z') {
+        ret.has_augmentation_data = true;
+        auto size = cur.uleb();
+        auto data_start = cur.position();
+        cur.skip(size);
+        cursor data(data_start, cur.position());
+        for (auto c : augmentation.substr(1)) {
+            if (c == 'L') {
+                data.u8();
+            } else if (c == 'P') {
+                auto encoding = data.u8();
+                // Only skipped, so indirect pointers are fine
+                read_encoded(data, encoding & ~dw::eh_pe_indirect, section);
+            } else if (c == 'R') {
+                ret.fde_encoding = data.u8();
+            } else if (c != 'S' && c != 'B') {
+                break;
+            }
+        }
+    }
+    ret.instructions = {cur.position(), cur.end()};
+    return ret;
+}
+
+/*
+ * Runs CFA instructions until the location would pass target. location is then where the row in
+ * effect at target starts, and row_end is set to where the next one starts; it is left alone if
+ * no row follows. The CIE's initial instructions are run with a target that is never reached, and
+ * give the rules DW_CFA_restore goes back to.
+ */
+void run_cfa_program(jdb::span<const std::byte> instructions, const cie &info,
+                     const section_view &section, std::uint64_t &location, std::uint64_t target,
+                     std::uint64_t &row_end, jdb::unwind_row &row,
+                     const jdb::unwind_row *initial) {
+    using kind = jdb::register_rule::kind;
+    std::vector<jdb::unwind_row> remembered;
+    auto rule = [&](std::uint64_t reg) -> jdb::register_rule * {
+        // Rules for the registers that don't matter to unwinding, like the vector ones, are dropped
+        return reg < jdb::unwind_row::register_count ? &row.registers[reg] : nullptr;
+    };
+    auto set = [&](std::uint64_t reg, kind type, std::int64_t value = 0,
+                   jdb::span<const std::byte> expression = {}) {
+        if (auto r = rule(reg)) {
+            *r = {type, value, expression};
+        }
+    };
+    auto restore = [&](std::uint64_t reg) {
+        if (auto r = rule(reg)) {
+            *r = initial ? initial->registers[reg] : jdb::register_rule{};
+        }
+    };
+    auto move_to = [&](std::uint64_t next) {
+        if (next > target) {
+            row_end = next;
+            return false;
+        }
+        location = next;
+        return true;
+    };
+    auto advance = [&](std::uint64_t delta) {
+        return move_to(location + delta * info.code_alignment);
+    };
+    auto block = [](cursor &cur) {
+        auto size = cur.uleb();
+        auto start = cur.position();
+        cur.skip(size);
+        return jdb::span<const std::byte>(start, size);
+    };
+
+    cursor cur(instructions);
+    while (!cur.finished()) {
+        auto opcode = cur.u8();
+        auto high = opcode & 0xc0;
+        auto low = opcode & 0x3f;
+        if (high == dw::cfa_advance_loc) {
+            if (!advance(low))
+                return;
+            continue;
+        }
+        if (high == dw::cfa_offset) {
+            set(low, kind::offset, cur.uleb() * info.data_alignment);
+            continue;
+        }
+        if (high == dw::cfa_restore) {
+            restore(low);
+            continue;
+        }
+
+        switch (opcode) {
+        case dw::cfa_nop:
+            break;
+        case dw::cfa_set_loc:
+            if (!move_to(read_encoded(cur, info.fde_encoding, section)))
+                return;
+            break;
+        case dw::cfa_advance_loc1:
+            if (!advance(cur.u8()))
+                return;
+            break;
+        case dw::cfa_advance_loc2:
+            if (!advance(cur.u16()))
+                return;
+            break;
+        case dw::cfa_advance_loc4:
+            if (!advance(cur.u32()))
+                return;
+            break;
+        case dw::cfa_offset_extended: {
+            auto reg = cur.uleb();
+            set(reg, kind::offset, cur.uleb() * info.data_alignment);
+            break;
+        }
+        case dw::cfa_restore_extended:
+            restore(cur.uleb());
+            break;
+        case dw::cfa_undefined:
+            set(cur.uleb(), kind::undefined);
+            break;
+        case dw::cfa_same_value:
+            set(cur.uleb(), kind::same_value);
+            break;
+        case dw::cfa_register: {
+            auto reg = cur.uleb();
+            set(reg, kind::in_register, cur.uleb());
+            break;
+        }
+        case dw::cfa_remember_state:
+            remembered.push_back(row);
+            break;
+        case dw::cfa_restore_state:
+            if (remembered.empty()) {
+                jdb::error::send("Malformed CFI: restore without remember");
+            }
+            // The CFA isn't part of the state DWARF remembers
+            {
+                auto cfa_register = row.cfa_register;
+                auto cfa_offset = row.cfa_offset;
+                auto cfa_expression = row.cfa_expression;
+                row = remembered.back();
+                row.cfa_register = cfa_register;
+                row.cfa_offset = cfa_offset;
+                row.cfa_expression = cfa_expression;
+            }
+            remembered.pop_back();
+            break;
+        case dw::cfa_def_cfa:
+            row.cfa_register = cur.uleb();
+            row.cfa_offset = cur.uleb();
+            row.cfa_expression = {};
+            break;
+        case dw::cfa_def_cfa_sf:
+            row.cfa_register = cur.uleb();
+            row.cfa_offset = cur.sleb() * info.data_alignment;
+            row.cfa_expression = {};
+            break;
+        case dw::cfa_def_cfa_register:
+            row.cfa_register = cur.uleb();
+            row.cfa_expression = {};
+            break;
+        case dw::cfa_def_cfa_offset:
+            row.cfa_offset = cur.uleb();
+            break;
+        case dw::cfa_def_cfa_offset_sf:
+            row.cfa_offset = cur.sleb() * info.data_alignment;
+            break;
+        case dw::cfa_def_cfa_expression:
+            row.cfa_expression = block(cur);
+            break;
+        case dw::cfa_expression: {
+            auto reg = cur.uleb();
+            set(reg, kind::expression, 0, block(cur));
+            break;
+        }
+        case dw::cfa_val_expression: {
+            auto reg = cur.uleb();
+            set(reg, kind::val_expression, 0, block(cur));
+            break;
+        }
+        case dw::cfa_offset_extended_sf: {
+            auto reg = cur.uleb();
+            set(reg, kind::offset, cur.sleb() * info.data_alignment);
+            break;
+        }
+        case dw::cfa_val_offset: {
+            auto reg = cur.uleb();
+            set(reg, kind::val_offset, cur.uleb() * info.data_alignment);
+            break;
+        }
+        case dw::cfa_val_offset_sf: {
+            auto reg = cur.uleb();
+            set(reg, kind::val_offset, cur.sleb() * info.data_alignment);
+            break;
+        }
+        case dw::cfa_gnu_args_size:
+            cur.uleb();
+            break;
+        case dw::cfa_gnu_negative_offset_extended: {
+            auto reg = cur.uleb();
+            set(reg, kind::offset, -static_cast<std::int64_t>(cur.uleb()) * info.data_alignment);
+            break;
+        }
+        default:
+            jdb::error::send("Unsupported CFA instruction");
+        }
+    }
+}
+
+// The registers of a frame, by DWARF number, and which of them are known
+struct frame_registers {
+    std::array<std::uint64_t, jdb::unwind_row::register_count> values;
+    std::uint32_t known = 0;
+
+    bool has(std::uint64_t reg) const {
+        return reg < values.size() && (known & (std::uint32_t(1) << reg));
+    }
+    void set(std::uint64_t reg, std::uint64_t value) {
+        values[reg] = value;
+        known |= std::uint32_t(1) << reg;
+    }
+    void forget(std::uint64_t reg) { known &= ~(std::uint32_t(1) << reg); }
+};
+
+/*
+ * Evaluates a DWARF expression, as found in CFI, with initial pushed first if there is one. Only
+ * the operations that make sense without a full debug context are supported: constants,
+ * arithmetic, registers and memory reads. Returns nullopt when the expression can't be computed.
+ */
+template <class ReadWord>
+std::optional<std::uint64_t> evaluate(jdb::span<const std::byte> expression,
+                                      const frame_registers &regs, ReadWord read_word,
+                                      std::optional<std::uint64_t> initial = std::nullopt) {
+    std::vector<std::uint64_t> stack;
+    if (initial) {
+        stack.push_back(*initial);
+    }
+    auto pop = [&]() -> std::optional<std::uint64_t> {
+        if (stack.empty())
+            return std::nullopt;
+        auto ret = stack.back();
+        stack.pop_back();
+        return ret;
+    };
+
+    cursor cur(expression);
+    // Branches may go backwards, but never out of the expression
+    auto jump = [&](std::int16_t offset) {
+        auto target = cur.position() + offset;
+        if (target < expression.begin() || target > expression.end())
+            return false;
+        cur = cursor(target, expression.end());
+        return true;
+    };
+    while (!cur.finished()) {
+        auto opcode = cur.u8();
+        if (opcode >= dw::op_lit0 && opcode <= dw::op_lit31) {
+            stack.push_back(opcode - dw::op_lit0);
+            continue;
+        }
+        if ((opcode >= dw::op_breg0 && opcode <= dw::op_breg31) || opcode == dw::op_bregx) {
+            auto reg = opcode == dw::op_bregx ? cur.uleb() : opcode - dw::op_breg0;
+            auto offset = cur.sleb();
+            if (!regs.has(reg))
+                return std::nullopt;
+            stack.push_back(regs.values[reg] + offset);
+            continue;
+        }
+
+        switch (opcode) {
+        case dw::op_addr:
+        case dw::op_const8u:
+        case dw::op_const8s:
+            stack.push_back(cur.u64());
+            continue;
+        case dw::op_const1u:
+            stack.push_back(cur.u8());
+            continue;
+        case dw::op_const1s:
+            stack.push_back(cur.s8());
+            continue;
+        case dw::op_const2u:
+            stack.push_back(cur.u16());
+            continue;
+        case dw::op_const2s:
+            stack.push_back(cur.fixed<std::int16_t>());
+            continue;
+        case dw::op_const4u:
+            stack.push_back(cur.u32());
+            continue;
+        case dw::op_const4s:
+            stack.push_back(cur.fixed<std::int32_t>());
+            continue;
+        case dw::op_constu:
+            stack.push_back(cur.uleb());
+            continue;
+        case dw::op_consts:
+            stack.push_back(cur.sleb());
+            continue;
+        case dw::op_nop:
+            continue;
+        case dw::op_skip:
+            if (!jump(cur.fixed<std::int16_t>()))
+                return std::nullopt;
+            continue;
+        default:
+            break;
+        }
+
+        // Everything else works on the stack
+        if (stack.empty())
+            return std::nullopt;
+        auto &top = stack.back();
+        switch (opcode) {
+        case dw::op_deref: {
+            auto value = read_word(top);
+            if (!value)
+                return std::nullopt;
+            top = *value;
+            continue;
+        }
+        case dw::op_dup:
+            stack.push_back(top);
+            continue;
+        case dw::op_drop:
+            stack.pop_back();
+            continue;
+        case dw::op_neg:
+            top = -top;
+            continue;
+        case dw::op_not:
+            top = ~top;
+            continue;
+        case dw::op_plus_uconst:
+            top += cur.uleb();
+            continue;
+        case dw::op_pick: {
+            auto index = cur.u8();
+            if (index >= stack.size())
+                return std::nullopt;
+            stack.push_back(stack[stack.size() - 1 - index]);
+            continue;
+        }
+        case dw::op_bra: {
+            auto offset = cur.fixed<std::int16_t>();
+            if (*pop() != 0 && !jump(offset))
+                return std::nullopt;
+            continue;
+        }
+        default:
+            break;
+        }
+
+        // Binary operations, with the second operand on top
+        auto rhs = *pop();
+        auto lhs = pop();
+        if (!lhs)
+            return std::nullopt;
+        auto a = *lhs;
+        auto sa = static_cast<std::int64_t>(a);
+        auto sb = static_cast<std::int64_t>(rhs);
+        std::uint64_t result;
+        switch (opcode) {
+        case dw::op_over:
+            stack.push_back(a);
+            stack.push_back(rhs);
+            result = a;
+            break;
+        case dw::op_swap:
+            stack.push_back(rhs);
+            result = a;
+            break;
+        case dw::op_and:
+            result = a & rhs;
+            break;
+        case dw::op_or:
+            result = a | rhs;
+            break;
+        case dw::op_xor:
+            result = a ^ rhs;
+            break;
+        case dw::op_plus:
+            result = a + rhs;
+            break;
+        case dw::op_minus:
+            result = a - rhs;
+            break;
+        case dw::op_mul:
+            result = a * rhs;
+            break;
+        case dw::op_div:
+            if (sb == 0)
+                return std::nullopt;
+            result = static_cast<std::uint64_t>(sa / sb);
+            break;
+        case dw::op_shl:
+            result = rhs < 64 ? a << rhs : 0;
+            break;
+        case dw::op_shr:
+            result = rhs < 64 ? a >> rhs : 0;
+            break;
+        case dw::op_shra:
+            result = static_cast<std::uint64_t>(sa >> std::min<std::uint64_t>(rhs, 63));
+            break;
+        case dw::op_eq:
+            result = sa == sb;
+            break;
+        case dw::op_ne:
+            result = sa != sb;
+            break;
+        case dw::op_ge:
+            result = sa >= sb;
+            break;
+        case dw::op_gt:
+            result = sa > sb;
+            break;
+        case dw::op_le:
+            result = sa <= sb;
+            break;
+        case dw::op_lt:
+            result = sa < sb;
+            break;
+        default:
+            return std::nullopt;
+        }
+        stack.push_back(result);
+    }
+    return pop();
+}
+} // namespace
+
+jdb::call_frame_information::call_frame_information(const elf &file) : elf_(&file) {
+    eh_frame_ = file.get_section_contents(".eh_frame");
+    if (eh_frame_.empty()) {
+        return;
+    }
+    eh_frame_address_ = file.get_section(".eh_frame")->sh_addr;
+
+    // The usual table is made of pairs of 4 byte offsets from the start of the header
+    constexpr std::uint8_t usual_table_encoding = dw::eh_pe_datarel | dw::eh_pe_sdata4;
+    eh_frame_hdr_ = file.get_section_contents(".eh_frame_hdr");
+    if (eh_frame_hdr_.size() >= 4) {
+        eh_frame_hdr_address_ = file.get_section(".eh_frame_hdr")->sh_addr;
+        section_view hdr{eh_frame_hdr_, eh_frame_hdr_address_};
+        cursor cur(eh_frame_hdr_);
+        auto version = cur.u8();
+        auto eh_frame_pointer_encoding = cur.u8();
+        auto count_encoding = cur.u8();
+        auto table_encoding = cur.u8();
+        if (version == 1 && table_encoding == usual_table_encoding &&
+            count_encoding != dw::eh_pe_omit) {
+            read_encoded(cur, eh_frame_pointer_encoding, hdr);
+            auto count = read_encoded(cur, count_encoding, hdr);
+            auto offset = cur.position() - eh_frame_hdr_.begin();
+            if (offset % 4 == 0 && count * 8 <= std::uint64_t(cur.end() - cur.position())) {
+                hdr_table_ = {reinterpret_cast<const std::int32_t *>(cur.position()), count * 2};
+                return;
+            }
+        }
+    }
+    index_eh_frame();
+}
+
+void jdb::call_frame_information::index_eh_frame() {
+    section_view section{eh_frame_, eh_frame_address_};
+    std::uint64_t offset = 0;
+    while (offset + 4 <= eh_frame_.size()) {
+        cursor cur(eh_frame_.begin() + offset, eh_frame_.end());
+        bool is_64;
+        auto length = cur.initial_length(is_64);
+        // A zero length terminates the section
+        if (length == 0 || is_64) {
+            break;
+        }
+        auto next = (cur.position() - eh_frame_.begin()) + length;
+        auto id_position = cur.position();
+        auto id = cur.u32();
+        if (id != 0) {
+            auto info = parse_cie(section, (id_position - eh_frame_.begin()) - id);
+            auto start = read_encoded(cur, info.fde_encoding, section);
+            fdes_.push_back({start, offset});
+        }
+        offset = next;
+    }
+    std::sort(fdes_.begin(), fdes_.end(),
+              [](auto &lhs, auto &rhs) { return lhs.start < rhs.start; });
+}
+
+bool jdb::call_frame_information::empty() const { return hdr_table_.empty() && fdes_.empty(); }
+
+std::optional<std::uint64_t>
+jdb::call_frame_information::find_fde(std::uint64_t file_address) const {
+    // The last FDE starting at or before the address is the only one that may cover it
+    if (!hdr_table_.empty()) {
+        auto count = hdr_table_.size() / 2;
+        std::size_t low = 0, high = count;
+        while (low < high) {
+            auto mid = (low + high) / 2;
+            if (eh_frame_hdr_address_ + hdr_table_[mid * 2] <= file_address) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        if (low == 0) {
+            return std::nullopt;
+        }
+        return eh_frame_hdr_address_ + hdr_table_[(low - 1) * 2 + 1] - eh_frame_address_;
+    }
+
+    auto it = std::upper_bound(fdes_.begin(), fdes_.end(), file_address,
+                               [](std::uint64_t address, auto &fde) { return address < fde.start; });
+    if (it == fdes_.begin()) {
+        return std::nullopt;
+    }
+    return std::prev(it)->offset;
+}
+
+std::optional<jdb::unwind_row>
+jdb::call_frame_information::row_at(std::uint64_t file_address) const {
+    auto offset = find_fde(file_address);
+    if (!offset) {
+        return std::nullopt;
+    }
+
+    section_view section{eh_frame_, eh_frame_address_};
+    std::uint32_t id;
+    const std::byte *id_position;
+    auto cur = entry_cursor(section, *offset, id, id_position);
+    if (id == 0) {
+        jdb::error::send("Malformed CFI: FDE expected");
+    }
+    auto info = parse_cie(section, (id_position - eh_frame_.begin()) - id);
+    auto start = read_encoded(cur, info.fde_encoding, section);
+    // The range is a plain size, whatever its encoding says it is relative to
+    auto range = read_encoded(cur, info.fde_encoding & 0x0f, section);
+    if (file_address < start || file_address >= start + range) {
+        return std::nullopt;
+    }
+    if (info.has_augmentation_data) {
+        cur.skip(cur.uleb());
+    }
+
+    unwind_row initial;
+    auto location = start;
+    auto end = start + range;
+    run_cfa_program(info.instructions, info, section, location,
+                    std::numeric_limits<std::uint64_t>::max(), end, initial, nullptr);
+    auto row = initial;
+    location = start;
+    run_cfa_program({cur.position(), cur.end()}, info, section, location, file_address, end, row,
+                    &initial);
+    row.start = location;
+    row.end = std::min(end, start + range);
+    return row;
+}
+
+const jdb::unwind_row *jdb::unwinder::row_at(std::uint64_t pc) {
+    // The first row that ends past the PC is the only one that may cover it
+    auto cached = rows_.upper_bound(pc);
+    if (cached != rows_.end() && cached->second.start <= pc) {
+        ++stats_.hits;
+        return &cached->second;
+    }
+    if (uncovered_.count(pc)) {
+        ++stats_.hits;
+        return nullptr;
+    }
+    ++stats_.misses;
+
+    std::optional<unwind_row> row;
+    try {
+        if (auto file = process_->elf_containing_address(virt_addr{pc})) {
+            auto file_address = file->to_file_addr(virt_addr{pc});
+            row = file->get_call_frame_info().row_at(file_address);
+            if (row) {
+                row->start += pc - file_address;
+                row->end += pc - file_address;
+                // CFI that moves its location backwards gets a row of the PC alone
+                if (row->start > pc || row->end <= pc) {
+                    row->start = pc;
+                    row->end = pc + 1;
+                }
+            }
+        }
+    } catch (const error &) {
+        // Malformed or unsupported CFI is handled like missing CFI
+    }
+    if (!row) {
+        if (uncovered_.size() >= max_uncovered) {
+            uncovered_.clear();
+        }
+        uncovered_.insert(pc);
+        return nullptr;
+    }
+    return &rows_.insert_or_assign(row->end, *row).first->second;
+}
+
+void jdb::unwinder::unwind(pid_t tid, std::vector<std::uint64_t> &frames, std::size_t max_depth,
+                           span<const std::byte> stack, std::uint64_t stack_start) {
+    frames.clear();
+    // Only GPRs are involved, so this is a single PTRACE_GETREGS
+    auto &thread_regs = process_->get_registers(tid);
+    frame_registers regs;
+    for (std::size_t i = 0; i < unwind_row::register_count; ++i) {
+        regs.set(i, thread_regs.read_by_id_as<std::uint64_t>(register_info_by_dwarf(i).id));
+    }
+
+    auto read_word = [&](std::uint64_t address) -> std::optional<std::uint64_t> {
+        if (address >= stack_start && address - stack_start + 8 <= stack.size()) {
+            return from_bytes<std::uint64_t>(stack.begin() + (address - stack_start));
+        }
+        std::uint64_t value;
+        if (process_->read_memory_into(virt_addr{address}, {as_bytes(value), sizeof(value)}) !=
+            sizeof(value)) {
+            return std::nullopt;
+        }
+        return value;
+    };
+
+    constexpr std::uint64_t sp = 7, fp = 6, ra = unwind_row::return_address;
+    while (frames.size() < max_depth) {
+        auto pc = regs.values[ra];
+        frames.push_back(pc);
+
+        // Return addresses point after the call, which may be past the end of the caller's
+        // function. Looking up the byte before finds the right rules.
+        auto row = row_at(frames.size() == 1 ? pc : pc - 1);
+        auto caller = regs;
+        std::uint64_t cfa;
+        if (row) {
+            if (!row->cfa_expression.empty()) {
+                auto value = evaluate(row->cfa_expression, regs, read_word);
+                if (!value)
+                    break;
+                cfa = *value;
+            } else {
+                if (!regs.has(row->cfa_register))
+                    break;
+                cfa = regs.values[row->cfa_register] + row->cfa_offset;
+            }
+
+            for (std::size_t i = 0; i < unwind_row::register_count; ++i) {
+                auto &rule = row->registers[i];
+                std::optional<std::uint64_t> value;
+                switch (rule.type) {
+                case register_rule::kind::same_value:
+                    continue;
+                case register_rule::kind::undefined:
+                    break;
+                case register_rule::kind::offset:
+                    value = read_word(cfa + rule.value);
+                    break;
+                case register_rule::kind::val_offset:
+                    value = cfa + rule.value;
+                    break;
+                case register_rule::kind::in_register:
+                    if (regs.has(rule.value))
+                        value = regs.values[rule.value];
+                    break;
+                case register_rule::kind::expression:
+                    if (auto address = evaluate(rule.expression, regs, read_word, cfa))
+                        value = read_word(*address);
+                    break;
+                case register_rule::kind::val_expression:
+                    value = evaluate(rule.expression, regs, read_word, cfa);
+                    break;
+                }
+                if (value) {
+                    caller.set(i, *value);
+                } else {
+                    caller.forget(i);
+                }
+            }
+            // The caller's stack pointer is the CFA, unless a rule says otherwise
+            if (row->registers[sp].type == register_rule::kind::same_value) {
+                caller.set(sp, cfa);
+            }
+        } else {
+            // Without CFI, the frame is assumed to start with the caller's frame pointer,
+            // followed by the return address
+            if (!regs.has(fp))
+                break;
+            auto frame = regs.values[fp];
+            auto saved_fp = read_word(frame);
+            auto return_address = read_word(frame + 8);
+            if (!saved_fp || !return_address)
+                break;
+            cfa = frame + 16;
+            caller.set(fp, *saved_fp);
+            caller.set(ra, *return_address);
+            caller.set(sp, cfa);
+        }
+
+        // An undefined return address marks the outermost frame. Stacks grow down, so a caller's
+        // frame is always above its callee's, which also stops the walk on garbage.
+        if (!caller.has(ra) || caller.values[ra] == 0 || !regs.has(sp) ||
+            cfa <= regs.values[sp]) {
+            break;
+        }
+        regs = caller;
+    }
+}
+
+std::vector<jdb::virt_addr> jdb::unwinder::backtrace(pid_t tid, std::size_t max_depth) {
+    std::vector<std::uint64_t> frames;
+    unwind(tid, frames, max_depth);
+    std::vector<virt_addr> ret;
+    ret.reserve(frames.size());
+    for (auto frame : frames) {
+        ret.push_back(virt_addr{frame});
+    }
+    return ret;
+}
@@ -0,0 +1,53 @@
+#include <cstring>
+#include <libjdb/error.hpp>
+#include <libjdb/process.hpp>
+#include <libjdb/watchpoint.hpp>
+#include <utility>
+
+namespace {
+auto get_next_id() {
+    static jdb::watchpoint::id_type id = 0;
+    return ++id;
+}
+} // namespace
+
+jdb::watchpoint::watchpoint(process &proc, virt_addr address, stoppoint_mode mode,
+                            std::size_t size)
+    : id_(get_next_id()), process_(&proc), address_(address), mode_(mode), size_(size),
+      is_enabled_(false) {
+    if (size != 1 && size != 2 && size != 4 && size != 8) {
+        error::send("Watchpoint size must be 1, 2, 4 or 8");
+    }
+    if (mode == stoppoint_mode::execute && size != 1) {
+        error::send("Execute watchpoints must have a size of 1");
+    }
+    // The CPU compares addresses with their lowest bits masked off according to the size
+    if ((address.addr() & (size - 1)) != 0) {
+        error::send("Watchpoint must be aligned to size");
+    }
+    update_data();
+}
+
+void jdb::watchpoint::enable() {
+    if (is_enabled_)
+        return;
+
+    hardware_register_index_ = process_->set_watchpoint(address_, mode_, size_);
+    is_enabled_ = true;
+}
+
+void jdb::watchpoint::disable() {
+    if (!is_enabled_)
+        return;
+
+    process_->clear_hardware_stoppoint(hardware_register_index_);
+    hardware_register_index_ = -1;
+    is_enabled_ = false;
+}
+
+void jdb::watchpoint::update_data() {
+    std::uint64_t new_data = 0;
+    auto read = process_->read_memory(address_, size_);
+    std::memcpy(&new_data, read.data(), read.size());
+    previous_data_ = std::exchange(data_, new_data);
+}
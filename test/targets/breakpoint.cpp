@@ -0,0 +1,19 @@
+#include <cstdio>
+#include <signal.h>
+#include <unistd.h>
+
+__attribute__((noinline)) void an_innocent_function() {
+    std::puts("Putting pepperoni on pizza...");
+    std::fflush(stdout);
+}
+
+int main() {
+    // Send the address of the function to the debugger, which sets a breakpoint site on it
+    auto address = &an_innocent_function;
+    write(STDOUT_FILENO, &address, sizeof(void *));
+    std::fflush(stdout);
+    raise(SIGTRAP);
+
+    an_innocent_function();
+    an_innocent_function();
+}
@@ -0,0 +1,18 @@
+#include <cstdio>
+#include <unistd.h>
+
+__attribute__((noinline)) void inner() {
+    volatile int i;
+    while (true)
+        i = 42;
+}
+
+__attribute__((noinline)) void outer() { inner(); }
+
+int main() {
+    // Send both addresses to the debugger, which checks the stacks it samples against them
+    void *addresses[] = {reinterpret_cast<void *>(&inner), reinterpret_cast<void *>(&outer)};
+    write(STDOUT_FILENO, addresses, sizeof(addresses));
+    std::fflush(stdout);
+    outer();
+}
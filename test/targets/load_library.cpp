@@ -0,0 +1,16 @@
+#include <csignal>
+#include <dlfcn.h>
+#include <unistd.h>
+
+int main() {
+    auto handle = dlopen("test/targets/libplugin.so", RTLD_NOW);
+    if (!handle)
+        return 1;
+    // Send the function's address to the debugger, then let it look around
+    auto function = dlsym(handle, "plugin_function");
+    write(STDOUT_FILENO, &function, sizeof(function));
+    raise(SIGTRAP);
+
+    dlclose(handle);
+    raise(SIGTRAP);
+}
@@ -0,0 +1,22 @@
+#include <cstdint>
+#include <cstdio>
+#include <signal.h>
+#include <unistd.h>
+
+int main() {
+    // Send the address of a known value to the debugger, then stop so it can be read
+    std::uint64_t a = 0xcafecafe;
+    auto a_address = &a;
+    write(STDOUT_FILENO, &a_address, sizeof(void *));
+    fflush(stdout);
+    raise(SIGTRAP);
+
+    // Send the address of an empty buffer, which the debugger fills in before we print it
+    char b[12] = {0};
+    auto b_address = &b;
+    write(STDOUT_FILENO, &b_address, sizeof(void *));
+    fflush(stdout);
+    raise(SIGTRAP);
+
+    printf("%s", b);
+}
@@ -0,0 +1,26 @@
+#include <cstdio>
+#include <signal.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+__attribute__((noinline)) void thread_function() {
+    static volatile int calls = 0;
+    calls = calls + 1;
+}
+
+int main() {
+    // Send the address of the function to the debugger, which sets a breakpoint site on it
+    auto address = &thread_function;
+    write(STDOUT_FILENO, &address, sizeof(void *));
+    std::fflush(stdout);
+    raise(SIGTRAP);
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 8; ++i) {
+        threads.emplace_back(thread_function);
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
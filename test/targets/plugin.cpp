@@ -0,0 +1 @@
+extern "C" int plugin_function(int value) { return value * 2; }
@@ -0,0 +1,25 @@
+#include <chrono>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+int main() {
+    // A few threads that run for a while and exit, while the main thread carries on
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([] {
+            auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(200);
+            while (std::chrono::steady_clock::now() < end) {
+            }
+        });
+    }
+    // Tells the debugger they are all running
+    char started = 1;
+    write(STDOUT_FILENO, &started, 1);
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    volatile int i;
+    while (true)
+        i = 42;
+}
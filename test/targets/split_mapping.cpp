@@ -0,0 +1,21 @@
+#include <cstdint>
+#include <cstring>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+int main() {
+    // Sixteen pages, each filled with its own number, then split in three by making the middle
+    // four read-only
+    constexpr std::size_t page_size = 0x1000;
+    auto pages = static_cast<std::uint8_t *>(mmap(nullptr, 16 * page_size, PROT_READ | PROT_WRITE,
+                                                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    for (std::size_t i = 0; i < 16; ++i) {
+        std::memset(pages + i * page_size, static_cast<int>(i + 1), page_size);
+    }
+    write(STDOUT_FILENO, &pages, sizeof(pages));
+    raise(SIGTRAP);
+
+    mprotect(pages + 6 * page_size, 4 * page_size, PROT_READ);
+    raise(SIGTRAP);
+}
@@ -0,0 +1,12 @@
+#include <cstdio>
+
+__attribute__((noinline)) int add(int a, int b) {
+    return a + b;
+}
+
+int main() {
+    int x = 1;
+    x = add(x, 2);
+    x = add(x, 3);
+    std::printf("%d\n", x);
+}
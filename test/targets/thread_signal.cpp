@@ -0,0 +1,23 @@
+#include <atomic>
+#include <chrono>
+#include <signal.h>
+#include <thread>
+
+std::atomic<bool> handled{false};
+
+void on_usr1(int) { handled = true; }
+
+int main() {
+    signal(SIGUSR1, on_usr1);
+    // Gets SIGUSR1 from the debugger while the process is stopped, and waits for it to arrive
+    std::thread worker([] {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (!handled && std::chrono::steady_clock::now() < deadline) {
+        }
+    });
+    raise(SIGTRAP);
+    // Stops again straight away, as the worker stops for its signal
+    raise(SIGTRAP);
+    worker.join();
+    return handled ? 0 : 1;
+}
@@ -0,0 +1,17 @@
+#include <signal.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+int main() {
+    // The worker's traced syscalls keep coming while the main thread stops the process
+    std::thread worker([] {
+        for (int i = 0; i < 200; ++i) {
+            syscall(SYS_getppid);
+        }
+    });
+    for (int i = 0; i < 50; ++i) {
+        raise(SIGTRAP);
+    }
+    worker.join();
+}
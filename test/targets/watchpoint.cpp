@@ -0,0 +1,17 @@
+#include <cstdint>
+#include <cstdio>
+#include <signal.h>
+#include <unistd.h>
+
+volatile std::uint64_t value = 0;
+
+int main() {
+    // Send the address of the watched variable to the debugger, then write to it twice
+    auto address = &value;
+    write(STDOUT_FILENO, &address, sizeof(void *));
+    std::fflush(stdout);
+    raise(SIGTRAP);
+
+    value = 42;
+    value = 43;
+}
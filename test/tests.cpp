@@ -1,14 +1,33 @@
+#include <algorithm>
 #include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <filesystem>
 #include <fstream>
 #include <libjdb/bit.hpp>
+#include <libjdb/dwarf.hpp>
+#include <libjdb/elf.hpp>
 #include <libjdb/error.hpp>
+#include <libjdb/event_loop.hpp>
+#include <libjdb/memory_dump.hpp>
+#include <libjdb/memory_search.hpp>
+#include <libjdb/perf.hpp>
 #include <libjdb/pipe.hpp>
 #include <libjdb/process.hpp>
+#include <libjdb/profiler.hpp>
 #include <libjdb/register_info.hpp>
+#include <libjdb/snapshot.hpp>
+#include <libjdb/stepping.hpp>
+#include <libjdb/syscalls.hpp>
+#include <libjdb/trace.hpp>
+#include <set>
+#include <sstream>
 #include <signal.h>
 #include <string>
+#include <sys/syscall.h>
 #include <sys/types.h>
 
 using namespace jdb;
@@ -19,6 +38,21 @@ bool process_exists(pid_t pid) {
     return ret != -1 && errno != ESRCH;
 }
 
+// Symbol indexes are written to a cache directory of the test run's own, rather than the user's
+struct temporary_index_cache {
+    temporary_index_cache()
+        : path(std::filesystem::temp_directory_path() /
+               ("jdb_test_cache_" + std::to_string(getpid()))) {
+        std::filesystem::remove_all(path);
+        setenv("XDG_CACHE_HOME", path.c_str(), true);
+    }
+    ~temporary_index_cache() {
+        std::error_code ec;
+        std::filesystem::remove_all(path, ec);
+    }
+    std::filesystem::path path;
+} index_cache;
+
 char get_process_status(pid_t pid) {
     std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
     std::string data;
@@ -52,6 +86,40 @@ TEST_CASE("process:attach invalid PID", "[process]") {
     REQUIRE_THROWS_AS(process::attach(0), error);
 }
 
+TEST_CASE("process::seize leaves the process running", "[process]") {
+    auto target = process::launch("test/targets/run_endlessly", false);
+    {
+        auto proc = process::seize(target->pid());
+        REQUIRE(proc->is_seized());
+        REQUIRE(proc->state() == process_state::running);
+        auto status = get_process_status(target->pid());
+        REQUIRE((status == 'R' || status == 'S'));
+
+        proc->interrupt();
+        auto reason = proc->wait_on_signal();
+        REQUIRE(reason.reason == process_state::stopped);
+        REQUIRE(reason.trap_reason == trap_type::interrupt);
+        REQUIRE(get_process_status(target->pid()) == 't');
+        REQUIRE_THROWS_AS(proc->interrupt(), error);
+
+        proc->resume();
+        REQUIRE(!proc->poll_stop(std::chrono::milliseconds(50)));
+    }
+    // Detaching from a running seized process sends it no signal, so it isn't left stopped
+    auto status = get_process_status(target->pid());
+    REQUIRE((status == 'R' || status == 'S'));
+}
+
+TEST_CASE("process::interrupt stops attached processes", "[process]") {
+    auto target = process::launch("test/targets/run_endlessly", false);
+    auto proc = process::attach(target->pid());
+    proc->resume();
+    proc->interrupt();
+    auto reason = proc->wait_on_signal();
+    REQUIRE(reason.reason == process_state::stopped);
+    REQUIRE(reason.info == SIGSTOP);
+}
+
 TEST_CASE("process::resume success", "[process]") {
     {
         auto proc = process::launch("test/targets/run_endlessly");
@@ -77,6 +145,78 @@ TEST_CASE("process::resume already terminated", "[process]") {
     REQUIRE_THROWS_AS(proc->resume(), error);
 }
 
+TEST_CASE("Stops report what the process spent since resuming", "[process]") {
+    perf_counters unused;
+    REQUIRE(!unused.stop());
+
+    auto proc = process::launch("test/targets/end_immediately");
+    proc->resume();
+    auto reason = proc->wait_on_signal();
+    REQUIRE(reason.reason == process_state::exited);
+    // Whether there are counters at all depends on the host having a PMU
+    if (reason.counters && reason.counters->instructions) {
+        REQUIRE(*reason.counters->instructions > 0);
+    }
+}
+
+TEST_CASE("Traced syscalls stop on entry and exit", "[syscall]") {
+    REQUIRE(syscall_name_to_id("write") == SYS_write);
+    REQUIRE(syscall_id_to_name(SYS_openat) == "openat");
+    REQUIRE_THROWS_AS(syscall_name_to_id("no_such_syscall"), error);
+
+    bool close_on_exec = false;
+    jdb::pipe channel(close_on_exec);
+    auto proc =
+        process::launch("test/targets/call_chain", true, channel.get_write(), {SYS_write});
+    channel.close_write();
+
+    proc->resume();
+    auto reason = proc->wait_on_signal();
+    REQUIRE(reason.trap_reason == trap_type::syscall);
+    REQUIRE(reason.syscall_info->id == SYS_write);
+    REQUIRE(reason.syscall_info->entry);
+    REQUIRE(reason.syscall_info->args[0] == STDOUT_FILENO);
+    REQUIRE(reason.syscall_info->args[2] == 16);
+
+    proc->resume();
+    reason = proc->wait_on_signal();
+    REQUIRE(reason.trap_reason == trap_type::syscall);
+    REQUIRE(reason.syscall_info->id == SYS_write);
+    REQUIRE(!reason.syscall_info->entry);
+    REQUIRE(reason.syscall_info->ret == 16);
+    // Only write stopped: everything the loader and libc did before it ran freely
+    REQUIRE(channel.read().size() == 16);
+}
+
+TEST_CASE("Syscall stops caught by an all-stop are reported", "[syscall]") {
+    auto proc =
+        process::launch("test/targets/thread_syscall", true, std::nullopt, {SYS_getppid});
+
+    // Every entry is reported, then the exit that goes with it
+    std::set<pid_t> in_syscall;
+    int entries = 0;
+    int traps = 0;
+    while (true) {
+        proc->resume();
+        auto reason = proc->wait_on_signal();
+        if (reason.reason == process_state::exited)
+            break;
+        if (reason.trap_reason != trap_type::syscall) {
+            ++traps;
+            continue;
+        }
+        REQUIRE(reason.syscall_info->id == SYS_getppid);
+        if (reason.syscall_info->entry) {
+            REQUIRE(in_syscall.insert(reason.tid).second);
+            ++entries;
+        } else {
+            REQUIRE(in_syscall.erase(reason.tid) == 1);
+        }
+    }
+    REQUIRE(entries == 200);
+    REQUIRE(traps == 50);
+}
+
 TEST_CASE("Write register works", "[register]") {
     // Our goal is to check, from within a running process, that we can affect the value of a
     // register.
@@ -135,6 +275,37 @@ TEST_CASE("Write register works", "[register]") {
     REQUIRE(to_string_view(output) == "42.24");
 }
 
+TEST_CASE("Write-back registers are flushed on resume", "[register]") {
+    bool close_on_exec = false;
+    jdb::pipe channel(close_on_exec);
+
+    auto proc = process::launch("test/targets/reg_write", true, channel.get_write());
+    channel.close_write();
+
+    proc->resume();
+    proc->wait_on_signal();
+
+    auto &regs = proc->get_registers();
+    regs.set_write_mode(register_write_mode::write_back);
+    regs.write_by_id(register_id::rsi, 0xcafecafe);
+    // The pending write is visible through the cache before it reaches the inferior
+    REQUIRE(regs.read_by_id_as<std::uint64_t>(register_id::rsi) == 0xcafecafe);
+
+    proc->resume();
+    proc->wait_on_signal();
+
+    auto output = channel.read();
+    REQUIRE(to_string_view(output) == "0xcafecafe");
+
+    regs.write_by_id(register_id::mm0, 0xba5eba11);
+
+    proc->resume();
+    proc->wait_on_signal();
+
+    output = channel.read();
+    REQUIRE(to_string_view(output) == "0xba5eba11");
+}
+
 TEST_CASE("Read register works", "[register]") {
     auto proc = process::launch("test/targets/reg_read");
     auto &regs = proc->get_registers();
@@ -164,3 +335,1246 @@ TEST_CASE("Read register works", "[register]") {
 
     REQUIRE(regs.read_by_id_as<long double>(register_id::st0) == 64.125L);
 }
+
+TEST_CASE("Register info lookups agree with the register table", "[register]") {
+    for (auto &info : g_register_infos) {
+        REQUIRE(&register_info_by_id(info.id) == &info);
+        REQUIRE(&register_info_by_name(info.name) == &info);
+        if (info.dwarf_id >= 0) {
+            REQUIRE(register_info_by_dwarf(info.dwarf_id).dwarf_id == info.dwarf_id);
+        }
+    }
+
+    static_assert(register_info_by_id(register_id::rip).offset ==
+                  offsetof(user, regs) + offsetof(user_regs_struct, rip));
+    static_assert(register_info_by_name("xmm3").id == register_id::xmm3);
+    static_assert(register_info_by_dwarf(7).id == register_id::rsp);
+
+    REQUIRE_THROWS_AS(register_info_by_name("not_a_register"), error);
+    REQUIRE_THROWS_AS(register_info_by_name(""), error);
+    REQUIRE_THROWS_AS(register_info_by_dwarf(-1), error);
+    REQUIRE_THROWS_AS(register_info_by_dwarf(1000), error);
+}
+
+TEST_CASE("Can read memory", "[memory]") {
+    bool close_on_exec = false;
+    jdb::pipe channel(close_on_exec);
+    auto proc = process::launch("test/targets/memory", true, channel.get_write());
+    channel.close_write();
+
+    proc->resume();
+    proc->wait_on_signal();
+
+    auto a_pointer = from_bytes<std::uint64_t>(channel.read().data());
+    REQUIRE(proc->read_memory_as<std::uint64_t>(virt_addr{a_pointer}) == 0xcafecafe);
+
+    std::uint64_t into = 0;
+    REQUIRE(proc->read_memory_into(virt_addr{a_pointer}, {as_bytes(into), sizeof(into)}) ==
+            sizeof(into));
+    REQUIRE(into == 0xcafecafe);
+
+    // The first page is never mapped, so nothing can be read from it
+    REQUIRE(proc->read_memory(virt_addr{0}, 8).empty());
+}
+
+TEST_CASE("Can write memory", "[memory]") {
+    bool close_on_exec = false;
+    jdb::pipe channel(close_on_exec);
+    auto proc = process::launch("test/targets/memory", true, channel.get_write());
+    channel.close_write();
+
+    proc->resume();
+    proc->wait_on_signal();
+    // Discard the address sent before the first stop
+    channel.read();
+    proc->resume();
+    proc->wait_on_signal();
+
+    auto b_pointer = from_bytes<std::uint64_t>(channel.read().data());
+    std::string hello = "Hello, jdb!";
+    proc->write_memory(virt_addr{b_pointer}, {as_bytes(hello[0]), hello.size() + 1});
+
+    // Code pages are read-only, so this write has to go through /proc/<pid>/mem
+    auto pc = proc->get_pc();
+    auto original = proc->read_memory(pc, 4);
+    std::vector<std::byte> patch(4, std::byte{0x90});
+    proc->write_memory(pc, patch);
+    REQUIRE(proc->read_memory(pc, 4) == patch);
+    proc->write_memory(pc, original);
+
+    proc->resume();
+    proc->wait_on_signal();
+
+    auto read = channel.read();
+    REQUIRE(to_string_view(read) == "Hello, jdb!");
+}
+
+TEST_CASE("Memory reads are cached until the process resumes", "[memory]") {
+    bool close_on_exec = false;
+    jdb::pipe channel(close_on_exec);
+    auto proc = process::launch("test/targets/memory", true, channel.get_write());
+    channel.close_write();
+
+    proc->resume();
+    proc->wait_on_signal();
+
+    auto a_pointer = virt_addr{from_bytes<std::uint64_t>(channel.read().data())};
+    proc->reset_memory_cache_stats();
+
+    REQUIRE(proc->read_memory_as<std::uint64_t>(a_pointer) == 0xcafecafe);
+    REQUIRE(proc->memory_cache_stats().misses == 1);
+    REQUIRE(proc->read_memory_as<std::uint64_t>(a_pointer) == 0xcafecafe);
+    REQUIRE(proc->memory_cache_stats().hits == 1);
+
+    // Writes must never leave stale data behind
+    std::uint64_t new_value = 0xba5eba11;
+    proc->write_memory(a_pointer, {as_bytes(new_value), sizeof(new_value)});
+    REQUIRE(proc->read_memory_as<std::uint64_t>(a_pointer) == 0xba5eba11);
+    REQUIRE(proc->memory_cache_stats().misses == 2);
+
+    // Reads spanning several pages mix hits and misses, and stop at the first unmapped page
+    auto page = virt_addr{a_pointer.addr() & ~std::uint64_t{0xfff}};
+    auto uncached = proc->read_memory(page - 0x2000, 0x3000);
+    REQUIRE(uncached.size() == 0x3000);
+    REQUIRE(proc->read_memory(page - 0x2000, 0x3000) == uncached);
+    REQUIRE(proc->read_memory(virt_addr{0}, 16).empty());
+
+    proc->resume();
+    proc->wait_on_signal();
+    proc->reset_memory_cache_stats();
+    proc->read_memory_as<std::uint64_t>(a_pointer);
+    REQUIRE(proc->memory_cache_stats().hits == 0);
+}
+
+TEST_CASE("Cached reads survive the eviction of their own pages", "[memory]") {
+    bool close_on_exec = false;
+    jdb::pipe channel(close_on_exec);
+    auto proc = process::launch("test/targets/memory", true, channel.get_write());
+    channel.close_write();
+    proc->resume();
+    proc->wait_on_signal();
+    auto a_pointer = virt_addr{from_bytes<std::uint64_t>(channel.read().data())};
+
+    // Two pages at the far end of the stack, told apart by what they start with
+    auto stack = *proc->get_memory_map().find(a_pointer);
+    auto first = stack.start;
+    std::uint64_t first_marker = 0x1111111111111111;
+    std::uint64_t second_marker = 0x2222222222222222;
+    proc->write_memory(first, {as_bytes(first_marker), sizeof(first_marker)});
+    proc->write_memory(first + 0x1000, {as_bytes(second_marker), sizeof(second_marker)});
+
+    // Caches the first page, then enough others that it becomes the next one evicted
+    proc->invalidate_memory_cache();
+    proc->read_memory(first, 1);
+    std::size_t others = 0;
+    for (auto &region : proc->get_memory_map().regions()) {
+        if (!region.readable || region.name.rfind("[v", 0) == 0)
+            continue;
+        for (auto page = region.start; page < region.end && others < page_cache::capacity - 1;
+             page += 0x1000) {
+            if (page == first || page == first + 0x1000)
+                continue;
+            if (proc->read_memory(page, 1).size() == 1)
+                ++others;
+        }
+    }
+    REQUIRE(others == page_cache::capacity - 1);
+
+    // The second page takes the slot of the first one, which this very read is using
+    auto cached = proc->read_memory(first, 0x2000);
+    proc->invalidate_memory_cache();
+    auto uncached = proc->read_memory(first, 0x2000);
+    REQUIRE(from_bytes<std::uint64_t>(cached.data()) == first_marker);
+    REQUIRE(cached == uncached);
+}
+
+TEST_CASE("Snapshots store changed pages once", "[memory]") {
+    bool close_on_exec = false;
+    jdb::pipe channel(close_on_exec);
+    auto proc = process::launch("test/targets/memory", true, channel.get_write());
+    channel.close_write();
+    proc->resume();
+    proc->wait_on_signal();
+    auto a_pointer = from_bytes<std::uint64_t>(channel.read().data());
+
+    snapshot_store snapshots(*proc);
+    auto first = snapshots.save();
+    auto stored = snapshots.pages().size();
+    REQUIRE(snapshots.get(first).pages_copied > 0);
+    // A snapshot of an unchanged process adds no page
+    auto unchanged = snapshots.save();
+    REQUIRE(snapshots.pages().size() == stored);
+    REQUIRE(snapshots.diff(first, unchanged).empty());
+
+    std::uint64_t new_value = 0x1234;
+    proc->write_memory(virt_addr{a_pointer}, {as_bytes(new_value), sizeof(new_value)});
+    auto changed = snapshots.save();
+    REQUIRE(snapshots.pages().size() == stored + 1);
+    auto changes = snapshots.diff(unchanged, changed);
+    REQUIRE(changes.size() == 1);
+    REQUIRE(changes[0].type == snapshot_change::kind::modified);
+    REQUIRE(changes[0].start.addr() == (a_pointer & ~std::uint64_t(0xfff)));
+    REQUIRE(changes[0].size == 0x1000);
+}
+
+TEST_CASE("Snapshots share pages of regions whose bounds changed", "[memory]") {
+    bool close_on_exec = false;
+    jdb::pipe channel(close_on_exec);
+    auto proc = process::launch("test/targets/split_mapping", true, channel.get_write());
+    channel.close_write();
+    proc->resume();
+    proc->wait_on_signal();
+    auto pages = from_bytes<std::uint64_t>(channel.read().data());
+
+    snapshot_store snapshots(*proc);
+    auto whole = snapshots.save();
+    proc->resume();
+    proc->wait_on_signal();
+    auto split = snapshots.save();
+
+    // Only the middle pages, now read-only, are gone
+    auto changes = snapshots.diff(whole, split);
+    auto middle = std::find_if(changes.begin(), changes.end(), [&](auto &change) {
+        return change.start.addr() == pages + 6 * 0x1000;
+    });
+    REQUIRE(middle != changes.end());
+    REQUIRE(middle->type == snapshot_change::kind::removed);
+    REQUIRE(middle->size == 4 * 0x1000);
+    for (auto &change : changes) {
+        bool in_mapping = change.start.addr() < pages + 16 * 0x1000 &&
+                          change.start.addr() + change.size > pages;
+        REQUIRE((!in_mapping || &change == &*middle));
+    }
+    // The twelve pages left weren't written, so they aren't copied again
+    if (snapshots.tracks_dirty_pages()) {
+        REQUIRE(snapshots.get(split).pages_copied < 12);
+    }
+}
+
+TEST_CASE("Memory maps are parsed once and looked up by address", "[memory]") {
+    bool close_on_exec = false;
+    jdb::pipe channel(close_on_exec);
+    auto proc = process::launch("test/targets/memory", true, channel.get_write());
+    channel.close_write();
+    proc->resume();
+    proc->wait_on_signal();
+    auto a_pointer = virt_addr{from_bytes<std::uint64_t>(channel.read().data())};
+
+    auto &map = proc->get_memory_map();
+    auto regions = map.regions();
+    REQUIRE(!regions.empty());
+    REQUIRE(std::is_sorted(regions.begin(), regions.end(),
+                           [](auto &lhs, auto &rhs) { return lhs.end <= rhs.start; }));
+
+    auto stack = map.find(a_pointer);
+    REQUIRE(stack);
+    REQUIRE(stack->readable);
+    REQUIRE(stack->writable);
+    REQUIRE(stack->name == "[stack]");
+    auto code = map.find(proc->get_pc());
+    REQUIRE(code);
+    REQUIRE(code->executable);
+    REQUIRE(!map.find(virt_addr{0}));
+
+    auto in_range = map.regions_in(stack->start - 1, stack->end);
+    REQUIRE(in_range.size() >= 1);
+    REQUIRE(in_range[in_range.size() - 1].start == stack->start);
+    REQUIRE(map.regions_in(virt_addr{0}, virt_addr{0x1000}).empty());
+
+    // Nothing ran since, so the table is reused
+    auto loads = map.loads();
+    REQUIRE(proc->get_memory_map().loads() == loads);
+    proc->invalidate_memory_map();
+    REQUIRE(proc->get_memory_map().loads() == loads + 1);
+}
+
+TEST_CASE("Memory maps are reloaded once the mappings may have changed", "[memory]") {
+    constexpr std::uint64_t page_size = 0x1000;
+    std::vector<int> mapping_syscalls = {SYS_mmap, SYS_munmap, SYS_mprotect, SYS_mremap,
+                                         SYS_brk,  SYS_shmat,  SYS_shmdt};
+    for (auto traced : {false, true}) {
+        bool close_on_exec = false;
+        jdb::pipe channel(close_on_exec);
+        auto proc = process::launch("test/targets/split_mapping", true, channel.get_write(),
+                                    traced ? mapping_syscalls : std::vector<int>{});
+        channel.close_write();
+        // The loader's and libc's own mappings stop the traced process on the way
+        proc->resume();
+        auto reason = proc->wait_on_signal();
+        while (reason.trap_reason == trap_type::syscall) {
+            proc->resume();
+            reason = proc->wait_on_signal();
+        }
+        auto pages = virt_addr{from_bytes<std::uint64_t>(channel.read().data())};
+        auto middle = pages + 6 * page_size;
+        REQUIRE(proc->get_memory_map().find(middle)->writable);
+        auto loads = proc->get_memory_map().loads();
+
+        if (traced) {
+            // Nothing changes before the mprotect returns
+            proc->resume();
+            reason = proc->wait_on_signal();
+            REQUIRE(reason.syscall_info->id == SYS_mprotect);
+            REQUIRE(reason.syscall_info->entry);
+            REQUIRE(proc->get_memory_map().loads() == loads);
+        }
+        proc->resume();
+        reason = proc->wait_on_signal();
+        REQUIRE(proc->get_memory_map().loads() == loads + 1);
+        REQUIRE(!proc->get_memory_map().find(middle)->writable);
+    }
+}
+
+TEST_CASE("find_in_buffer agrees with a plain search", "[memory]") {
+    // Few distinct values, so partial matches are common. The sizes cover the vector loop, the
+    // scalar tail and needles longer than a vector.
+    std::vector<std::byte> haystack(1000);
+    std::uint32_t state = 12345;
+    for (auto &byte : haystack) {
+        state = state * 1103515245 + 12345;
+        byte = std::byte((state >> 16) % 3);
+    }
+    for (std::size_t size : {1, 2, 3, 5, 17, 40}) {
+        for (std::size_t at : {0, 31, 500}) {
+            std::vector<std::byte> needle(haystack.begin() + at, haystack.begin() + at + size);
+            std::vector<std::size_t> expected;
+            for (std::size_t i = 0; i + size <= haystack.size(); ++i) {
+                if (std::equal(needle.begin(), needle.end(), haystack.begin() + i))
+                    expected.push_back(i);
+            }
+            std::vector<std::size_t> offsets;
+            find_in_buffer(haystack, needle, offsets);
+            REQUIRE(offsets == expected);
+        }
+    }
+}
+
+TEST_CASE("memory_searcher finds values in the process", "[memory]") {
+    bool close_on_exec = false;
+    jdb::pipe channel(close_on_exec);
+    auto proc = process::launch("test/targets/memory", true, channel.get_write());
+    channel.close_write();
+    proc->resume();
+    proc->wait_on_signal();
+    auto a_pointer = virt_addr{from_bytes<std::uint64_t>(channel.read().data())};
+
+    // A value no optimized code would keep a copy of
+    std::uint64_t value = 0x0123456789abcdef;
+    proc->write_memory(a_pointer, {as_bytes(value), sizeof(value)});
+
+    memory_searcher searcher(*proc);
+    auto matches = searcher.find({as_bytes(value), sizeof(value)}, virt_addr{0},
+                                 virt_addr{~std::uint64_t(0)}, 8);
+    REQUIRE(std::find(matches.begin(), matches.end(), a_pointer) != matches.end());
+    REQUIRE(std::is_sorted(matches.begin(), matches.end()));
+    REQUIRE(searcher.bytes_scanned() > 0);
+
+    // Matches are reported where they start, and only within the range
+    auto tail = searcher.find({as_bytes(value) + 4, 4}, a_pointer, a_pointer + 8);
+    REQUIRE(tail == std::vector<virt_addr>{a_pointer + 4});
+    REQUIRE(searcher.find({as_bytes(value), sizeof(value)}, a_pointer + 1, a_pointer + 8).empty());
+    // Misaligned matches don't count
+    REQUIRE(searcher.find({as_bytes(value) + 4, 4}, a_pointer, a_pointer + 8, 8).empty());
+}
+
+TEST_CASE("encode_hex writes two digits per byte", "[memory]") {
+    // Every byte value, and a tail shorter than a vector
+    std::vector<std::byte> data(256 + 7);
+    for (std::size_t i = 0; i < data.size(); ++i) {
+        data[i] = std::byte(i);
+    }
+    std::string expected;
+    for (auto byte : data) {
+        expected += "0123456789abcdef"[std::to_integer<int>(byte) >> 4];
+        expected += "0123456789abcdef"[std::to_integer<int>(byte) & 0xf];
+    }
+    std::string out(2 * data.size(), ' ');
+    encode_hex(data, out.data());
+    REQUIRE(out == expected);
+}
+
+TEST_CASE("Memory dumps stream to a file", "[memory]") {
+    bool close_on_exec = false;
+    jdb::pipe channel(close_on_exec);
+    auto proc = process::launch("test/targets/memory", true, channel.get_write());
+    channel.close_write();
+    proc->resume();
+    proc->wait_on_signal();
+    auto a_pointer = virt_addr{from_bytes<std::uint64_t>(channel.read().data())};
+    std::uint64_t value = 0x0123456789abcdef;
+    proc->write_memory(a_pointer, {as_bytes(value), sizeof(value)});
+
+    auto path = std::filesystem::temp_directory_path() / "jdb_dump_test";
+    auto read_file = [&] {
+        std::ifstream file(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(file), {});
+    };
+
+    // The whole stack, in chunks small enough to go around both buffers many times
+    auto stack = *proc->get_memory_map().find(a_pointer);
+    auto stats = dump_memory(*proc, stack.start, stack.size(), path, dump_format::raw, 4096);
+    auto memory = proc->read_memory(stack.start, stack.size());
+    REQUIRE(stats.bytes_read == stack.size());
+    REQUIRE(stats.bytes_unreadable == 0);
+    REQUIRE(read_file() == std::string(reinterpret_cast<const char *>(memory.data()), memory.size()));
+
+    dump_memory(*proc, a_pointer, sizeof(value), path, dump_format::hex);
+    char address[17];
+    std::snprintf(address, sizeof(address), "%016lx", a_pointer.addr());
+    REQUIRE(read_file() == std::string(address) + ": efcdab8967452301\n");
+
+    // Software breakpoints don't show
+    auto text = proc->get_memory_map().find(proc->get_pc());
+    auto &site = proc->create_breakpoint_site(text->start + 16);
+    site.enable();
+    dump_memory(*proc, text->start, 64, path, dump_format::raw);
+    auto original = proc->read_memory_without_traps(text->start, 64);
+    REQUIRE(read_file() == std::string(reinterpret_cast<const char *>(original.data()), 64));
+
+    // Pages that can't be read come out as zeros
+    stats = dump_memory(*proc, virt_addr{0}, 100, path, dump_format::raw);
+    REQUIRE(stats.bytes_unreadable == 100);
+    REQUIRE(read_file() == std::string(100, '\0'));
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Checkpoints restart the process where they were taken", "[checkpoint]") {
+    bool close_on_exec = false;
+    jdb::pipe channel(close_on_exec);
+    auto proc = process::launch("test/targets/memory", true, channel.get_write());
+    channel.close_write();
+    proc->resume();
+    proc->wait_on_signal();
+    auto a_pointer = from_bytes<std::uint64_t>(channel.read().data());
+    auto original_pid = proc->pid();
+    auto pc = proc->get_pc();
+
+    auto index = proc->create_checkpoint();
+    REQUIRE(proc->checkpoints().size() == 1);
+    REQUIRE(proc->checkpoints()[index].pid != original_pid);
+    // Forking left the process itself as it was
+    REQUIRE(proc->get_pc() == pc);
+    REQUIRE(proc->read_memory_as<std::uint64_t>(virt_addr{a_pointer}) == 0xcafecafe);
+
+    std::uint64_t new_value = 0x1234;
+    proc->write_memory(virt_addr{a_pointer}, {as_bytes(new_value), sizeof(new_value)});
+
+    for (int i = 0; i < 2; ++i) {
+        proc->restart(index);
+        REQUIRE(proc->pid() != original_pid);
+        REQUIRE(process_exists(proc->pid()));
+        REQUIRE(proc->get_pc() == pc);
+        REQUIRE(proc->read_memory_as<std::uint64_t>(virt_addr{a_pointer}) == 0xcafecafe);
+
+        // The fork carries on from there, up to the next raise(SIGTRAP)
+        proc->resume();
+        auto reason = proc->wait_on_signal();
+        REQUIRE(reason.reason == process_state::stopped);
+        REQUIRE(reason.info == SIGTRAP);
+        REQUIRE(channel.read().size() == 8);
+    }
+    REQUIRE(!process_exists(original_pid));
+}
+
+TEST_CASE("Can create breakpoint site", "[breakpoint]") {
+    auto proc = process::launch("test/targets/run_endlessly");
+    auto &site = proc->create_breakpoint_site(virt_addr{42});
+    REQUIRE(site.address().addr() == 42);
+    REQUIRE(!site.is_enabled());
+}
+
+TEST_CASE("Breakpoint site ids increase", "[breakpoint]") {
+    auto proc = process::launch("test/targets/run_endlessly");
+
+    auto &s1 = proc->create_breakpoint_site(virt_addr{42});
+    auto &s2 = proc->create_breakpoint_site(virt_addr{43});
+    REQUIRE(s2.id() == s1.id() + 1);
+
+    REQUIRE_THROWS_AS(proc->create_breakpoint_site(virt_addr{42}), error);
+}
+
+TEST_CASE("Can find and remove breakpoint sites", "[breakpoint]") {
+    auto proc = process::launch("test/targets/run_endlessly");
+    auto &sites = proc->breakpoint_sites();
+
+    auto &s1 = proc->create_breakpoint_site(virt_addr{42});
+    auto s1_id = s1.id();
+    proc->create_breakpoint_site(virt_addr{43});
+    proc->create_breakpoint_site(virt_addr{44});
+
+    REQUIRE(sites.size() == 3);
+    REQUIRE(sites.contains_address(virt_addr{43}));
+    REQUIRE(!sites.contains_address(virt_addr{45}));
+    REQUIRE(sites.get_by_id(s1_id).address().addr() == 42);
+    REQUIRE(sites.get_by_address(virt_addr{44}).id() == s1_id + 2);
+    REQUIRE_THROWS_AS(sites.get_by_id(s1_id + 3), error);
+    REQUIRE(sites.get_in_region(virt_addr{43}, virt_addr{100}).size() == 2);
+
+    sites.remove_by_id(s1_id);
+    sites.remove_by_address(virt_addr{44});
+    REQUIRE(sites.size() == 1);
+    REQUIRE(!sites.contains_id(s1_id));
+    REQUIRE(sites.get_by_id(s1_id + 1).address().addr() == 43);
+}
+
+TEST_CASE("Breakpoint sites are hit and stepped over", "[breakpoint]") {
+    bool close_on_exec = false;
+    jdb::pipe channel(close_on_exec);
+    auto proc = process::launch("test/targets/breakpoint", true, channel.get_write());
+    channel.close_write();
+
+    proc->resume();
+    proc->wait_on_signal();
+
+    auto function = virt_addr{from_bytes<std::uint64_t>(channel.read().data())};
+    proc->create_breakpoint_site(function).enable();
+
+    for (int i = 0; i < 2; ++i) {
+        proc->resume();
+        auto reason = proc->wait_on_signal();
+        REQUIRE(reason.reason == process_state::stopped);
+        REQUIRE(reason.info == SIGTRAP);
+        REQUIRE(reason.trap_reason == trap_type::software_break);
+        REQUIRE(proc->get_pc() == function);
+    }
+
+    proc->resume();
+    auto reason = proc->wait_on_signal();
+    REQUIRE(reason.reason == process_state::exited);
+    REQUIRE(reason.info == 0);
+
+    auto output = channel.read();
+    REQUIRE(to_string_view(output) ==
+            "Putting pepperoni on pizza...\nPutting pepperoni on pizza...\n");
+}
+
+TEST_CASE("Breakpoint sites are patched in bulk", "[breakpoint]") {
+    bool close_on_exec = false;
+    jdb::pipe channel(close_on_exec);
+    auto proc = process::launch("test/targets/breakpoint", true, channel.get_write());
+    channel.close_write();
+
+    proc->resume();
+    proc->wait_on_signal();
+
+    auto function = virt_addr{from_bytes<std::uint64_t>(channel.read().data())};
+    auto original = proc->read_memory(function, 16);
+
+    std::vector<breakpoint_site *> sites;
+    for (int i = 0; i < 16; ++i) {
+        sites.push_back(&proc->create_breakpoint_site(function + i));
+    }
+
+    proc->set_breakpoint_sites_enabled(sites, true);
+    REQUIRE(proc->read_memory(function, 16) == std::vector<std::byte>(16, std::byte{0xcc}));
+    REQUIRE(proc->read_memory_without_traps(function, 16) == original);
+
+    proc->set_breakpoint_sites_enabled(sites, false);
+    REQUIRE(proc->read_memory(function, 16) == original);
+    for (auto site : sites) {
+        REQUIRE(!site->is_enabled());
+    }
+}
+
+TEST_CASE("Can step a single instruction", "[breakpoint]") {
+    auto proc = process::launch("test/targets/breakpoint");
+    auto pc = proc->get_pc();
+    proc->create_breakpoint_site(pc).enable();
+
+    auto reason = proc->step_instruction();
+    REQUIRE(reason.reason == process_state::stopped);
+    REQUIRE(reason.trap_reason == trap_type::single_step);
+    REQUIRE(proc->get_pc() != pc);
+    REQUIRE(proc->breakpoint_sites().get_by_address(pc).is_enabled());
+}
+
+TEST_CASE("Hardware breakpoint sites are hit", "[breakpoint]") {
+    bool close_on_exec = false;
+    jdb::pipe channel(close_on_exec);
+    auto proc = process::launch("test/targets/breakpoint", true, channel.get_write());
+    channel.close_write();
+
+    proc->resume();
+    proc->wait_on_signal();
+
+    auto function = virt_addr{from_bytes<std::uint64_t>(channel.read().data())};
+    auto original = proc->read_memory(function, 1);
+    auto &site = proc->create_breakpoint_site(function, true);
+    site.enable();
+    // Hardware sites leave the code untouched
+    REQUIRE(proc->read_memory(function, 1) == original);
+
+    for (int i = 0; i < 2; ++i) {
+        proc->resume();
+        auto reason = proc->wait_on_signal();
+        REQUIRE(reason.trap_reason == trap_type::hardware_break);
+        REQUIRE(proc->get_pc() == function);
+        REQUIRE(std::get<0>(proc->get_current_hardware_stoppoint()) == site.id());
+    }
+
+    site.disable();
+    proc->resume();
+    REQUIRE(proc->wait_on_signal().reason == process_state::exited);
+}
+
+TEST_CASE("Watchpoints detect writes", "[watchpoint]") {
+    bool close_on_exec = false;
+    jdb::pipe channel(close_on_exec);
+    auto proc = process::launch("test/targets/watchpoint", true, channel.get_write());
+    channel.close_write();
+
+    proc->resume();
+    proc->wait_on_signal();
+
+    auto address = virt_addr{from_bytes<std::uint64_t>(channel.read().data())};
+    auto &point = proc->create_watchpoint(address, stoppoint_mode::write, 8);
+    point.enable();
+
+    proc->resume();
+    auto reason = proc->wait_on_signal();
+    REQUIRE(reason.trap_reason == trap_type::hardware_break);
+    REQUIRE(std::get<1>(proc->get_current_hardware_stoppoint()) == point.id());
+    REQUIRE(point.previous_data() == 0);
+    REQUIRE(point.data() == 42);
+
+    proc->resume();
+    proc->wait_on_signal();
+    REQUIRE(point.previous_data() == 42);
+    REQUIRE(point.data() == 43);
+
+    proc->resume();
+    REQUIRE(proc->wait_on_signal().reason == process_state::exited);
+}
+
+TEST_CASE("Watchpoints are reported while single stepping", "[watchpoint]") {
+    bool close_on_exec = false;
+    jdb::pipe channel(close_on_exec);
+    auto proc = process::launch("test/targets/watchpoint", true, channel.get_write());
+    channel.close_write();
+
+    proc->resume();
+    proc->wait_on_signal();
+    auto address = virt_addr{from_bytes<std::uint64_t>(channel.read().data())};
+    auto &point = proc->create_watchpoint(address, stoppoint_mode::write, 8);
+    point.enable();
+
+    // Out of raise and on to the first write
+    auto reason = proc->step_instruction();
+    for (int i = 0; i < 10000 && reason.trap_reason == trap_type::single_step; ++i) {
+        reason = proc->step_instruction();
+    }
+    REQUIRE(reason.trap_reason == trap_type::hardware_break);
+    REQUIRE(point.data() == 42);
+}
+
+TEST_CASE("Hardware stoppoint slots are allocated and released", "[watchpoint]") {
+    auto proc = process::launch("test/targets/watchpoint");
+    auto base = proc->get_pc().addr() & ~std::uint64_t{0xfff};
+
+    REQUIRE_THROWS_AS(proc->create_watchpoint(virt_addr{base + 1}, stoppoint_mode::write, 8),
+                      error);
+    REQUIRE_THROWS_AS(proc->create_watchpoint(virt_addr{base}, stoppoint_mode::execute, 8),
+                      error);
+
+    std::vector<watchpoint *> points;
+    for (int i = 0; i < 4; ++i) {
+        points.push_back(
+            &proc->create_watchpoint(virt_addr{base + i * 8}, stoppoint_mode::read_write, 8));
+        points.back()->enable();
+    }
+
+    auto &fifth = proc->create_watchpoint(virt_addr{base + 32}, stoppoint_mode::write, 4);
+    REQUIRE_THROWS_AS(fifth.enable(), error);
+
+    points[2]->disable();
+    fifth.enable();
+    // Slot 2 was freed and reused: R/W = 01 (write), LEN = 11 (4 bytes), local enable set
+    auto dr7 = proc->get_registers().read_by_id_as<std::uint64_t>(register_id::dr7);
+    REQUIRE(((dr7 >> 24) & 0b1111) == 0b1101);
+    REQUIRE((dr7 & (1 << 4)) != 0);
+    REQUIRE(proc->get_registers().read_by_id_as<std::uint64_t>(register_id::dr2) == base + 32);
+}
+
+TEST_CASE("process::poll_stop times out", "[event_loop]") {
+    auto proc = process::launch("test/targets/run_endlessly");
+    proc->resume();
+
+    REQUIRE(!proc->poll_stop(std::chrono::milliseconds(0)));
+    REQUIRE(!proc->poll_stop(std::chrono::milliseconds(50)));
+
+    kill(proc->pid(), SIGSTOP);
+    auto reason = proc->poll_stop(std::chrono::milliseconds(5000));
+    REQUIRE(reason);
+    REQUIRE(reason->reason == process_state::stopped);
+    REQUIRE(reason->info == SIGSTOP);
+}
+
+TEST_CASE("event_loop dispatches stops of many processes", "[event_loop]") {
+    std::vector<std::unique_ptr<process>> procs;
+    for (int i = 0; i < 4; ++i) {
+        procs.push_back(process::launch("test/targets/end_immediately"));
+    }
+
+    event_loop loop;
+    std::vector<pid_t> exited;
+    for (auto &proc : procs) {
+        loop.add(*proc, [&](process &proc, stop_reason reason) {
+            if (reason.reason == process_state::exited) {
+                exited.push_back(proc.pid());
+            } else {
+                proc.resume();
+            }
+        });
+        proc->resume();
+    }
+
+    loop.run();
+    REQUIRE(exited.size() == procs.size());
+    REQUIRE(loop.run_once(std::chrono::milliseconds(10)) == 0);
+}
+
+TEST_CASE("Threads are tracked and stopped together", "[thread]") {
+    bool close_on_exec = false;
+    jdb::pipe channel(close_on_exec);
+    auto proc = process::launch("test/targets/multi_threaded", true, channel.get_write());
+    channel.close_write();
+
+    proc->resume();
+    proc->wait_on_signal();
+    REQUIRE(proc->thread_states().size() == 1);
+
+    auto function = virt_addr{from_bytes<std::uint64_t>(channel.read().data())};
+    proc->create_breakpoint_site(function).enable();
+
+    // Every thread reports its own hit, while all the others are stopped
+    std::set<pid_t> hit_by;
+    for (int i = 0; i < 8; ++i) {
+        proc->resume();
+        auto reason = proc->wait_on_signal();
+        REQUIRE(reason.reason == process_state::stopped);
+        REQUIRE(reason.trap_reason == trap_type::software_break);
+        REQUIRE(reason.tid != proc->pid());
+        REQUIRE(proc->current_thread() == reason.tid);
+        REQUIRE(proc->get_pc() == function);
+        REQUIRE(proc->get_pc(reason.tid) == function);
+        REQUIRE(proc->thread_states().count(proc->pid()) == 1);
+        for (auto &[tid, thread] : proc->thread_states()) {
+            REQUIRE(thread.state == process_state::stopped);
+        }
+        hit_by.insert(reason.tid);
+    }
+    REQUIRE(hit_by.size() == 8);
+
+    proc->set_current_thread(proc->pid());
+    REQUIRE_THROWS_AS(proc->set_current_thread(-1), error);
+
+    proc->resume();
+    auto reason = proc->wait_on_signal();
+    REQUIRE(reason.reason == process_state::exited);
+    REQUIRE(reason.info == 0);
+}
+
+TEST_CASE("Stops caught by an all-stop are reported and their signals delivered", "[process]") {
+    auto proc = process::launch("test/targets/thread_signal");
+    proc->resume();
+    auto reason = proc->wait_on_signal();
+    REQUIRE(reason.info == SIGTRAP);
+    REQUIRE(proc->thread_states().size() == 2);
+    auto worker = std::find_if(proc->thread_states().begin(), proc->thread_states().end(),
+                               [&](auto &entry) { return entry.first != proc->pid(); })
+                      ->first;
+
+    // The worker stops for its signal as the main thread raises SIGTRAP. Both are reported, in
+    // whichever order they come in.
+    REQUIRE(tgkill(proc->pid(), worker, SIGUSR1) == 0);
+    std::set<std::pair<pid_t, int>> stops;
+    for (int i = 0; i < 2; ++i) {
+        proc->resume();
+        reason = proc->wait_on_signal();
+        REQUIRE(reason.reason == process_state::stopped);
+        REQUIRE(proc->current_thread() == reason.tid);
+        stops.emplace(reason.tid, reason.info);
+    }
+    REQUIRE(stops == std::set<std::pair<pid_t, int>>{{proc->pid(), SIGTRAP}, {worker, SIGUSR1}});
+
+    // The handler only runs if the signal was passed on
+    proc->resume();
+    reason = proc->wait_on_signal();
+    REQUIRE(reason.reason == process_state::exited);
+    REQUIRE(reason.info == 0);
+}
+
+TEST_CASE("Trace files round trip through the ring", "[trace]") {
+    auto path = std::filesystem::temp_directory_path() / "jdb_ring_test.trace";
+    std::vector<std::uint64_t> pcs;
+    for (std::uint64_t i = 0; i < 1000; ++i) {
+        // Short forward steps, with the occasional jump back and jump far away
+        auto previous = pcs.empty() ? 0x401000 : pcs.back();
+        pcs.push_back(i % 7 == 0 ? previous - 0x40 : i % 97 == 0 ? ~previous : previous + i % 15);
+    }
+    {
+        trace_writer out(path, 4, 64);
+        for (auto pc : pcs) {
+            out.append(pc);
+        }
+        REQUIRE(out.records_written() == pcs.size());
+    }
+
+    trace_reader trace(path);
+    REQUIRE(trace.records_written() == pcs.size());
+    // Four 64 byte blocks only hold the end of the trace
+    REQUIRE(trace.size() > 0);
+    REQUIRE(trace.size() < pcs.size());
+    std::vector<std::uint64_t> decoded;
+    trace.for_each([&](std::uint64_t pc) { decoded.push_back(pc); });
+    REQUIRE(decoded.size() == trace.size());
+    REQUIRE(std::equal(decoded.begin(), decoded.end(), pcs.end() - decoded.size()));
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("trace_instructions records every PC", "[trace]") {
+    auto path = std::filesystem::temp_directory_path() / "jdb_process_test.trace";
+    std::vector<std::uint64_t> pcs;
+    {
+        auto proc = process::launch("test/targets/end_immediately");
+        auto start = proc->get_pc();
+        trace_writer out(path);
+        auto reason = trace_instructions(*proc, out, 50);
+        REQUIRE(out.records_written() == 50);
+        REQUIRE(reason->trap_reason == trap_type::single_step);
+
+        trace_reader trace(path);
+        trace.for_each([&](std::uint64_t pc) { pcs.push_back(pc); });
+        REQUIRE(pcs.size() == 50);
+        REQUIRE(pcs[0] == start.addr());
+    }
+    {
+        // Tracing until an address stops right before executing it
+        // The first instructions are all in the dynamic loader, which may load elsewhere this time
+        auto proc = process::launch("test/targets/end_immediately");
+        auto first_hit = std::find(pcs.begin(), pcs.end(), pcs[30]) - pcs.begin();
+        auto until = pcs[30] - pcs[0] + proc->get_pc().addr();
+        trace_writer out(path);
+        trace_instructions(*proc, out, 1000, virt_addr{until});
+        REQUIRE(out.records_written() == static_cast<std::uint64_t>(first_hit));
+        REQUIRE(proc->get_pc().addr() == until);
+    }
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("stack_table interns stacks", "[profiler]") {
+    stack_table stacks;
+    std::uint64_t first[] = {0x10, 0x20, 0x30};
+    std::uint64_t second[] = {0x10, 0x20};
+
+    auto id = stacks.add({first, 3});
+    REQUIRE(stacks.add({second, 2}) != id);
+    REQUIRE(stacks.add({first, 3}, 2) == id);
+    REQUIRE(stacks.size() == 2);
+    REQUIRE(stacks.total_samples() == 4);
+    REQUIRE(stacks.count(id) == 3);
+    REQUIRE(stacks.frames(id).size() == 3);
+    REQUIRE(stacks.frames(id)[2] == 0x30);
+
+    // Enough stacks to grow the slot table a few times
+    for (std::uint64_t i = 0; i < 1000; ++i) {
+        std::uint64_t frames[] = {0x1000 + i, 0x20};
+        stacks.add({frames, 2});
+        stacks.add({frames, 2});
+    }
+    REQUIRE(stacks.size() == 1002);
+    REQUIRE(stacks.count(id) == 3);
+
+    stack_table folded;
+    folded.add({first, 3}, 5);
+    std::ostringstream out;
+    folded.write_folded(out);
+    REQUIRE(out.str() == "0x30;0x20;0x10 5\n");
+}
+
+TEST_CASE("sampling_profiler walks frame pointers", "[profiler]") {
+    bool close_on_exec = false;
+    jdb::pipe channel(close_on_exec);
+    auto target = process::launch("test/targets/call_chain", false, channel.get_write());
+    channel.close_write();
+    auto addresses = channel.read();
+    auto inner = from_bytes<std::uint64_t>(addresses.data());
+    auto outer = from_bytes<std::uint64_t>(addresses.data() + 8);
+
+    auto proc = process::seize(target->pid());
+    sampling_profiler profiler(*proc);
+    auto samples = profiler.run(200, std::chrono::milliseconds(200));
+    REQUIRE(samples > 0);
+    REQUIRE(proc->state() == process_state::running);
+
+    auto &stacks = profiler.stacks();
+    REQUIRE(stacks.total_samples() == samples);
+    // Apart from the few taken before the target reaches it, samples land in inner, called from
+    // outer, called from main
+    std::uint64_t in_inner = 0;
+    for (stack_table::id_type id = 0; id < stacks.size(); ++id) {
+        auto frames = stacks.frames(id);
+        if (frames[0] < inner || frames[0] >= inner + 0x40)
+            continue;
+        REQUIRE(frames.size() >= 3);
+        REQUIRE(frames[1] > outer);
+        REQUIRE(frames[1] < outer + 0x40);
+        in_inner += stacks.count(id);
+    }
+    REQUIRE(in_inner * 2 > samples);
+}
+
+TEST_CASE("sampling_profiler passes on the signals it catches", "[profiler]") {
+    auto proc = process::launch("test/targets/thread_signal");
+    proc->resume();
+    proc->wait_on_signal();
+    auto worker = std::find_if(proc->thread_states().begin(), proc->thread_states().end(),
+                               [&](auto &entry) { return entry.first != proc->pid(); })
+                      ->first;
+    REQUIRE(tgkill(proc->pid(), worker, SIGUSR1) == 0);
+    proc->resume();
+
+    // The worker's signal, and maybe the main thread's SIGTRAP, can come in before the interrupt
+    sampling_profiler profiler(*proc);
+    REQUIRE(profiler.sample());
+    // One stack per thread
+    REQUIRE(profiler.stacks().total_samples() == 2);
+    REQUIRE(proc->state() == process_state::running);
+
+    auto reason = proc->wait_on_signal();
+    while (reason.reason == process_state::stopped) {
+        proc->resume();
+        reason = proc->wait_on_signal();
+    }
+    // The target only exits with 0 once the worker has handled the signal
+    REQUIRE(reason.reason == process_state::exited);
+    REQUIRE(reason.info == 0);
+}
+
+TEST_CASE("Backtraces unwind with CFI and cache the rules", "[unwind]") {
+    bool close_on_exec = false;
+    jdb::pipe channel(close_on_exec);
+    auto proc = process::launch("test/targets/call_chain", true, channel.get_write());
+    channel.close_write();
+    // libc's frames are unwound with its own CFI
+    proc->track_shared_libraries();
+    auto &file = proc->get_elf();
+    REQUIRE(!file.get_call_frame_info().empty());
+    auto inner = file.symbols_by_name("_Z5innerv").front().address;
+    auto outer = file.symbols_by_name("_Z5outerv").front().address;
+
+    // At the first instruction of inner, rbp still holds outer's frame, so a frame pointer walk
+    // would skip outer. The CFI knows better.
+    proc->create_breakpoint_site(inner).enable();
+    proc->resume();
+    proc->wait_on_signal();
+    auto frames = proc->backtrace();
+    REQUIRE(frames.size() >= 4);
+    REQUIRE(frames[0] == inner);
+    REQUIRE(proc->symbol_containing_address(frames[1])->address == outer);
+    REQUIRE(proc->symbol_containing_address(frames[2])->name == "main");
+    // _start marks its return address undefined, which ends the walk
+    auto outermost = proc->symbol_containing_address(frames.back());
+    REQUIRE(outermost);
+    REQUIRE(outermost->name == "_start");
+
+    auto &unwinder = proc->get_unwinder();
+    unwinder.reset_stats();
+    REQUIRE(proc->backtrace() == frames);
+    REQUIRE(unwinder.get_stats().misses == 0);
+    REQUIRE(unwinder.get_stats().hits == frames.size());
+
+    // Rows hold over a range, which starts a new row where it ends
+    auto &cfi = file.get_call_frame_info();
+    auto main_address = file.to_file_addr(file.symbols_by_name("main").front().address);
+    auto row = cfi.row_at(main_address);
+    REQUIRE(row);
+    REQUIRE(row->start == main_address);
+    REQUIRE(row->end > row->start);
+    REQUIRE(cfi.row_at(row->end - 1)->start == row->start);
+    auto next = cfi.row_at(row->end);
+    REQUIRE(next);
+    REQUIRE(next->start == row->end);
+}
+
+TEST_CASE("perf_profiler samples without stopping the process", "[profiler]") {
+    bool close_on_exec = false;
+    jdb::pipe channel(close_on_exec);
+    auto target = process::launch("test/targets/call_chain", false, channel.get_write());
+    channel.close_write();
+    auto addresses = channel.read();
+    auto inner = from_bytes<std::uint64_t>(addresses.data());
+    auto outer = from_bytes<std::uint64_t>(addresses.data() + 8);
+
+    perf_profiler profiler(target->pid(), 999);
+    auto samples = profiler.run(std::chrono::milliseconds(300));
+    REQUIRE(samples > 0);
+
+    auto &stacks = profiler.stacks();
+    REQUIRE(stacks.total_samples() == samples);
+    std::uint64_t in_inner = 0;
+    for (stack_table::id_type id = 0; id < stacks.size(); ++id) {
+        auto frames = stacks.frames(id);
+        if (frames[0] < inner || frames[0] >= inner + 0x40)
+            continue;
+        REQUIRE(frames.size() >= 3);
+        REQUIRE(frames[1] > outer);
+        REQUIRE(frames[1] < outer + 0x40);
+        in_inner += stacks.count(id);
+    }
+    REQUIRE(in_inner * 2 > samples);
+}
+
+TEST_CASE("perf_profiler lets go of the rings of exited threads", "[profiler]") {
+    bool close_on_exec = false;
+    jdb::pipe channel(close_on_exec);
+    auto target = process::launch("test/targets/short_threads", false, channel.get_write());
+    channel.close_write();
+    channel.read();
+
+    auto perf_fds = [] {
+        std::size_t count = 0;
+        for (auto &entry : std::filesystem::directory_iterator("/proc/self/fd")) {
+            std::error_code ec;
+            auto link = std::filesystem::read_symlink(entry.path(), ec);
+            count += !ec && link.string().find("perf_event") != std::string::npos;
+        }
+        return count;
+    };
+    perf_profiler profiler(target->pid(), 999);
+    REQUIRE(perf_fds() == 5);
+    // Outlives the other threads by a few rescans
+    profiler.run(std::chrono::milliseconds(600));
+    REQUIRE(perf_fds() == 1);
+}
+
+TEST_CASE("elf indexes symbols by address and by name", "[elf]") {
+    elf file("test/targets/call_chain");
+    REQUIRE(file.header().e_type == ET_DYN);
+    REQUIRE(file.get_section(".text") != nullptr);
+    REQUIRE(file.get_section(".nothing") == nullptr);
+    REQUIRE(!file.get_section_contents(".text").empty());
+    REQUIRE(file.get_section_contents(".bss").empty());
+    REQUIRE(file.symbol_count() > 0);
+
+    auto inner = file.symbols_by_name("_Z5innerv");
+    REQUIRE(inner.size() == 1);
+    REQUIRE(inner[0].type == STT_FUNC);
+    REQUIRE(inner[0].size > 1);
+    REQUIRE(file.symbols_by_name("no_such_symbol").empty());
+
+    auto found = file.symbol_containing_address(inner[0].address + 1);
+    REQUIRE(found);
+    REQUIRE(found->name == "_Z5innerv");
+    REQUIRE(found->address == inner[0].address);
+    REQUIRE(!file.symbol_containing_address(virt_addr{0}));
+}
+
+TEST_CASE("process::get_elf accounts for the load bias", "[elf]") {
+    bool close_on_exec = false;
+    jdb::pipe channel(close_on_exec);
+    auto proc = process::launch("test/targets/call_chain", true, channel.get_write());
+    proc->resume();
+    channel.close_write();
+    auto addresses = channel.read();
+    auto inner = virt_addr{from_bytes<std::uint64_t>(addresses.data())};
+
+    auto &file = proc->get_elf();
+    REQUIRE(file.load_bias() != 0);
+    REQUIRE(file.symbols_by_name("_Z5innerv").at(0).address == inner);
+    auto found = file.symbol_containing_address(inner + 4);
+    REQUIRE(found);
+    REQUIRE(found->name == "_Z5innerv");
+}
+
+TEST_CASE("Symbol indexes are cached by build-id", "[elf]") {
+    auto cache = std::filesystem::temp_directory_path() / "jdb_index_test";
+    std::filesystem::remove_all(cache);
+    auto old_cache = std::getenv("XDG_CACHE_HOME");
+    std::string saved = old_cache ? old_cache : "";
+    setenv("XDG_CACHE_HOME", cache.c_str(), true);
+
+    std::vector<elf_symbol> built;
+    {
+        elf file("test/targets/call_chain");
+        REQUIRE(!file.build_id().empty());
+        REQUIRE(!file.symbols_from_cache());
+        built = file.symbols_by_name("_Z5innerv");
+        REQUIRE(built.size() == 1);
+    }
+    auto entries = std::distance(std::filesystem::directory_iterator(cache / "jdb"),
+                                 std::filesystem::directory_iterator());
+    REQUIRE(entries == 1);
+
+    {
+        elf file("test/targets/call_chain");
+        REQUIRE(file.symbols_from_cache());
+        auto cached = file.symbols_by_name("_Z5innerv");
+        REQUIRE(cached.size() == 1);
+        REQUIRE(cached[0].address == built[0].address);
+        REQUIRE(cached[0].size == built[0].size);
+        REQUIRE(file.symbol_containing_address(built[0].address + 1)->name == "_Z5innerv");
+    }
+
+    // Indexes of another version, of another symbol table of the same build (as a stripped copy
+    // has), or with offsets or an order lookups can't trust are rebuilt and replaced
+    auto path = std::filesystem::directory_iterator(cache / "jdb")->path();
+    auto patch = [&](std::size_t offset, auto value) {
+        std::fstream index(path, std::ios::binary | std::ios::in | std::ios::out);
+        index.seekp(offset);
+        index.write(reinterpret_cast<const char *>(&value), sizeof(value));
+    };
+    auto first_symbol = sizeof(detail::index_file_header);
+    patch(offsetof(detail::index_file_header, version), std::uint32_t{0});
+    REQUIRE(!elf("test/targets/call_chain").symbols_from_cache());
+    REQUIRE(elf("test/targets/call_chain").symbols_from_cache());
+    patch(offsetof(detail::index_file_header, symbol_table_size), std::uint64_t{0});
+    REQUIRE(!elf("test/targets/call_chain").symbols_from_cache());
+    patch(first_symbol + offsetof(detail::indexed_symbol, name), ~std::uint32_t{0});
+    REQUIRE(!elf("test/targets/call_chain").symbols_from_cache());
+    patch(first_symbol + offsetof(detail::indexed_symbol, address), ~std::uint64_t{0});
+    REQUIRE(!elf("test/targets/call_chain").symbols_from_cache());
+    REQUIRE(elf("test/targets/call_chain").symbols_from_cache());
+
+    // Lookups of names that aren't there probe until an empty slot, so there must be one
+    detail::index_file_header header;
+    {
+        std::ifstream index(path, std::ios::binary);
+        index.read(reinterpret_cast<char *>(&header), sizeof(header));
+    }
+    auto slots_offset = first_symbol + header.symbol_count * sizeof(detail::indexed_symbol) +
+                        header.unit_count * sizeof(std::uint64_t) +
+                        header.unit_range_count * sizeof(detail::indexed_unit_range);
+    for (std::uint64_t i = 0; i < header.name_slot_count; ++i) {
+        patch(slots_offset + i * sizeof(std::uint32_t), std::uint32_t{1});
+    }
+    {
+        elf file("test/targets/call_chain");
+        REQUIRE(!file.symbols_from_cache());
+        REQUIRE(file.symbols_by_name("no_such_symbol").empty());
+    }
+    REQUIRE(elf("test/targets/call_chain").symbols_from_cache());
+
+    // The compile unit index of the line tables is saved along
+    std::size_t unit_count;
+    std::uint64_t line;
+    {
+        elf file("test/targets/step");
+        REQUIRE(!file.symbols_from_cache());
+        unit_count = file.get_dwarf().compile_unit_count();
+        REQUIRE(unit_count >= 1);
+        auto main = file.symbols_by_name("main").at(0);
+        line = file.get_dwarf().line_entry_at_address(main.address)->line;
+    }
+    {
+        elf file("test/targets/step");
+        REQUIRE(file.symbols_from_cache());
+        span<const std::uint64_t> offsets;
+        span<const detail::indexed_unit_range> ranges;
+        REQUIRE(file.cached_compile_units(offsets, ranges));
+        REQUIRE(offsets.size() == unit_count);
+        REQUIRE(!ranges.empty());
+        REQUIRE(file.get_dwarf().compile_unit_count() == unit_count);
+        auto main = file.symbols_by_name("main").at(0);
+        REQUIRE(file.get_dwarf().line_entry_at_address(main.address)->line == line);
+    }
+
+    if (old_cache) {
+        setenv("XDG_CACHE_HOME", saved.c_str(), true);
+    } else {
+        unsetenv("XDG_CACHE_HOME");
+    }
+    std::filesystem::remove_all(cache);
+}
+
+TEST_CASE("Line tables are decoded on first use", "[dwarf]") {
+    elf file("test/targets/step");
+    auto &lines = file.get_dwarf();
+    REQUIRE(lines.compile_unit_count() >= 1);
+    REQUIRE(lines.decoded_unit_count() == 0);
+
+    auto main = file.symbols_by_name("main").at(0);
+    auto entry = lines.line_entry_at_address(main.address);
+    REQUIRE(entry);
+    REQUIRE(entry->address == main.address);
+    REQUIRE(entry->line == 7);
+    REQUIRE(std::filesystem::path(entry->file).filename() == "step.cpp");
+    REQUIRE(lines.decoded_unit_count() == 1);
+
+    auto add = file.symbols_by_name("_Z3addii").at(0);
+    REQUIRE(lines.line_entry_at_address(add.address + 1)->line == 3);
+    REQUIRE(!lines.line_entry_at_address(virt_addr{0}));
+}
+
+TEST_CASE("step and next move by source line", "[dwarf]") {
+    bool close_on_exec = false;
+    jdb::pipe channel(close_on_exec);
+    auto proc = process::launch("test/targets/step", true, channel.get_write());
+    channel.close_write();
+    auto main = proc->get_elf().symbols_by_name("main").at(0).address;
+    proc->create_breakpoint_site(main).enable();
+    proc->resume();
+    proc->wait_on_signal();
+
+    auto line = [&] { return proc->line_entry_at_address(proc->get_pc())->line; };
+    REQUIRE(line() == 7);
+    REQUIRE(step_over(*proc).trap_reason == trap_type::single_step);
+    REQUIRE(line() == 8);
+    step_over(*proc);
+    REQUIRE(line() == 9);
+
+    // Into add, and back to main once it returns
+    step_in(*proc);
+    REQUIRE(proc->symbol_containing_address(proc->get_pc())->name == "_Z3addii");
+    REQUIRE(line() == 3);
+    step_over(*proc);
+    REQUIRE(line() == 4);
+    step_over(*proc);
+    REQUIRE(line() == 5);
+    step_over(*proc);
+    REQUIRE(line() == 10);
+
+    // Over add, then over printf, which has no line information
+    step_over(*proc);
+    REQUIRE(line() == 11);
+    step_in(*proc);
+    REQUIRE(line() == 12);
+
+    // The sites set to step over calls are gone
+    REQUIRE(proc->breakpoint_sites().size() == 1);
+}
+
+TEST_CASE("Shared libraries are tracked as they are loaded", "[elf]") {
+    bool close_on_exec = false;
+    jdb::pipe channel(close_on_exec);
+    auto proc = process::launch("test/targets/load_library", true, channel.get_write());
+    channel.close_write();
+    // Right after exec the dynamic linker hasn't mapped anything yet
+    proc->track_shared_libraries();
+    REQUIRE(proc->shared_libraries().empty());
+
+    auto is_plugin = [](auto &library) { return library.path.filename() == "libplugin.so"; };
+    proc->resume();
+    auto reason = proc->wait_on_signal();
+    REQUIRE(reason.info == SIGTRAP);
+    auto &libraries = proc->shared_libraries();
+    auto plugin = std::find_if(libraries.begin(), libraries.end(), is_plugin);
+    REQUIRE(plugin != libraries.end());
+    REQUIRE(plugin->file);
+    REQUIRE(libraries.size() >= 2);
+
+    auto function = virt_addr{from_bytes<std::uint64_t>(channel.read().data())};
+    REQUIRE(proc->elf_containing_address(function) == plugin->file.get());
+    REQUIRE(proc->symbol_containing_address(function)->name == "plugin_function");
+    auto loaded = proc->create_checkpoint();
+
+    proc->resume();
+    proc->wait_on_signal();
+    REQUIRE(std::none_of(libraries.begin(), libraries.end(), is_plugin));
+    REQUIRE(!proc->symbol_containing_address(function));
+
+    // Going back to before dlclose brings the library back
+    proc->restart(loaded);
+    REQUIRE(std::any_of(libraries.begin(), libraries.end(), is_plugin));
+    REQUIRE(proc->symbol_containing_address(function)->name == "plugin_function");
+}
@@ -2,17 +2,29 @@
 #include "libjdb/register_info.hpp"
 #include "libjdb/registers.hpp"
 #include <algorithm>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <editline/readline.h>
+#include <filesystem>
 #include <fmt/base.h>
 #include <fmt/format.h>
 #include <fmt/ranges.h>
+#include <fstream>
 #include <iostream>
 #include <libjdb/error.hpp>
+#include <libjdb/memory_dump.hpp>
+#include <libjdb/memory_search.hpp>
 #include <libjdb/process.hpp>
+#include <libjdb/profiler.hpp>
+#include <libjdb/snapshot.hpp>
+#include <libjdb/stepping.hpp>
+#include <libjdb/syscalls.hpp>
+#include <libjdb/trace.hpp>
+#include <limits>
 #include <memory>
+#include <optional>
 #include <sstream>
 #include <string>
 #include <string_view>
@@ -21,6 +33,7 @@
 #include <sys/wait.h>
 #include <type_traits>
 #include <unistd.h>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
@@ -34,8 +47,80 @@ bool is_prefix(std::string_view str, std::string_view of) {
 void print_help(const std::vector<std::string> &args) {
     if (args.size() == 1) {
         std::cerr << R"(Available commands:
+backtrace   - Print the call stack of the current thread
+breakpoint  - Commands for operating on breakpoints
+checkpoint  - Commands for forking the process to come back to later
 continue    - Resume the process
+interrupt   - Stop a running process
+library     - Commands for listing the loaded shared libraries
+memory      - Commands for operating on memory
+next        - Step to the next source line, over function calls
 register    - Commands for operating on register
+restart     - Go back to a checkpoint
+snapshot    - Commands for saving and comparing memory snapshots
+step        - Step to the next source line, into function calls
+stepi       - Single instruction step
+thread      - Commands for operating on threads
+trace       - Record every instruction executed to a trace file
+watchpoint  - Commands for operating on watchpoints
+)";
+    } else if (is_prefix(args[1], "watchpoint")) {
+        std::cerr << R"(Available commands:
+list
+delete <id>
+disable <id>
+enable <id>
+set <address> <write|rw|execute> <size>
+)";
+    } else if (is_prefix(args[1], "breakpoint")) {
+        std::cerr << R"(Available commands:
+list
+delete <id>
+disable <id>|all
+enable <id>|all
+set <address>|<symbol>
+set <address>|<symbol> -h
+)";
+    } else if (is_prefix(args[1], "memory")) {
+        std::cerr << R"(Available commands:
+dump <address> <number of bytes> <file>
+dump <address> <number of bytes> <file> -x
+find <bytes> [--range <start> <end>]
+find -x <hex string> [--range <start> <end>]
+find -s <text> [--range <start> <end>]
+find -u8|-u16|-u32|-u64 <decimal or 0x value> [--range <start> <end>]
+maps
+read <address>
+read <address> <number of bytes>
+write <address> <bytes>
+)";
+    } else if (is_prefix(args[1], "library")) {
+        std::cerr << R"(Available commands:
+list
+)";
+    } else if (is_prefix(args[1], "thread")) {
+        std::cerr << R"(Available commands:
+list
+select <tid>
+)";
+    } else if (is_prefix(args[1], "checkpoint")) {
+        std::cerr << R"(Available commands:
+create
+list
+Go back to one with restart <number>.
+)";
+    } else if (is_prefix(args[1], "snapshot")) {
+        std::cerr << R"(Available commands:
+save
+list
+diff <from> <to>
+diff <from>
+)";
+    } else if (is_prefix(args[1], "trace")) {
+        std::cerr << R"(Available commands:
+<count> [<file>]
+until <address> [<file>]
+The trace goes to jdb.trace by default. Read it with jdb trace-report <file>.
 )";
     } else if (is_prefix(args[1], "register")) {
         std::cerr << R"(Available commands:
@@ -149,6 +234,468 @@ void handle_register_command(jdb::process &process, const std::vector<std::strin
     }
 }
 
+// Names the symbol holding the address, as " <name+offset>", and its source line if known. Empty
+// if there's neither, or if the executable can't be read.
+std::string describe_address(const jdb::process &process, jdb::virt_addr address) {
+    std::string ret;
+    try {
+        if (auto symbol = process.symbol_containing_address(address)) {
+            auto offset = address.addr() - symbol->address.addr();
+            ret = offset ? fmt::format(" <{}+{:#x}>", symbol->name, offset)
+                         : fmt::format(" <{}>", symbol->name);
+        }
+        if (auto line = process.line_entry_at_address(address)) {
+            ret += fmt::format(" at {}:{}", std::filesystem::path(line->file).filename().string(),
+                               line->line);
+        }
+    } catch (const jdb::error &) {
+    }
+    return ret;
+}
+
+void handle_memory_read_command(jdb::process &process, const std::vector<std::string> &args) {
+    auto address = jdb::to_integral<std::uint64_t>(args[2], 16);
+    if (!address)
+        jdb::error::send("Invalid address format");
+
+    std::size_t n_bytes = 32;
+    if (args.size() == 4) {
+        auto bytes_arg = jdb::to_integral<std::size_t>(args[3]);
+        if (!bytes_arg)
+            jdb::error::send("Invalid number of bytes");
+        n_bytes = *bytes_arg;
+    }
+
+    auto data = process.read_memory_without_traps(jdb::virt_addr{*address}, n_bytes);
+    if (data.size() < n_bytes) {
+        std::cerr << fmt::format("Only {} bytes could be read\n", data.size());
+    }
+
+    // Print 16 bytes per line, prefixed with the address of the first one
+    for (std::size_t i = 0; i < data.size(); i += 16) {
+        auto start = data.begin() + i;
+        auto end = data.begin() + std::min(i + 16, data.size());
+        fmt::print("{:#016x}: {:02x}\n", *address + i, fmt::join(start, end, " "));
+    }
+}
+
+void handle_memory_write_command(jdb::process &process, const std::vector<std::string> &args) {
+    if (args.size() != 4) {
+        print_help({"help", "memory"});
+        return;
+    }
+
+    auto address = jdb::to_integral<std::uint64_t>(args[2], 16);
+    if (!address)
+        jdb::error::send("Invalid address format");
+
+    auto data = jdb::parse_vector(args[3]);
+    process.write_memory(jdb::virt_addr{*address}, {data.data(), data.size()});
+}
+
+void handle_memory_maps_command(jdb::process &process) {
+    for (auto &region : process.get_memory_map().regions()) {
+        fmt::print("{:#016x}-{:#016x} {}{}{}{} {}\n", region.start.addr(), region.end.addr(),
+                   region.readable ? 'r' : '-', region.writable ? 'w' : '-',
+                   region.executable ? 'x' : '-', region.shared ? 's' : 'p', region.name);
+    }
+}
+
+// Bytes given as a string of hex digits, in memory order: "deadbeef" is de ad be ef
+std::vector<std::byte> parse_hex_string(std::string_view text) {
+    if (text.size() % 2 != 0)
+        jdb::error::send("Hex string needs an even number of digits");
+    std::vector<std::byte> bytes;
+    for (std::size_t i = 0; i < text.size(); i += 2) {
+        auto byte = jdb::to_integral<std::byte>(text.substr(i, 2), 16);
+        if (!byte)
+            jdb::error::send("Invalid hex string");
+        bytes.push_back(*byte);
+    }
+    return bytes;
+}
+
+void handle_memory_find_command(jdb::process &process, const std::vector<std::string> &args) {
+    // memory find <pattern...> [--range <start> <end>]
+    auto pattern_end = args.size();
+    jdb::virt_addr start{0};
+    jdb::virt_addr end{std::numeric_limits<std::uint64_t>::max()};
+    if (args.size() >= 6 && args[args.size() - 3] == "--range") {
+        auto low = jdb::to_integral<std::uint64_t>(args[args.size() - 2], 16);
+        auto high = jdb::to_integral<std::uint64_t>(args[args.size() - 1], 16);
+        if (!low || !high)
+            jdb::error::send("Invalid address format");
+        start = jdb::virt_addr{*low};
+        end = jdb::virt_addr{*high};
+        pattern_end -= 3;
+    }
+
+    std::vector<std::byte> pattern;
+    std::size_t alignment = 1;
+    if (pattern_end == 3) {
+        pattern = jdb::parse_vector(args[2]);
+    } else if (pattern_end == 4 && args[2] == "-x") {
+        pattern = parse_hex_string(args[3]);
+    } else if (pattern_end == 4 && args[2] == "-s") {
+        pattern.resize(args[3].size());
+        std::memcpy(pattern.data(), args[3].data(), args[3].size());
+    } else if (pattern_end == 4 && args[2].rfind("-u", 0) == 0) {
+        auto bits = jdb::to_integral<std::size_t>(std::string_view(args[2]).substr(2));
+        if (!bits || (*bits != 8 && *bits != 16 && *bits != 32 && *bits != 64))
+            jdb::error::send("Invalid integer size");
+        // Decimal, unless the value starts with 0x
+        auto value = args[3].rfind("0x", 0) == 0 ? jdb::to_integral<std::uint64_t>(args[3], 16)
+                                                 : jdb::to_integral<std::uint64_t>(args[3]);
+        if (!value || (*bits < 64 && *value >> *bits != 0))
+            jdb::error::send("Invalid integer value");
+        // Little endian, and only at addresses the type would be aligned to
+        alignment = *bits / 8;
+        pattern.resize(alignment);
+        std::memcpy(pattern.data(), &*value, alignment);
+    } else {
+        print_help({"help", "memory"});
+        return;
+    }
+
+    constexpr std::size_t max_matches = 1000;
+    jdb::memory_searcher searcher(process);
+    auto matches = searcher.find(pattern, start, end, alignment, max_matches);
+    for (auto match : matches) {
+        fmt::print("{:#016x}{}\n", match.addr(), describe_address(process, match));
+    }
+    fmt::print("{} matches in {} bytes{}\n", matches.size(), searcher.bytes_scanned(),
+               matches.size() == max_matches ? ", stopped at the limit" : "");
+}
+
+void handle_memory_dump_command(jdb::process &process, const std::vector<std::string> &args) {
+    // memory dump <address> <number of bytes> <file> [-x]
+    if (args.size() != 5 && !(args.size() == 6 && args[5] == "-x")) {
+        print_help({"help", "memory"});
+        return;
+    }
+    auto address = jdb::to_integral<std::uint64_t>(args[2], 16);
+    if (!address)
+        jdb::error::send("Invalid address format");
+    auto n_bytes = args[3].rfind("0x", 0) == 0 ? jdb::to_integral<std::uint64_t>(args[3], 16)
+                                               : jdb::to_integral<std::uint64_t>(args[3]);
+    if (!n_bytes)
+        jdb::error::send("Invalid number of bytes");
+
+    auto format = args.size() == 6 ? jdb::dump_format::hex : jdb::dump_format::raw;
+    auto stats = jdb::dump_memory(process, jdb::virt_addr{*address}, *n_bytes, args[4], format);
+    fmt::print("Dumped {} bytes to {}\n", *n_bytes, args[4]);
+    if (stats.bytes_unreadable) {
+        std::cerr << fmt::format("{} bytes could not be read and were written as zeros\n",
+                                 stats.bytes_unreadable);
+    }
+}
+
+void handle_memory_command(jdb::process &process, const std::vector<std::string> &args) {
+    if (args.size() == 2 && is_prefix(args[1], "maps")) {
+        try {
+            handle_memory_maps_command(process);
+        } catch (jdb::error &err) {
+            std::cerr << err.what() << '\n';
+        }
+        return;
+    }
+    if (args.size() < 3) {
+        print_help({"help", "memory"});
+        return;
+    }
+    try {
+        if (is_prefix(args[1], "dump")) {
+            handle_memory_dump_command(process, args);
+        } else if (is_prefix(args[1], "find")) {
+            handle_memory_find_command(process, args);
+        } else if (is_prefix(args[1], "read")) {
+            handle_memory_read_command(process, args);
+        } else if (is_prefix(args[1], "write")) {
+            handle_memory_write_command(process, args);
+        } else {
+            print_help({"help", "memory"});
+        }
+    } catch (jdb::error &err) {
+        std::cerr << err.what() << '\n';
+    }
+}
+
+void handle_breakpoint_command(jdb::process &process, const std::vector<std::string> &args) {
+    if (args.size() < 2) {
+        print_help({"help", "breakpoint"});
+        return;
+    }
+
+    auto command = args[1];
+
+    if (is_prefix(command, "list")) {
+        // Sites jdb set for itself aren't the user's business
+        std::vector<const jdb::breakpoint_site *> sites;
+        process.breakpoint_sites().for_each([&](auto &site) {
+            if (!site.is_internal())
+                sites.push_back(&site);
+        });
+        if (sites.empty()) {
+            fmt::print("No breakpoints set\n");
+        } else {
+            fmt::print("Current breakpoints:\n");
+            for (auto site : sites) {
+                fmt::print("{}: address = {:#x}, {}{}\n", site->id(), site->address().addr(),
+                           site->is_enabled() ? "enabled" : "disabled",
+                           site->is_hardware() ? ", hardware" : "");
+            }
+        }
+        return;
+    }
+
+    if (args.size() < 3) {
+        print_help({"help", "breakpoint"});
+        return;
+    }
+
+    try {
+        if (is_prefix(command, "set")) {
+            auto address = jdb::to_integral<std::uint64_t>(args[2], 16);
+            // Anything that isn't an address is taken as a symbol name
+            if (!address) {
+                auto symbols = process.get_elf().symbols_by_name(args[2]);
+                if (symbols.empty()) {
+                    fmt::print(stderr, "Breakpoint command expects address in hexadecimal, "
+                                       "prefixed with '0x', or a symbol name\n");
+                    return;
+                }
+                address = symbols.front().address.addr();
+            }
+            bool hardware = args.size() == 4 && args[3] == "-h";
+            process.create_breakpoint_site(jdb::virt_addr{*address}, hardware).enable();
+            return;
+        }
+
+        // enable and disable accept "all", which patches every site in one batch
+        if ((is_prefix(command, "enable") || is_prefix(command, "disable")) && args[2] == "all") {
+            std::vector<jdb::breakpoint_site *> sites;
+            process.breakpoint_sites().for_each([&](auto &site) {
+                if (!site.is_internal())
+                    sites.push_back(&site);
+            });
+            process.set_breakpoint_sites_enabled(sites, is_prefix(command, "enable"));
+            return;
+        }
+
+        auto id = jdb::to_integral<jdb::breakpoint_site::id_type>(args[2]);
+        if (!id) {
+            std::cerr << "Command expects breakpoint id\n";
+            return;
+        }
+
+        if (is_prefix(command, "enable")) {
+            process.breakpoint_sites().get_by_id(*id).enable();
+        } else if (is_prefix(command, "disable")) {
+            process.breakpoint_sites().get_by_id(*id).disable();
+        } else if (is_prefix(command, "delete")) {
+            process.breakpoint_sites().remove_by_id(*id);
+        } else {
+            print_help({"help", "breakpoint"});
+        }
+    } catch (jdb::error &err) {
+        std::cerr << err.what() << '\n';
+    }
+}
+
+void handle_watchpoint_list(jdb::process &process) {
+    auto stoppoint_mode_to_string = [](auto mode) {
+        switch (mode) {
+        case jdb::stoppoint_mode::execute:
+            return "execute";
+        case jdb::stoppoint_mode::write:
+            return "write";
+        case jdb::stoppoint_mode::read_write:
+            return "read_write";
+        default:
+            jdb::error::send("Invalid stoppoint mode");
+        }
+    };
+
+    if (process.watchpoints().empty()) {
+        fmt::print("No watchpoints set\n");
+    } else {
+        fmt::print("Current watchpoints:\n");
+        process.watchpoints().for_each([&](auto &point) {
+            fmt::print("{}: address = {:#x}, mode = {}, size = {}, {}\n", point.id(),
+                       point.address().addr(), stoppoint_mode_to_string(point.mode()),
+                       point.size(), point.is_enabled() ? "enabled" : "disabled");
+        });
+    }
+}
+
+void handle_watchpoint_set(jdb::process &process, const std::vector<std::string> &args) {
+    if (args.size() != 5) {
+        print_help({"help", "watchpoint"});
+        return;
+    }
+
+    auto address = jdb::to_integral<std::uint64_t>(args[2], 16);
+    auto mode_text = args[3];
+    auto size = jdb::to_integral<std::size_t>(args[4]);
+
+    if (!address || !size || !(mode_text == "write" || mode_text == "rw" || mode_text == "execute")) {
+        print_help({"help", "watchpoint"});
+        return;
+    }
+
+    jdb::stoppoint_mode mode;
+    if (mode_text == "write")
+        mode = jdb::stoppoint_mode::write;
+    else if (mode_text == "rw")
+        mode = jdb::stoppoint_mode::read_write;
+    else
+        mode = jdb::stoppoint_mode::execute;
+
+    process.create_watchpoint(jdb::virt_addr{*address}, mode, *size).enable();
+}
+
+void handle_watchpoint_command(jdb::process &process, const std::vector<std::string> &args) {
+    if (args.size() < 2) {
+        print_help({"help", "watchpoint"});
+        return;
+    }
+
+    auto command = args[1];
+
+    if (is_prefix(command, "list")) {
+        handle_watchpoint_list(process);
+        return;
+    }
+
+    try {
+        if (is_prefix(command, "set")) {
+            handle_watchpoint_set(process, args);
+            return;
+        }
+
+        if (args.size() < 3) {
+            print_help({"help", "watchpoint"});
+            return;
+        }
+
+        auto id = jdb::to_integral<jdb::watchpoint::id_type>(args[2]);
+        if (!id) {
+            std::cerr << "Command expects watchpoint id\n";
+            return;
+        }
+
+        if (is_prefix(command, "enable")) {
+            process.watchpoints().get_by_id(*id).enable();
+        } else if (is_prefix(command, "disable")) {
+            process.watchpoints().get_by_id(*id).disable();
+        } else if (is_prefix(command, "delete")) {
+            process.watchpoints().remove_by_id(*id);
+        } else {
+            print_help({"help", "watchpoint"});
+        }
+    } catch (jdb::error &err) {
+        std::cerr << err.what() << '\n';
+    }
+}
+
+void handle_library_command(jdb::process &process, const std::vector<std::string> &args) {
+    if (args.size() < 2 || !is_prefix(args[1], "list")) {
+        print_help({"help", "library"});
+        return;
+    }
+    for (auto &library : process.shared_libraries()) {
+        if (library.file) {
+            fmt::print("{:#x} {}\n", library.file->load_bias(), library.path.string());
+        } else {
+            fmt::print("{:>18} {}\n", "-", library.path.string());
+        }
+    }
+}
+
+void handle_thread_command(jdb::process &process, const std::vector<std::string> &args) {
+    if (args.size() < 2) {
+        print_help({"help", "thread"});
+        return;
+    }
+
+    auto command = args[1];
+    if (is_prefix(command, "list")) {
+        // The map is unordered, so sort by tid for a stable listing
+        std::vector<const jdb::thread_state *> threads;
+        for (auto &[tid, thread] : process.thread_states()) {
+            threads.push_back(&thread);
+        }
+        std::sort(threads.begin(), threads.end(),
+                  [](auto lhs, auto rhs) { return lhs->tid < rhs->tid; });
+        for (auto thread : threads) {
+            auto marker = thread->tid == process.current_thread() ? '*' : ' ';
+            if (thread->state == jdb::process_state::stopped) {
+                fmt::print("{} {}: stopped at {:#x}\n", marker, thread->tid,
+                           process.get_pc(thread->tid).addr());
+            } else {
+                fmt::print("{} {}: running\n", marker, thread->tid);
+            }
+        }
+    } else if (is_prefix(command, "select") && args.size() == 3) {
+        auto tid = jdb::to_integral<pid_t>(args[2]);
+        if (!tid) {
+            std::cerr << "Command expects thread id\n";
+            return;
+        }
+        try {
+            process.set_current_thread(*tid);
+        } catch (jdb::error &err) {
+            std::cerr << err.what() << '\n';
+        }
+    } else {
+        print_help({"help", "thread"});
+    }
+}
+
+// jdb trace-report <file> [--top <count>]
+int run_trace_report(int argc, const char **argv) {
+    if (argc != 3 && !(argc == 5 && argv[3] == std::string_view("--top"))) {
+        fmt::print(stderr, "Usage: jdb trace-report <file> [--top <count>]\n");
+        return -1;
+    }
+    std::size_t top = 20;
+    if (argc == 5) {
+        auto count = jdb::to_integral<std::size_t>(argv[4]);
+        if (!count) {
+            fmt::print(stderr, "Invalid count\n");
+            return -1;
+        }
+        top = *count;
+    }
+
+    jdb::trace_reader trace(argv[2]);
+    std::unordered_map<std::uint64_t, std::uint64_t> hits;
+    auto start = std::chrono::steady_clock::now();
+    trace.for_each([&](std::uint64_t pc) { ++hits[pc]; });
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> hottest(hits.begin(), hits.end());
+    auto shown = std::min(top, hottest.size());
+    std::partial_sort(hottest.begin(), hottest.begin() + shown, hottest.end(),
+                      [](auto &lhs, auto &rhs) { return lhs.second > rhs.second; });
+    for (std::size_t i = 0; i < shown; ++i) {
+        fmt::print("{:#018x} {}\n", hottest[i].first, hottest[i].second);
+    }
+    fmt::print(stderr, "{} instructions ({} recorded), {} distinct addresses, decoded in {:.3f}s\n",
+               trace.size(), trace.records_written(), hits.size(), elapsed.count());
+    return 0;
+}
+
+std::vector<std::string> split(std::string_view str, char delimiter) {
+    std::vector<std::string> out{};
+    std::stringstream ss{std::string{str}};
+    std::string item;
+    while (std::getline(ss, item, delimiter)) {
+        out.push_back(item);
+    }
+    return out;
+}
+
 std::unique_ptr<jdb::process> attach(int argc, const char **argv) {
     pid_t pid = 0;
     // Passing a PID
@@ -156,20 +703,131 @@ std::unique_ptr<jdb::process> attach(int argc, const char **argv) {
         // In this branch, the program will attach to a running process
         pid = std::atoi(argv[2]);
         return jdb::process::attach(pid);
+    } else if (argc == 3 && argv[1] == std::string_view("-s")) {
+        // Same, but the process keeps running until the interrupt command
+        pid = std::atoi(argv[2]);
+        return jdb::process::seize(pid);
+    } else if (argc == 4 && argv[1] == std::string_view("--syscalls")) {
+        // Launches the program stopping only at the given comma separated syscalls
+        std::vector<int> traced;
+        for (auto &name : split(argv[2], ',')) {
+            auto id = jdb::to_integral<int>(name);
+            traced.push_back(id ? *id : jdb::syscall_name_to_id(name));
+        }
+        return jdb::process::launch(argv[3], true, std::nullopt, traced);
     } else {
         const char *program_path = argv[1];
         return jdb::process::launch(program_path);
     }
 }
 
-std::vector<std::string> split(std::string_view str, char delimiter) {
-    std::vector<std::string> out{};
-    std::stringstream ss{std::string{str}};
-    std::string item;
-    while (std::getline(ss, item, delimiter)) {
-        out.push_back(item);
+// Accepts a number followed by ms, s or m. A bare number is in seconds.
+std::optional<std::chrono::milliseconds> parse_duration(std::string_view text) {
+    std::uint64_t scale = 1000;
+    if (text.size() > 2 && text.substr(text.size() - 2) == "ms") {
+        scale = 1;
+        text.remove_suffix(2);
+    } else if (!text.empty() && text.back() == 's') {
+        text.remove_suffix(1);
+    } else if (!text.empty() && text.back() == 'm') {
+        scale = 60 * 1000;
+        text.remove_suffix(1);
     }
-    return out;
+    auto value = jdb::to_integral<std::uint64_t>(text);
+    if (!value) {
+        return std::nullopt;
+    }
+    return std::chrono::milliseconds(*value * scale);
+}
+
+// jdb profile -p <pid> [--hz <rate>] [--duration <time>] [-o <file>]
+int run_profile(int argc, const char **argv) {
+    std::optional<pid_t> pid;
+    double hz = 99;
+    std::chrono::milliseconds duration = std::chrono::seconds(10);
+    const char *output_path = nullptr;
+    bool use_perf = false;
+
+    for (int i = 2; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--perf") {
+            use_perf = true;
+            continue;
+        }
+        if (i + 1 == argc) {
+            fmt::print(stderr, "Missing value for {}\n", arg);
+            return -1;
+        }
+        std::string_view value = argv[++i];
+        if (arg == "-p") {
+            pid = jdb::to_integral<pid_t>(value);
+        } else if (arg == "--hz") {
+            auto rate = jdb::to_float<double>(value);
+            if (!rate || *rate <= 0) {
+                fmt::print(stderr, "Invalid sampling rate\n");
+                return -1;
+            }
+            hz = *rate;
+        } else if (arg == "--duration") {
+            auto parsed = parse_duration(value);
+            if (!parsed) {
+                fmt::print(stderr, "Invalid duration, expected e.g. 30s or 500ms\n");
+                return -1;
+            }
+            duration = *parsed;
+        } else if (arg == "-o") {
+            output_path = argv[i];
+        } else {
+            fmt::print(stderr, "Unknown profile option {}\n", arg);
+            return -1;
+        }
+    }
+    if (!pid) {
+        fmt::print(stderr, "Usage: jdb profile -p <pid> [--hz <rate>] [--duration <time>] "
+                           "[-o <file>] [--perf]\n");
+        return -1;
+    }
+
+    auto write_stacks = [&](const jdb::stack_table &stacks) {
+        if (output_path) {
+            std::ofstream out(output_path);
+            stacks.write_folded(out);
+        } else {
+            stacks.write_folded(std::cout);
+        }
+    };
+
+    if (use_perf) {
+        // The kernel does the sampling, so the process isn't traced at all
+        jdb::perf_profiler profiler(*pid, hz);
+        auto samples = profiler.run(duration);
+        write_stacks(profiler.stacks());
+        auto event = profiler.sampled_event() == jdb::perf_profiler::event::cycles ? "cycles"
+                                                                                   : "cpu-clock";
+        fmt::print(stderr, "{} samples of {}, {} lost, {} distinct stacks\n", samples, event,
+                   profiler.lost(), profiler.stacks().size());
+        return 0;
+    }
+
+    // Seizing leaves the process running, so it only pauses for the samples themselves
+    auto process = jdb::process::seize(*pid);
+    // Without the library list, only the executable's frames would be unwound with CFI. Reading
+    // it takes one stop of its own.
+    process->interrupt();
+    if (process->wait_on_signal().reason != jdb::process_state::stopped) {
+        fmt::print(stderr, "Process {} ended\n", *pid);
+        return -1;
+    }
+    process->track_shared_libraries();
+    process->resume();
+    jdb::sampling_profiler profiler(*process);
+    auto samples = profiler.run(hz, duration);
+
+    auto &stacks = profiler.stacks();
+    write_stacks(stacks);
+    fmt::print(stderr, "{} samples, {} thread stacks, {} distinct\n", samples,
+               stacks.total_samples(), stacks.size());
+    return 0;
 }
 
 void print_stop_reason(const jdb::process &process, jdb::stop_reason reason) {
@@ -182,11 +840,198 @@ void print_stop_reason(const jdb::process &process, jdb::stop_reason reason) {
         message = fmt::format("terminated with signal {}", sigabbrev_np(reason.info));
         break;
     case jdb::process_state::stopped:
-        message = fmt::format("stopped with signal {} at {:#x}", sigabbrev_np(reason.info),
-                              process.get_pc().addr());
+        auto pc = process.get_pc();
+        message = fmt::format("stopped with signal {} at {:#x}{}", sigabbrev_np(reason.info),
+                              pc.addr(), describe_address(process, pc));
+        if (reason.trap_reason == jdb::trap_type::software_break) {
+            // The inferior may contain int3 instructions of its own
+            if (auto site = process.breakpoint_sites().find_by_address(process.get_pc());
+                site && !site->is_internal()) {
+                message += fmt::format(" (breakpoint {})", site->id());
+            }
+        } else if (reason.trap_reason == jdb::trap_type::hardware_break) {
+            auto id = process.get_current_hardware_stoppoint();
+            if (id.index() == 0) {
+                message += fmt::format(" (breakpoint {})", std::get<0>(id));
+            } else {
+                auto &point = process.watchpoints().get_by_id(std::get<1>(id));
+                message += fmt::format(" (watchpoint {})", point.id());
+                if (point.data() == point.previous_data()) {
+                    message += fmt::format("\nValue: {:#x}", point.data());
+                } else {
+                    message += fmt::format("\nOld value: {:#x}\nNew value: {:#x}",
+                                           point.previous_data(), point.data());
+                }
+            }
+        } else if (reason.trap_reason == jdb::trap_type::single_step) {
+            message += " (single step)";
+        } else if (reason.trap_reason == jdb::trap_type::interrupt) {
+            message += " (interrupted)";
+        } else if (reason.trap_reason == jdb::trap_type::syscall) {
+            auto &info = *reason.syscall_info;
+            auto name = jdb::syscall_id_to_name(info.id);
+            if (info.entry) {
+                message += fmt::format(" (syscall entry)\nsyscall: {}({:#x})", name,
+                                       fmt::join(info.args, ", "));
+            } else {
+                // Errors come back as negative errno values, which read best in decimal
+                message += fmt::format(" (syscall exit)\nsyscall: {} returned {}", name, info.ret);
+            }
+        }
         break;
     }
-    fmt::print("Process {} {}\n", process.pid(), message);
+    // Stops of the main thread read just like they did before threads were tracked
+    if (reason.tid != 0 && reason.tid != process.pid()) {
+        fmt::print("Process {} thread {} {}\n", process.pid(), reason.tid, message);
+    } else {
+        fmt::print("Process {} {}\n", process.pid(), message);
+    }
+}
+
+// Prints what the inferior spent since it was resumed. Counters the CPU lacks are left out.
+void print_counters(const jdb::perf_counts &counts) {
+    std::string message;
+    auto append = [&](const char *name, std::optional<std::uint64_t> value) {
+        if (value) {
+            message += fmt::format("{}{} {}", message.empty() ? "" : ", ", *value, name);
+        }
+    };
+    append("instructions", counts.instructions);
+    append("cycles", counts.cycles);
+    append("cache misses", counts.cache_misses);
+    append("branch misses", counts.branch_misses);
+    if (!message.empty()) {
+        fmt::print("{}\n", message);
+    }
+}
+
+void handle_snapshot_command(jdb::process &process, const std::vector<std::string> &args) {
+    if (args.size() < 2) {
+        print_help({"help", "snapshot"});
+        return;
+    }
+    // Snapshots belong to the process they were taken of
+    static std::unique_ptr<jdb::snapshot_store> snapshots;
+    static pid_t snapshots_pid = 0;
+    if (!snapshots || snapshots_pid != process.pid()) {
+        snapshots = std::make_unique<jdb::snapshot_store>(process);
+        snapshots_pid = process.pid();
+    }
+
+    auto command = args[1];
+    if (is_prefix(command, "save")) {
+        auto index = snapshots->save();
+        auto &snap = snapshots->get(index);
+        std::size_t pages = 0;
+        for (auto &region : snap.regions) {
+            pages += region.pages.size();
+        }
+        fmt::print("Snapshot {}: {} pages in {} regions, {} copied, {} distinct pages stored\n",
+                   index, pages, snap.regions.size(), snap.pages_copied,
+                   snapshots->pages().size());
+    } else if (is_prefix(command, "list")) {
+        for (std::size_t i = 0; i < snapshots->size(); ++i) {
+            fmt::print("{}: {} regions, {} pages copied\n", i,
+                       snapshots->get(i).regions.size(), snapshots->get(i).pages_copied);
+        }
+        if (!snapshots->tracks_dirty_pages()) {
+            fmt::print("Soft-dirty tracking is unavailable, so every snapshot copies every page\n");
+        }
+    } else if (is_prefix(command, "diff") && (args.size() == 3 || args.size() == 4)) {
+        auto from = jdb::to_integral<std::size_t>(args[2]);
+        // Without a second snapshot, compare with the latest one
+        auto to = args.size() == 4 ? jdb::to_integral<std::size_t>(args[3])
+                                   : std::optional<std::size_t>(snapshots->size() - 1);
+        if (!from || !to || *from >= snapshots->size() || *to >= snapshots->size()) {
+            std::cerr << "No such snapshot\n";
+            return;
+        }
+        for (auto &change : snapshots->diff(*from, *to)) {
+            const char *kind = change.type == jdb::snapshot_change::kind::added     ? "added"
+                               : change.type == jdb::snapshot_change::kind::removed ? "removed"
+                                                                                    : "modified";
+            fmt::print("{:#x}-{:#x} {}\n", change.start.addr(),
+                       change.start.addr() + change.size, kind);
+        }
+    } else {
+        print_help({"help", "snapshot"});
+    }
+}
+
+void handle_checkpoint_command(jdb::process &process, const std::vector<std::string> &args) {
+    if (args.size() < 2) {
+        print_help({"help", "checkpoint"});
+        return;
+    }
+    if (is_prefix(args[1], "create")) {
+        auto index = process.create_checkpoint();
+        fmt::print("Checkpoint {} at {:#x} (process {})\n", index, process.get_pc().addr(),
+                   process.checkpoints()[index].pid);
+    } else if (is_prefix(args[1], "list")) {
+        auto &checkpoints = process.checkpoints();
+        for (std::size_t i = 0; i < checkpoints.size(); ++i) {
+            fmt::print("{}: {:#x} (process {})\n", i, checkpoints[i].pc.addr(),
+                       checkpoints[i].pid);
+        }
+    } else {
+        print_help({"help", "checkpoint"});
+    }
+}
+
+void handle_restart_command(jdb::process &process, const std::vector<std::string> &args) {
+    auto index = args.size() == 2 ? jdb::to_integral<std::size_t>(args[1]) : std::nullopt;
+    if (!index) {
+        std::cerr << "Command expects a checkpoint number\n";
+        return;
+    }
+    process.restart(*index);
+    fmt::print("Process {} restarted from checkpoint {} at {:#x}\n", process.pid(), *index,
+               process.get_pc().addr());
+}
+
+void handle_trace_command(jdb::process &process, const std::vector<std::string> &args) {
+    std::uint64_t max_steps = std::numeric_limits<std::uint64_t>::max();
+    std::optional<jdb::virt_addr> until;
+    std::size_t path_index = 2;
+    if (args.size() >= 3 && is_prefix(args[1], "until")) {
+        auto address = jdb::to_integral<std::uint64_t>(args[2], 16);
+        if (!address) {
+            std::cerr << "Command expects address in hexadecimal, prefixed with '0x'\n";
+            return;
+        }
+        until = jdb::virt_addr{*address};
+        path_index = 3;
+    } else if (args.size() >= 2) {
+        auto count = jdb::to_integral<std::uint64_t>(args[1]);
+        if (!count) {
+            std::cerr << "Command expects an instruction count\n";
+            return;
+        }
+        max_steps = *count;
+    } else {
+        print_help({"help", "trace"});
+        return;
+    }
+    std::string path = args.size() > path_index ? args[path_index] : "jdb.trace";
+
+    jdb::trace_writer out(path);
+    auto reason = jdb::trace_instructions(process, out, max_steps, until);
+    fmt::print("Traced {} instructions to {}\n", out.records_written(), path);
+    if (reason) {
+        print_stop_reason(process, *reason);
+    }
+}
+
+void handle_backtrace_command(jdb::process &process) {
+    try {
+        auto frames = process.backtrace();
+        for (std::size_t i = 0; i < frames.size(); ++i) {
+            fmt::print("#{:<3} {:#018x}{}\n", i, frames[i].addr(),
+                       describe_address(process, frames[i]));
+        }
+    } catch (jdb::error &err) {
+        std::cerr << err.what() << '\n';
+    }
 }
 
 void handle_command(std::unique_ptr<jdb::process> &process, std::string_view line) {
@@ -196,8 +1041,44 @@ void handle_command(std::unique_ptr<jdb::process> &process, std::string_view lin
         process->resume();
         auto reason = process->wait_on_signal();
         print_stop_reason(*process, reason);
+        if (reason.counters) {
+            print_counters(*reason.counters);
+        }
+    } else if (is_prefix(command, "breakpoint")) {
+        handle_breakpoint_command(*process, args);
+    } else if (is_prefix(command, "backtrace")) {
+        handle_backtrace_command(*process);
+    } else if (is_prefix(command, "watchpoint")) {
+        handle_watchpoint_command(*process, args);
+    } else if (is_prefix(command, "step")) {
+        auto reason = jdb::step_in(*process);
+        print_stop_reason(*process, reason);
+    } else if (is_prefix(command, "next")) {
+        auto reason = jdb::step_over(*process);
+        print_stop_reason(*process, reason);
+    } else if (is_prefix(command, "stepi")) {
+        auto reason = process->step_instruction();
+        print_stop_reason(*process, reason);
+    } else if (is_prefix(command, "memory")) {
+        handle_memory_command(*process, args);
     } else if (is_prefix(command, "register")) {
         handle_register_command(*process, args);
+    } else if (is_prefix(command, "thread")) {
+        handle_thread_command(*process, args);
+    } else if (is_prefix(command, "library")) {
+        handle_library_command(*process, args);
+    } else if (is_prefix(command, "trace")) {
+        handle_trace_command(*process, args);
+    } else if (is_prefix(command, "snapshot")) {
+        handle_snapshot_command(*process, args);
+    } else if (is_prefix(command, "checkpoint")) {
+        handle_checkpoint_command(*process, args);
+    } else if (is_prefix(command, "restart")) {
+        handle_restart_command(*process, args);
+    } else if (is_prefix(command, "interrupt")) {
+        process->interrupt();
+        auto reason = process->wait_on_signal();
+        print_stop_reason(*process, reason);
     } else if (is_prefix(command, "help")) {
         print_help(args);
     } else {
@@ -241,7 +1122,21 @@ int main(int argc, const char **argv) {
         return -1;
     }
     try {
+        if (argv[1] == std::string_view("profile")) {
+            return run_profile(argc, argv);
+        }
+        if (argv[1] == std::string_view("trace-report")) {
+            return run_trace_report(argc, argv);
+        }
         auto process = attach(argc, argv);
+        // Seized processes keep running, so they only get the executable's symbols
+        if (process->state() == jdb::process_state::stopped) {
+            try {
+                process->track_shared_libraries();
+            } catch (const jdb::error &err) {
+                std::cerr << "Shared libraries won't be tracked: " << err.what() << '\n';
+            }
+        }
         main_loop(process);
     } catch (const jdb::error &err) {
         std::cout << err.what() << '\n';